@@ -0,0 +1,88 @@
+#include "AttractorField.h"
+#include "ThreadPool.h"
+#include <cmath>
+
+// Node rows per parallel chunk of a rebuild
+const int ATTRACTOR_FIELD_ROWS_PER_CHUNK = 4;
+
+// Functions
+bool sameAttractor(const attractive_particle& a, const attractive_particle& b);
+
+bool sameAttractor(const attractive_particle& a, const attractive_particle& b) {
+    return a.id == b.id && a.removed == b.removed && a.position == b.position
+        && a.attractionRadius == b.attractionRadius && a.attraction == b.attraction;
+}
+
+bool attractorFieldStale(const attractor_field& field, const std::vector<attractive_particle>& attractive_particles) {
+    if (!field.valid || field.built.size() != attractive_particles.size()) {
+        return true;
+    }
+    for (size_t a = 0; a < attractive_particles.size(); a++) {
+        if (!sameAttractor(field.built[a], attractive_particles[a])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Each row of nodes sums the attractors in order, over the nodes their
+// reach covers, so rows are independent and the sums do not depend on the
+// thread count. A node on an attractor gets no pull from it, there is no
+// direction to pull in.
+void buildAttractorField(attractor_field& field, const std::vector<attractive_particle>& attractive_particles, float width, float height, float cellSize) {
+    field.cellSize = cellSize;
+    field.columns = std::max(1, static_cast<int>(std::ceil(width / cellSize)));
+    field.rows = std::max(1, static_cast<int>(std::ceil(height / cellSize)));
+    const int stride = field.columns + 1;
+    field.ax.assign(stride * (field.rows + 1), 0.f);
+    field.ay.assign(stride * (field.rows + 1), 0.f);
+    parallelFor(field.rows + 1, ATTRACTOR_FIELD_ROWS_PER_CHUNK, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            const float y = row * cellSize;
+            for (const auto& p : attractive_particles) {
+                const float reach = p.attractionRadius + ATTRACTOR_FIELD_PARTICLE_RADIUS;
+                if (p.removed || std::fabs(p.position.y - y) > reach) {
+                    continue;
+                }
+                const int first = std::max(0, static_cast<int>(std::ceil((p.position.x - reach) / cellSize)));
+                const int last = std::min(field.columns, static_cast<int>(std::floor((p.position.x + reach) / cellSize)));
+                for (int column = first; column <= last; column++) {
+                    const sf::Vector2f distance = p.position - sf::Vector2f(column * cellSize, y);
+                    const float absoluteDistance = hypot(distance.x, distance.y);
+                    if (absoluteDistance > reach || absoluteDistance == 0) {
+                        continue;
+                    }
+                    const sf::Vector2f distanceNorm = normalize(distance);
+                    field.ax[row * stride + column] += distanceNorm.x * p.attraction.x;
+                    field.ay[row * stride + column] += distanceNorm.y * p.attraction.y;
+                }
+            }
+        }
+    });
+    field.built = attractive_particles;
+    field.valid = true;
+}
+
+// Bound on the length of the difference between the sampled pull at a point
+// and the exact one for a particle of any radius there
+float attractorFieldErrorBound(const attractor_field& field, float x, float y) {
+    const float diagonal = field.cellSize * std::sqrt(2.f);
+    float bound = 0;
+    for (const auto& p : field.built) {
+        if (p.removed) {
+            continue;
+        }
+        const float r = hypot(p.position.x - x, p.position.y - y);
+        const float pull = hypot(p.attraction.x, p.attraction.y);
+        if (r > p.attractionRadius + MAX_RADIUS + diagonal) {
+            continue;
+        }
+        if (r < diagonal || r > p.attractionRadius + MIN_RADIUS - diagonal) {
+            bound += 2 * pull;
+            continue;
+        }
+        const float nearest = r - diagonal;
+        bound += std::min(2 * pull, field.cellSize * field.cellSize / 8 * 2.16f * pull / (nearest * nearest));
+    }
+    return bound;
+}
@@ -0,0 +1,300 @@
+#include "BarnesHut.h"
+#include "MortonOrder.h"
+#include "RadixSort.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+// Bits per axis of the codes, so the tree is at most this deep
+const int BARNES_HUT_LEVELS = 16;
+// The top of the tree is split until runs are this small, or a 64th of the
+// bodies when that is more, and each such run is one parallel task
+const int BARNES_HUT_TASK_BODIES = PARALLEL_GRAIN;
+const int BARNES_HUT_TASKS = 64;
+// Removed particles sort after every live one; live codes never reach it
+// since coordinates stop one short of the 16 bit maximum
+const unsigned int BARNES_HUT_REMOVED = 0xFFFFFFFFu;
+const int BARNES_HUT_STACK = 4 * BARNES_HUT_LEVELS + 4;
+
+// Functions
+void buildBarnesHutNode(barnes_hut_tree& tree, std::vector<barnes_hut_node>& nodes, int slot, int level, int taskBodies);
+void sumBarnesHutNode(const barnes_hut_tree& tree, std::vector<barnes_hut_node>& nodes, int slot);
+int barnesHutLevel(const barnes_hut_tree& tree, const barnes_hut_node& node);
+
+// Fills in the node at slot, whose bounds and body range are already set,
+// then its children. With taskBodies, runs that small are left for a task
+// and their centre of mass is only summed once the tasks are done.
+void buildBarnesHutNode(barnes_hut_tree& tree, std::vector<barnes_hut_node>& nodes, int slot, int level, int taskBodies) {
+    const int begin = nodes[slot].begin;
+    const int end = nodes[slot].end;
+    nodes[slot].firstChild = -1;
+    nodes[slot].children = 0;
+    if (end - begin <= BARNES_HUT_LEAF_BODIES || level == BARNES_HUT_LEVELS) {
+        sumBarnesHutNode(tree, nodes, slot);
+        return;
+    }
+    if (end - begin <= taskBodies) {
+        tree.tasks.push_back(slot);
+        return;
+    }
+    // Every code in the run shares the bits above shift, the two at shift
+    // pick the quadrant, x on the lower one
+    const int shift = 2 * (BARNES_HUT_LEVELS - 1 - level);
+    int bounds[5];
+    bounds[0] = begin;
+    for (int q = 1; q < 4; q++) {
+        bounds[q] = static_cast<int>(std::partition_point(tree.codes.begin() + bounds[q - 1], tree.codes.begin() + end, [&](unsigned int code) {
+            return static_cast<int>((code >> shift) & 3) < q;
+        }) - tree.codes.begin());
+    }
+    bounds[4] = end;
+    const float half = nodes[slot].size * 0.5f;
+    const float minX = nodes[slot].minX;
+    const float minY = nodes[slot].minY;
+    const int firstChild = static_cast<int>(nodes.size());
+    int children = 0;
+    for (int q = 0; q < 4; q++) {
+        if (bounds[q + 1] > bounds[q]) {
+            barnes_hut_node child;
+            child.minX = minX + (q & 1) * half;
+            child.minY = minY + (q >> 1) * half;
+            child.size = half;
+            child.begin = bounds[q];
+            child.end = bounds[q + 1];
+            nodes.push_back(child);
+            children++;
+        }
+    }
+    nodes[slot].firstChild = firstChild;
+    nodes[slot].children = children;
+    for (int c = firstChild; c < firstChild + children; c++) {
+        buildBarnesHutNode(tree, nodes, c, level + 1, taskBodies);
+    }
+    if (taskBodies == 0) {
+        sumBarnesHutNode(tree, nodes, slot);
+    }
+}
+
+// Mass and centre of mass, from the bodies of a leaf or the children of
+// anything else
+void sumBarnesHutNode(const barnes_hut_tree& tree, std::vector<barnes_hut_node>& nodes, int slot) {
+    barnes_hut_node& node = nodes[slot];
+    float mass = 0.f;
+    float x = 0.f;
+    float y = 0.f;
+    if (node.children == 0) {
+        for (int k = node.begin; k < node.end; k++) {
+            mass += tree.bodyMass[k];
+            x += tree.bodyMass[k] * tree.bodyX[k];
+            y += tree.bodyMass[k] * tree.bodyY[k];
+        }
+    }
+    else {
+        for (int c = node.firstChild; c < node.firstChild + node.children; c++) {
+            mass += nodes[c].mass;
+            x += nodes[c].mass * nodes[c].x;
+            y += nodes[c].mass * nodes[c].y;
+        }
+    }
+    node.mass = mass;
+    node.x = mass > 0.f ? x / mass : node.minX + node.size * 0.5f;
+    node.y = mass > 0.f ? y / mass : node.minY + node.size * 0.5f;
+}
+
+// Sizes halve exactly from the root down
+int barnesHutLevel(const barnes_hut_tree& tree, const barnes_hut_node& node) {
+    int level = 0;
+    for (float size = tree.nodes[0].size; size > node.size; size *= 0.5f) {
+        level++;
+    }
+    return level;
+}
+
+void buildBarnesHutTree(barnes_hut_tree& tree, const ParticleStore& particles) {
+    const int n = particleCount(particles);
+    const particle_bounds bounds = liveParticleBounds(particles, n);
+    tree.nodes.clear();
+    tree.leaves.clear();
+    tree.tasks.clear();
+    tree.originX = bounds.minX;
+    tree.originY = bounds.minY;
+    tree.size = std::max(std::max(bounds.maxX - bounds.minX, bounds.maxY - bounds.minY), 1.f);
+    tree.codes.resize(n);
+    tree.order.resize(n);
+    const float scale = 65535.f / tree.size;
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            tree.order[i] = i;
+            if (particles.flags[i] & PARTICLE_REMOVED) {
+                tree.codes[i] = BARNES_HUT_REMOVED;
+                continue;
+            }
+            const unsigned int x = static_cast<unsigned int>(std::min(65534.f, (particles.x[i] - bounds.minX) * scale));
+            const unsigned int y = static_cast<unsigned int>(std::min(65534.f, (particles.y[i] - bounds.minY) * scale));
+            tree.codes[i] = mortonCode(x, y);
+        }
+    });
+    parallelRadixSort(tree.codes, tree.order, tree.sortScratch);
+    tree.bodyX.resize(bounds.alive);
+    tree.bodyY.resize(bounds.alive);
+    tree.bodyMass.resize(bounds.alive);
+    parallelFor(bounds.alive, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const int i = tree.order[k];
+            tree.bodyX[k] = particles.x[i];
+            tree.bodyY[k] = particles.y[i];
+            tree.bodyMass[k] = particles.radius[i] * particles.radius[i];
+        }
+    });
+    if (bounds.alive == 0) {
+        return;
+    }
+    // Quantising maps the root onto 65536 cells of size / 65535, so its
+    // cells are that much wider than the bounds
+    barnes_hut_node root;
+    root.minX = bounds.minX;
+    root.minY = bounds.minY;
+    root.size = tree.size * (65536.f / 65535.f);
+    root.begin = 0;
+    root.end = bounds.alive;
+    tree.nodes.push_back(root);
+    buildBarnesHutNode(tree, tree.nodes, 0, 0, std::max(BARNES_HUT_TASK_BODIES, bounds.alive / BARNES_HUT_TASKS));
+    const int topNodes = static_cast<int>(tree.nodes.size());
+
+    const int tasks = static_cast<int>(tree.tasks.size());
+    tree.subtrees.resize(std::max(tasks, static_cast<int>(tree.subtrees.size())));
+    parallelFor(tasks, 1, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            std::vector<barnes_hut_node>& subtree = tree.subtrees[t];
+            subtree.assign(1, tree.nodes[tree.tasks[t]]);
+            buildBarnesHutNode(tree, subtree, 0, barnesHutLevel(tree, subtree[0]), 0);
+        }
+    });
+    // Each subtree root replaces its task's node, the rest is appended, so
+    // local index j > 0 of task t lands at offset t + j - 1
+    std::vector<int> offsets(tasks);
+    int total = topNodes;
+    for (int t = 0; t < tasks; t++) {
+        offsets[t] = total;
+        total += static_cast<int>(tree.subtrees[t].size()) - 1;
+    }
+    tree.nodes.resize(total);
+    parallelFor(tasks, 1, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            const std::vector<barnes_hut_node>& subtree = tree.subtrees[t];
+            for (int j = 0; j < static_cast<int>(subtree.size()); j++) {
+                barnes_hut_node node = subtree[j];
+                if (node.children > 0) {
+                    node.firstChild += offsets[t] - 1;
+                }
+                tree.nodes[j == 0 ? tree.tasks[t] : offsets[t] + j - 1] = node;
+            }
+        }
+    });
+    // Children of the top nodes come after them
+    for (int k = topNodes - 1; k >= 0; k--) {
+        if (tree.nodes[k].children > 0) {
+            sumBarnesHutNode(tree, tree.nodes, k);
+        }
+    }
+
+    // Leaf ranges are disjoint, so each body start has one leaf at most
+    tree.leafAt.assign(bounds.alive, -1);
+    parallelFor(static_cast<int>(tree.nodes.size()), PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            if (tree.nodes[k].children == 0) {
+                tree.leafAt[tree.nodes[k].begin] = k;
+            }
+        }
+    });
+    tree.leaves.clear();
+    for (int k = 0; k < bounds.alive; k++) {
+        if (tree.leafAt[k] >= 0) {
+            tree.leaves.push_back(tree.leafAt[k]);
+        }
+    }
+}
+
+int barnesHutBodyCount(const barnes_hut_tree& tree) {
+    return static_cast<int>(tree.bodyX.size());
+}
+
+// Accelerations of the bodies of a leaf for unit gravity, into ax and ay at
+// their body index. The list holds point masses: nodes standing in for their
+// bodies, and the bodies of the leaves that had to be opened, the leaf's own
+// included. With softening above zero a body adds nothing to itself.
+void barnesHutLeafAccelerations(const barnes_hut_tree& tree, int leaf, float theta, float softening, float* ax, float* ay) {
+    thread_local std::vector<float> pointX;
+    thread_local std::vector<float> pointY;
+    thread_local std::vector<float> pointMass;
+    const barnes_hut_node& own = tree.nodes[leaf];
+    float boxMinX = tree.bodyX[own.begin];
+    float boxMinY = tree.bodyY[own.begin];
+    float boxMaxX = boxMinX;
+    float boxMaxY = boxMinY;
+    for (int k = own.begin + 1; k < own.end; k++) {
+        boxMinX = std::min(boxMinX, tree.bodyX[k]);
+        boxMinY = std::min(boxMinY, tree.bodyY[k]);
+        boxMaxX = std::max(boxMaxX, tree.bodyX[k]);
+        boxMaxY = std::max(boxMaxY, tree.bodyY[k]);
+    }
+    pointX.clear();
+    pointY.clear();
+    pointMass.clear();
+    const float theta2 = theta * theta;
+    int stack[BARNES_HUT_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const int index = stack[--top];
+        const barnes_hut_node& node = tree.nodes[index];
+        const bool holdsLeaf = node.begin <= own.begin && own.end <= node.end;
+        if (!holdsLeaf) {
+            const float dx = std::max(std::max(boxMinX - node.x, node.x - boxMaxX), 0.f);
+            const float dy = std::max(std::max(boxMinY - node.y, node.y - boxMaxY), 0.f);
+            if (node.size * node.size < theta2 * (dx * dx + dy * dy)) {
+                pointX.push_back(node.x);
+                pointY.push_back(node.y);
+                pointMass.push_back(node.mass);
+                continue;
+            }
+        }
+        if (node.children == 0) {
+            for (int k = node.begin; k < node.end; k++) {
+                pointX.push_back(tree.bodyX[k]);
+                pointY.push_back(tree.bodyY[k]);
+                pointMass.push_back(tree.bodyMass[k]);
+            }
+        }
+        else {
+            for (int c = node.firstChild; c < node.firstChild + node.children; c++) {
+                stack[top++] = c;
+            }
+        }
+    }
+    const float softening2 = softening * softening;
+    for (int k = own.begin; k < own.end; k++) {
+        gravityKernel(SIMD_LEVEL, pointX.data(), pointY.data(), pointMass.data(), static_cast<int>(pointX.size()), tree.bodyX[k], tree.bodyY[k], softening2, ax[k], ay[k]);
+    }
+}
+
+// Every other body summed in double, the reference for the tree
+void directAcceleration(const barnes_hut_tree& tree, int body, float softening, float& ax, float& ay) {
+    double sumX = 0;
+    double sumY = 0;
+    const double softening2 = static_cast<double>(softening) * softening;
+    for (int k = 0; k < barnesHutBodyCount(tree); k++) {
+        if (k == body) {
+            continue;
+        }
+        const double bx = static_cast<double>(tree.bodyX[k]) - tree.bodyX[body];
+        const double by = static_cast<double>(tree.bodyY[k]) - tree.bodyY[body];
+        const double r2 = bx * bx + by * by + softening2;
+        const double pull = tree.bodyMass[k] / (r2 * std::sqrt(r2));
+        sumX += pull * bx;
+        sumY += pull * by;
+    }
+    ax = static_cast<float>(sumX);
+    ay = static_cast<float>(sumY);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include "ParticleStore.h"
+#include "RadixSort.h"
+
+// Up to this many bodies a node is a leaf and its bodies are summed directly.
+// Each leaf walks the tree once for all its bodies, so bigger leaves walk
+// less but sum more pairs; 32 was the fastest of 8 to 64 on 1M bodies.
+const int BARNES_HUT_LEAF_BODIES = 32;
+
+// One square cell of the tree. Children of a node are consecutive, bodies of
+// a node are the consecutive range [begin, end) of the sorted bodies.
+typedef struct {
+    // Centre of mass, and the total mass of the bodies below
+    float x;
+    float y;
+    float mass;
+    float minX;
+    float minY;
+    float size;
+    int firstChild;
+    int children;
+    int begin;
+    int end;
+} barnes_hut_node;
+
+// Quadtree over every live particle, rebuilt from scratch each step. Bodies
+// are sorted along the Z curve of their position at 16 bits per axis, so
+// every cell of the tree is a run of the sorted array and its children
+// split that run by the next two bits of the code. The top of the tree is
+// built serially until runs are small enough to share out, then the
+// subtrees are built in parallel, each into its own buffer, and appended.
+//
+// Forces are found a leaf at a time: one walk per leaf collects the nodes
+// that can stand in for their bodies, those whose size over their distance
+// from the leaf's bounding box is below theta, and the bodies of the leaves
+// that cannot, and every body of the leaf then sums that list. The box
+// distance is never more than any single body's, so the walk opens at least
+// the nodes a walk per body would. Theta 0 opens every node and gives the
+// direct sum. Masses are radius squared, so bodies weigh as much as their area.
+typedef struct {
+    float originX;
+    float originY;
+    float size;
+    std::vector<unsigned int> codes;
+    // Store index of each sorted body, and its position and mass
+    std::vector<int> order;
+    radix_sort_scratch sortScratch;
+    std::vector<float> bodyX;
+    std::vector<float> bodyY;
+    std::vector<float> bodyMass;
+    std::vector<barnes_hut_node> nodes;
+    // Leaf nodes in body order, and for each body start the leaf there, or -1
+    std::vector<int> leaves;
+    std::vector<int> leafAt;
+    // Nodes whose subtrees are built in parallel, and their buffers
+    std::vector<int> tasks;
+    std::vector<std::vector<barnes_hut_node>> subtrees;
+} barnes_hut_tree;
+
+// Functions
+void buildBarnesHutTree(barnes_hut_tree& tree, const ParticleStore& particles);
+int barnesHutBodyCount(const barnes_hut_tree& tree);
+void barnesHutLeafAccelerations(const barnes_hut_tree& tree, int leaf, float theta, float softening, float* ax, float* ay);
+void directAcceleration(const barnes_hut_tree& tree, int body, float softening, float& ax, float& ay);
@@ -0,0 +1,26 @@
+#include "Constants.h"
+
+// Particles
+bool FREEZE_PARTICLES_ON_COLLAPSE = false;
+bool FREEZE_PARTICLES_ON_BORDER_COLLAPSE = false;
+int LAST_ATTRACTIVE_PARTICLE_ID = -1;
+int BROAD_PHASE = BROAD_PHASE_GRID;
+float VERLET_SKIN = 10.f;
+bool SOLVE_COLLISIONS = false;
+int SOLVER_ITERATIONS = 4;
+float RESTITUTION = 0.8f;
+bool MORTON_REORDER = true;
+bool SLEEP_FROZEN_PARTICLES = true;
+bool CACHE_ATTRACTOR_FIELD = false;
+// Gravity
+bool GRAVITY_ENABLED = false;
+int NBODY_GRAVITY = NBODY_GRAVITY_OFF;
+float BARNES_HUT_THETA = 0.5f;
+bool SPECIALISE_UPDATE_KERNELS = true;
+// Time
+float TIME = 0.5;
+int SECONDS = 0;
+int FRAMES = 0;
+// Controls
+bool PAUSED = false;
+bool LEFT_MOUSE_CLICK = false;
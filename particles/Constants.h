@@ -0,0 +1,84 @@
+#pragma once
+#include <SFML/System/Vector2.hpp>
+
+// Screen constants
+const int WINDOW_WIDTH = 1000;
+const int WINDOW_HEIGHT = 1000;
+const int FRAME_RATE_LIMIT = 30;
+const int BASE_SPAWN_MARGIN = 20;
+const int MOUSE_CLICK_SPAWN_RANGE = 20;
+
+// Threads, counting the main one; 0 means one per hardware thread
+const int THREADS_COUNT = 0;
+
+// Particles
+const int PARTICLES_COUNT = 200;
+const int MOUSE_CLICK_PARTICLES_SPAWN_COUNT = 20;
+extern bool FREEZE_PARTICLES_ON_COLLAPSE;
+extern bool FREEZE_PARTICLES_ON_BORDER_COLLAPSE;
+extern int LAST_ATTRACTIVE_PARTICLE_ID;
+const int MIN_RADIUS = 1;
+const int MAX_RADIUS = 5;
+// Broad phase used to find colliding particles, switchable at runtime
+const int BROAD_PHASE_GRID = 0;
+const int BROAD_PHASE_SWEEP = 1;
+const int BROAD_PHASE_QUADTREE = 2;
+const int BROAD_PHASE_VERLET = 3;
+const int BROAD_PHASE_COUNT = 4;
+extern int BROAD_PHASE;
+// Extra reach of the Verlet neighbour lists, in pixels. Wider lists survive
+// more steps between rebuilds but hold more candidates.
+extern float VERLET_SKIN;
+// Collision response: impulses and overlap correction between touching
+// particles, SOLVER_ITERATIONS passes per step. RESTITUTION 1 is elastic,
+// 0 perfectly inelastic.
+extern bool SOLVE_COLLISIONS;
+extern int SOLVER_ITERATIONS;
+extern float RESTITUTION;
+// Keep particle storage in Z-curve order for cache locality
+extern bool MORTON_REORDER;
+// Move frozen particles out of the per step passes until something touches them
+extern bool SLEEP_FROZEN_PARTICLES;
+// Attract from a field of every attractor's pull, cached until an attractor
+// is added, moves or is removed, instead of attractor by attractor
+extern bool CACHE_ATTRACTOR_FIELD;
+// Gravity
+extern bool GRAVITY_ENABLED;
+const sf::Vector2f GRAVITY_FORCE(0.f, 1.f);
+// Every particle pulling every other, through a Barnes-Hut tree opened at
+// BARNES_HUT_THETA or through a particle mesh, switchable at runtime. The
+// strength is the pull of the whole scene's mass from NBODY_PULL_DISTANCE
+// away, per step, whatever the particle count; the softening keeps close
+// pairs from slingshotting each other.
+const int NBODY_GRAVITY_OFF = 0;
+const int NBODY_GRAVITY_BARNES_HUT = 1;
+const int NBODY_GRAVITY_MESH = 2;
+const int NBODY_GRAVITY_COUNT = 3;
+extern int NBODY_GRAVITY;
+extern float BARNES_HUT_THETA;
+const float NBODY_PULL = 0.5f;
+const float NBODY_PULL_DISTANCE = 100.f;
+const float NBODY_SOFTENING = MAX_RADIUS;
+// The per particle flags above as a bitmask. The per particle passes are
+// compiled for every combination and picked once per pass, so their loops
+// test none of them; SPECIALISE_UPDATE_KERNELS off runs the generic loops,
+// which read the flags as they go.
+const int UPDATE_GRAVITY = 1 << 0;
+const int UPDATE_FREEZE_ON_COLLAPSE = 1 << 1;
+const int UPDATE_FREEZE_ON_BORDER_COLLAPSE = 1 << 2;
+const int UPDATE_FLAG_COMBINATIONS = 8;
+extern bool SPECIALISE_UPDATE_KERNELS;
+// Time. The simulation advances in fixed steps of its own, whatever the frame
+// rate; TIME is the simulated time per step at BASE_SIMULATION_RATE.
+const int BASE_SIMULATION_RATE = 30;
+const int SIMULATION_RATE = 30;
+const int MAX_SUBSTEPS_PER_FRAME = 8;
+extern float TIME;
+// Simulated seconds, and steps into the current one
+extern int SECONDS;
+extern int FRAMES;
+// Controls
+extern bool PAUSED;
+extern bool LEFT_MOUSE_CLICK;
+// Colors
+const int COLORS_LENGTH = 7;
@@ -0,0 +1,128 @@
+#include "ContactSolver.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+const int CONTACT_COLORS = 64;
+// Penetration left alone, and the share of the rest every iteration removes
+const float CONTACT_SLOP = 0.01f;
+const float CONTACT_CORRECTION = 0.8f;
+
+// Functions
+float inverseMass(const ParticleStore& particles, int i);
+
+// Mass goes with area; frozen and removed particles do not move
+float inverseMass(const ParticleStore& particles, int i) {
+    if (particles.flags[i] & (PARTICLE_FROZEN | PARTICLE_REMOVED)) {
+        return 0.f;
+    }
+    return 1.f / (particles.radius[i] * particles.radius[i]);
+}
+
+// Each contact takes the lowest colour neither of its particles has yet.
+// Serial and in buffer order, so the batches never depend on thread count.
+void colorContacts(contact_batches& batches, const std::vector<particle_contact>& contacts, int particles) {
+    const int m = static_cast<int>(contacts.size());
+    batches.particleColors.assign(particles, 0);
+    batches.contactColor.resize(m);
+    std::vector<int>& counts = batches.colorCounts;
+    counts.assign(CONTACT_COLORS + 2, 0);
+    int colors = 0;
+    for (int k = 0; k < m; k++) {
+        const unsigned long long used = batches.particleColors[contacts[k].a] | batches.particleColors[contacts[k].b];
+        int color = 0;
+        while (color < CONTACT_COLORS && (used >> color) & 1ULL) {
+            color++;
+        }
+        if (color < CONTACT_COLORS) {
+            batches.particleColors[contacts[k].a] |= 1ULL << color;
+            batches.particleColors[contacts[k].b] |= 1ULL << color;
+            colors = std::max(colors, color + 1);
+        }
+        batches.contactColor[k] = static_cast<unsigned char>(color);
+        counts[color + 1]++;
+    }
+    // Counting sort by colour; the serial leftovers sort last
+    const bool leftovers = counts[CONTACT_COLORS + 1] > 0;
+    batches.parallelBatches = colors;
+    batches.batchStart.assign(colors + 2, 0);
+    for (int c = 0; c < colors; c++) {
+        batches.batchStart[c + 1] = batches.batchStart[c] + counts[c + 1];
+    }
+    batches.batchStart[colors + 1] = batches.batchStart[colors] + counts[CONTACT_COLORS + 1];
+    if (!leftovers) {
+        batches.batchStart.pop_back();
+    }
+    std::vector<int>& fill = batches.batchFill;
+    fill.assign(batches.batchStart.begin(), batches.batchStart.end() - 1);
+    batches.contacts.resize(m);
+    for (int k = 0; k < m; k++) {
+        const int color = std::min(static_cast<int>(batches.contactColor[k]), colors);
+        batches.contacts[fill[color]++] = contacts[k];
+    }
+}
+
+// Every iteration walks the batches in colour order, each batch in parallel
+void solveContacts(const contact_batches& batches, ParticleStore& particles, int iterations, float restitution) {
+    const int count = static_cast<int>(batches.batchStart.size()) - 1;
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (int c = 0; c < count; c++) {
+            const int first = batches.batchStart[c];
+            const int size = batches.batchStart[c + 1] - first;
+            if (c >= batches.parallelBatches) {
+                for (int k = first; k < first + size; k++) {
+                    solveContact(particles, batches.contacts[k], restitution);
+                }
+                continue;
+            }
+            parallelFor(size, PARALLEL_GRAIN, [&](int begin, int end) {
+                for (int k = first + begin; k < first + end; k++) {
+                    solveContact(particles, batches.contacts[k], restitution);
+                }
+            });
+        }
+    }
+}
+
+// Mass weighted impulse along the contact normal while the particles close
+// in, then a positional correction that pushes them apart by most of the
+// remaining overlap. Restitution 1 is elastic, 0 perfectly inelastic.
+void solveContact(ParticleStore& particles, const particle_contact& contact, float restitution) {
+    const int a = contact.a;
+    const int b = contact.b;
+    const float inverseA = inverseMass(particles, a);
+    const float inverseB = inverseMass(particles, b);
+    const float inverseSum = inverseA + inverseB;
+    if (inverseSum == 0.f) {
+        return;
+    }
+    float nx = particles.x[b] - particles.x[a];
+    float ny = particles.y[b] - particles.y[a];
+    const float distance = std::sqrt(nx * nx + ny * ny);
+    const float penetration = particles.radius[a] + particles.radius[b] - distance;
+    if (penetration <= 0.f) {
+        return;
+    }
+    // Coincident positions get an arbitrary but fixed normal
+    if (distance > 0.f) {
+        nx /= distance;
+        ny /= distance;
+    }
+    else {
+        nx = 1.f;
+        ny = 0.f;
+    }
+    const float closing = (particles.vx[b] - particles.vx[a]) * nx + (particles.vy[b] - particles.vy[a]) * ny;
+    if (closing < 0.f) {
+        const float impulse = -(1.f + restitution) * closing / inverseSum;
+        particles.vx[a] -= impulse * inverseA * nx;
+        particles.vy[a] -= impulse * inverseA * ny;
+        particles.vx[b] += impulse * inverseB * nx;
+        particles.vy[b] += impulse * inverseB * ny;
+    }
+    const float correction = std::max(penetration - CONTACT_SLOP, 0.f) * CONTACT_CORRECTION / inverseSum;
+    particles.x[a] -= correction * inverseA * nx;
+    particles.y[a] -= correction * inverseA * ny;
+    particles.x[b] += correction * inverseB * nx;
+    particles.y[b] += correction * inverseB * ny;
+}
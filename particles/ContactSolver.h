@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include "Particle.h"
+#include "ParticleStore.h"
+
+// Contacts split into batches that share no particle, by greedy graph
+// colouring in buffer order. The contacts of one batch can be solved in
+// parallel without locks; batches run one after the other. Colours are
+// tracked in a 64 bit mask per particle, so contacts that find all 64 taken
+// go to one last batch that is solved serially.
+typedef struct {
+    // Contacts of batch c are contacts[batchStart[c], batchStart[c + 1])
+    std::vector<particle_contact> contacts;
+    std::vector<int> batchStart;
+    // Batches that can run in parallel; the one after them, if any, is serial
+    int parallelBatches;
+    std::vector<unsigned long long> particleColors;
+    std::vector<unsigned char> contactColor;
+    // Scratch of the counting sort, kept between steps
+    std::vector<int> colorCounts;
+    std::vector<int> batchFill;
+} contact_batches;
+
+// Functions
+void colorContacts(contact_batches& batches, const std::vector<particle_contact>& contacts, int particles);
+void solveContacts(const contact_batches& batches, ParticleStore& particles, int iterations, float restitution);
+void solveContact(ParticleStore& particles, const particle_contact& contact, float restitution);
@@ -0,0 +1,54 @@
+#include "CpuUsage.h"
+#include <chrono>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+// User plus kernel time of every thread of the process, pool workers included
+double processCpuSeconds() {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER kernelTicks, userTicks;
+    kernelTicks.LowPart = kernel.dwLowDateTime;
+    kernelTicks.HighPart = kernel.dwHighDateTime;
+    userTicks.LowPart = user.dwLowDateTime;
+    userTicks.HighPart = user.dwHighDateTime;
+    return (kernelTicks.QuadPart + userTicks.QuadPart) * 1e-7;
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+        return 0;
+    }
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+double wallSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void startCpuUsageMeter(cpu_usage_meter& meter) {
+    meter.wallStart = wallSeconds();
+    meter.cpuStart = processCpuSeconds();
+    meter.cpuPerWallSecond = 0;
+}
+
+// True when a wall second has passed and cpuPerWallSecond holds a new reading
+bool updateCpuUsageMeter(cpu_usage_meter& meter) {
+    const double wall = wallSeconds();
+    if (wall - meter.wallStart < 1.0) {
+        return false;
+    }
+    const double cpu = processCpuSeconds();
+    meter.cpuPerWallSecond = (cpu - meter.cpuStart) / (wall - meter.wallStart);
+    meter.wallStart = wall;
+    meter.cpuStart = cpu;
+    return true;
+}
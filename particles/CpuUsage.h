@@ -0,0 +1,15 @@
+#pragma once
+
+// Process CPU time over wall time, read once per wall second. 1.0 means one
+// core kept fully busy.
+typedef struct {
+    double wallStart;
+    double cpuStart;
+    double cpuPerWallSecond;
+} cpu_usage_meter;
+
+// Functions
+double processCpuSeconds();
+double wallSeconds();
+void startCpuUsageMeter(cpu_usage_meter& meter);
+bool updateCpuUsageMeter(cpu_usage_meter& meter);
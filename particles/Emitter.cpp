@@ -0,0 +1,377 @@
+#include "Emitter.h"
+#include "Constants.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const float EMITTER_RADIANS = 3.14159265f / 180.f;
+// Longest scene line, comments included
+const int EMITTER_SCENE_LINE = 512;
+
+// Functions
+bool validEmitterSettings(const emitter_settings& settings);
+int parseSceneValues(const char* text, float& low, float& high);
+bool setEmitterSetting(emitter_settings& settings, char* word);
+bool parseSceneLine(char* line, std::vector<emitter_settings>& scene, int& capacity);
+
+// Reserves the store, and its free slot list, for the whole pool up front
+void initEmitters(emitter_system& system, ParticleStore& particles, int capacity) {
+    system.capacity = capacity;
+    reserveParticles(particles, capacity);
+}
+
+emitter_settings defaultEmitterSettings(float x, float y) {
+    emitter_settings settings;
+    settings.x = x;
+    settings.y = y;
+    settings.range = 5;
+    settings.rate = 10;
+    settings.burst = MOUSE_CLICK_PARTICLES_SPAWN_COUNT;
+    settings.lifetime = 3;
+    settings.direction = 90;
+    settings.spread = 20;
+    settings.minSpeed = 5;
+    settings.maxSpeed = 15;
+    settings.minRadius = MIN_RADIUS;
+    settings.maxRadius = MAX_RADIUS;
+    settings.colorIndex = -1;
+    settings.start = 0;
+    settings.stop = -1;
+    return settings;
+}
+
+// Bursts born within one lifetime of each other, plus one for a burst due
+// on the same step the oldest one expires. Never more than the pool holds,
+// since an emitter can have no more particles alive than that.
+int emitterRingSize(const emitter_settings& settings, int capacity) {
+    const double bursts = settings.rate > 0 ? std::ceil(static_cast<double>(settings.rate) * settings.lifetime) + 1 : 1;
+    return static_cast<int>(std::min(static_cast<double>(settings.burst) * bursts, static_cast<double>(std::max(capacity, 0))));
+}
+
+// Takes the place of a removed emitter whose particles have all expired, so
+// placing and removing emitters does not grow the list. Each emitter draws
+// from a stream of its own, seeded from the calling thread's.
+int addEmitter(emitter_system& system, const emitter_settings& settings) {
+    int index = 0;
+    const int count = static_cast<int>(system.emitters.size());
+    while (index < count && !(system.emitters[index].removed && system.emitters[index].live == 0)) {
+        index++;
+    }
+    if (index == count) {
+        system.emitters.push_back(particle_emitter());
+    }
+    particle_emitter& emitter = system.emitters[index];
+    emitter.settings = settings;
+    random_stream& stream = threadRandomStream();
+    const unsigned long long high = nextRandom(stream);
+    seedRandomStream(emitter.random, (high << 32) | nextRandom(stream), index);
+    // start and stop count from now
+    emitter.nextBurst = system.time + settings.start;
+    emitter.stopAt = settings.stop < 0 ? -1 : system.time + settings.stop;
+    const int ring = emitterRingSize(settings, system.capacity);
+    emitter.handles.assign(ring, particle_handle());
+    emitter.deaths.assign(ring, 0.0);
+    emitter.head = 0;
+    emitter.live = 0;
+    emitter.removed = false;
+    return index;
+}
+
+void removeEmitter(emitter_system& system, int index) {
+    system.emitters[index].removed = true;
+}
+
+// Index of the closest emitter within range of x, y, or -1
+int nearestEmitter(const emitter_system& system, float x, float y, float range) {
+    int nearest = -1;
+    float nearestDistance = range * range;
+    for (int i = 0; i < static_cast<int>(system.emitters.size()); i++) {
+        const emitter_settings& settings = system.emitters[i].settings;
+        const float dx = settings.x - x;
+        const float dy = settings.y - y;
+        const float distance = dx * dx + dy * dy;
+        if (!system.emitters[i].removed && distance <= nearestDistance) {
+            nearest = i;
+            nearestDistance = distance;
+        }
+    }
+    return nearest;
+}
+
+// True while any emitter may still spawn or expire a particle
+bool emittersActive(const emitter_system& system) {
+    for (const particle_emitter& emitter : system.emitters) {
+        if (!emitter.removed || emitter.live > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Expires first, so a burst due on the same step reuses the slots
+void updateEmitters(emitter_system& system, ParticleStore& particles, double elapsed) {
+    system.time += elapsed;
+    expireEmitterParticles(system, particles);
+    for (particle_emitter& emitter : system.emitters) {
+        while (!emitter.removed && emitter.nextBurst <= system.time) {
+            if (emitter.stopAt >= 0 && emitter.nextBurst >= emitter.stopAt) {
+                emitter.removed = true;
+                break;
+            }
+            emitParticles(system, emitter, particles);
+            if (emitter.settings.rate <= 0) {
+                emitter.removed = true;
+                break;
+            }
+            emitter.nextBurst += 1.0 / emitter.settings.rate;
+        }
+    }
+}
+
+// Pops every particle whose time is up off the front of each ring. Particles
+// that already left some other way only leave a stale handle behind.
+int expireEmitterParticles(emitter_system& system, ParticleStore& particles) {
+    int expired = 0;
+    for (particle_emitter& emitter : system.emitters) {
+        const int ring = static_cast<int>(emitter.handles.size());
+        while (emitter.live > 0 && emitter.deaths[emitter.head] <= system.time) {
+            const int index = particleIndex(particles, emitter.handles[emitter.head]);
+            if (index >= 0) {
+                removeParticle(particles, index);
+                expired++;
+            }
+            emitter.head = emitter.head + 1 == ring ? 0 : emitter.head + 1;
+            emitter.live--;
+        }
+    }
+    system.expired += expired;
+    return expired;
+}
+
+// One burst, cut short by whatever is left of the pool and the ring. Drawn
+// particle by particle from the emitter's stream: bursts are small, and a
+// batch fill would hand its blocks to the thread pool.
+int emitParticles(emitter_system& system, particle_emitter& emitter, ParticleStore& particles) {
+    const emitter_settings& settings = emitter.settings;
+    const int ring = static_cast<int>(emitter.handles.size());
+    const int n = std::max(0, std::min(std::min(settings.burst, system.capacity - particleCount(particles)), ring - emitter.live));
+    system.dropped += settings.burst - n;
+    if (n == 0) {
+        return 0;
+    }
+    const int first = appendParticles(particles, n);
+    const float direction = settings.direction * EMITTER_RADIANS;
+    const float spread = settings.spread * EMITTER_RADIANS;
+    const double death = emitter.nextBurst + settings.lifetime;
+    random_stream& random = emitter.random;
+    for (int i = first; i < first + n; i++) {
+        const float angle = nextRandomFloat(random, direction - spread, direction + spread);
+        const float speed = nextRandomFloat(random, settings.minSpeed, settings.maxSpeed);
+        particles.x[i] = nextRandomFloat(random, settings.x - settings.range, settings.x + settings.range);
+        particles.y[i] = nextRandomFloat(random, settings.y - settings.range, settings.y + settings.range);
+        particles.vx[i] = speed * std::cos(angle);
+        particles.vy[i] = -speed * std::sin(angle);
+        particles.radius[i] = nextRandomFloat(random, settings.minRadius, settings.maxRadius);
+        particles.colorIndex[i] = static_cast<unsigned char>(settings.colorIndex >= 0 ? settings.colorIndex : nextRandomIndex(random, COLORS_LENGTH));
+        particles.flags[i] = 0;
+        particles.previousX[i] = particles.x[i];
+        particles.previousY[i] = particles.y[i];
+        const int entry = (emitter.head + emitter.live) % ring;
+        emitter.handles[entry] = particleHandle(particles, i);
+        emitter.deaths[entry] = death;
+        emitter.live++;
+    }
+    system.spawned += n;
+    return n;
+}
+
+// Radii past MAX_RADIUS would slip through the broad phases. Infinities
+// and NaNs fail the range checks.
+bool validEmitterSettings(const emitter_settings& settings) {
+    const float limit = static_cast<float>(WINDOW_WIDTH + WINDOW_HEIGHT) * EMITTER_MAX_SCALE;
+    return std::fabs(settings.x) <= limit && std::fabs(settings.y) <= limit && settings.range >= 0 && settings.range <= limit
+        && settings.rate >= 0 && settings.rate <= EMITTER_MAX_RATE && settings.burst > 0 && settings.burst <= EMITTER_MAX_BURST
+        && settings.lifetime > 0 && settings.lifetime <= EMITTER_MAX_LIFETIME
+        && std::fabs(settings.direction) <= 360 && settings.spread >= 0 && settings.spread <= 180
+        && settings.minSpeed <= settings.maxSpeed && std::fabs(settings.minSpeed) <= limit && std::fabs(settings.maxSpeed) <= limit
+        && settings.minRadius > 0 && settings.minRadius <= settings.maxRadius && settings.maxRadius <= MAX_RADIUS
+        && settings.colorIndex >= -1 && settings.colorIndex < COLORS_LENGTH
+        && settings.start >= 0 && settings.start <= EMITTER_MAX_LIFETIME && std::fabs(settings.stop) <= EMITTER_MAX_LIFETIME;
+}
+
+// "a" or "a:b". Returns how many values there were, 0 if text is neither.
+int parseSceneValues(const char* text, float& low, float& high) {
+    char* end;
+    low = strtof(text, &end);
+    if (end == text) {
+        return 0;
+    }
+    if (*end == '\0') {
+        high = low;
+        return 1;
+    }
+    if (*end != ':') {
+        return 0;
+    }
+    const char* rest = end + 1;
+    high = strtof(rest, &end);
+    if (end == rest || *end != '\0') {
+        return 0;
+    }
+    return 2;
+}
+
+// One name=value pair. speed and radius take a min:max range or a single
+// value, the others a single value only.
+bool setEmitterSetting(emitter_settings& settings, char* word) {
+    char* value = strchr(word, '=');
+    if (value == nullptr) {
+        return false;
+    }
+    *value++ = '\0';
+    if (strcmp(word, "color") == 0 && strcmp(value, "random") == 0) {
+        settings.colorIndex = -1;
+        return true;
+    }
+    float low;
+    float high;
+    const int values = parseSceneValues(value, low, high);
+    if (values == 0) {
+        return false;
+    }
+    if (strcmp(word, "speed") == 0) {
+        settings.minSpeed = low;
+        settings.maxSpeed = high;
+        return true;
+    }
+    if (strcmp(word, "radius") == 0) {
+        settings.minRadius = low;
+        settings.maxRadius = high;
+        return true;
+    }
+    if (values != 1) {
+        return false;
+    }
+    if (strcmp(word, "x") == 0) {
+        settings.x = low;
+    }
+    else if (strcmp(word, "y") == 0) {
+        settings.y = low;
+    }
+    else if (strcmp(word, "range") == 0) {
+        settings.range = low;
+    }
+    else if (strcmp(word, "rate") == 0) {
+        settings.rate = low;
+    }
+    else if (strcmp(word, "burst") == 0) {
+        // Checked before the conversion, which a float past int overflows
+        if (!(low >= 1 && low <= EMITTER_MAX_BURST)) {
+            return false;
+        }
+        settings.burst = static_cast<int>(low);
+    }
+    else if (strcmp(word, "lifetime") == 0) {
+        settings.lifetime = low;
+    }
+    else if (strcmp(word, "direction") == 0) {
+        settings.direction = low;
+    }
+    else if (strcmp(word, "spread") == 0) {
+        settings.spread = low;
+    }
+    else if (strcmp(word, "color") == 0) {
+        if (!(low >= -1 && low < COLORS_LENGTH)) {
+            return false;
+        }
+        settings.colorIndex = static_cast<int>(low);
+    }
+    else if (strcmp(word, "start") == 0) {
+        settings.start = low;
+    }
+    else if (strcmp(word, "stop") == 0) {
+        settings.stop = low;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Blank lines and anything after # are skipped. The rest is either
+//   pool PARTICLES
+//   emitter [name=value ...]
+// with the names of setEmitterSetting; anything left out keeps the value of
+// defaultEmitterSettings at 0, 0.
+bool parseSceneLine(char* line, std::vector<emitter_settings>& scene, int& capacity) {
+    char* comment = strchr(line, '#');
+    if (comment != nullptr) {
+        *comment = '\0';
+    }
+    const char* separators = " \t\r\n";
+    char* word = strtok(line, separators);
+    if (word == nullptr) {
+        return true;
+    }
+    if (strcmp(word, "pool") == 0) {
+        char* value = strtok(nullptr, separators);
+        if (value == nullptr || strtok(nullptr, separators) != nullptr) {
+            return false;
+        }
+        char* end;
+        const long pool = strtol(value, &end, 10);
+        if (end == value || *end != '\0' || pool <= 0 || pool > EMITTER_MAX_POOL) {
+            return false;
+        }
+        capacity = static_cast<int>(pool);
+        return true;
+    }
+    if (strcmp(word, "emitter") != 0) {
+        return false;
+    }
+    emitter_settings settings = defaultEmitterSettings(0, 0);
+    while ((word = strtok(nullptr, separators)) != nullptr) {
+        if (!setEmitterSetting(settings, word)) {
+            return false;
+        }
+    }
+    if (!validEmitterSettings(settings)) {
+        return false;
+    }
+    scene.push_back(settings);
+    return true;
+}
+
+// Replaces the emitters with the scene's, or leaves them alone if any line
+// is wrong. The old emitters stop spawning, their particles still expire.
+bool loadEmitterScene(const char* path, emitter_system& system, ParticleStore& particles) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot read scene '%s'\n", path);
+        return false;
+    }
+    std::vector<emitter_settings> scene;
+    int capacity = system.capacity > 0 ? system.capacity : EMITTER_POOL_PARTICLES;
+    char line[EMITTER_SCENE_LINE];
+    int number = 0;
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), file) != nullptr) {
+        number++;
+        valid = parseSceneLine(line, scene, capacity);
+    }
+    fclose(file);
+    if (!valid) {
+        fprintf(stderr, "'%s' line %d is not a valid scene line\n", path, number);
+        return false;
+    }
+    for (int i = 0; i < static_cast<int>(system.emitters.size()); i++) {
+        removeEmitter(system, i);
+    }
+    initEmitters(system, particles, capacity);
+    for (const emitter_settings& settings : scene) {
+        addEmitter(system, settings);
+    }
+    return true;
+}
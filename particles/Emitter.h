@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include "ParticleStore.h"
+#include "Random.h"
+
+// Particles the store is reserved for when emitters start, unless a scene
+// asks for another pool size
+const int EMITTER_POOL_PARTICLES = 100000;
+// How close to the mouse an emitter has to be to be picked
+const float EMITTER_PICK_RANGE = 30.f;
+// Largest settings a scene may give. Positions, ranges and speeds may reach
+// EMITTER_MAX_SCALE window sizes, start and stop EMITTER_MAX_LIFETIME, the
+// pool EMITTER_MAX_POOL particles.
+const int EMITTER_MAX_POOL = 16000000;
+const float EMITTER_MAX_RATE = 1000.f;
+const int EMITTER_MAX_BURST = 1000000;
+const float EMITTER_MAX_LIFETIME = 3600.f;
+const float EMITTER_MAX_SCALE = 10.f;
+
+// What an emitter spawns and how often. Times are in emitter seconds, which
+// are simulated: one passes per SIMULATION_RATE steps at TIME 1, slow motion
+// slows them down with everything else. Speeds are in the units of vx, vy.
+typedef struct {
+    float x;
+    float y;
+    // Half width of the square around x, y that particles appear in
+    float range;
+    // Bursts per second; 0 fires a single burst at start
+    float rate;
+    int burst;
+    float lifetime;
+    // Velocity cone, in degrees: the centre, counter clockwise from the x
+    // axis with y up on screen, and the half angle either side of it
+    float direction;
+    float spread;
+    float minSpeed;
+    float maxSpeed;
+    float minRadius;
+    float maxRadius;
+    // Colour of every particle, or -1 for random ones
+    int colorIndex;
+    // When it starts and stops spawning, counted from when it is added;
+    // stop < 0 never does
+    float start;
+    float stop;
+} emitter_settings;
+
+// Each emitter keeps its live particles in a ring, oldest first, sized when
+// the emitter is added for as many as its rate and lifetime can keep alive.
+// Every particle of an emitter lives as long, so they die in the order they
+// were born and expiry only ever pops the front of the ring.
+typedef struct {
+    emitter_settings settings;
+    random_stream random;
+    // Emitter times of the next burst and of the last, -1 for never
+    double nextBurst;
+    double stopAt;
+    std::vector<particle_handle> handles;
+    std::vector<double> deaths;
+    int head;
+    int live;
+    // Removed emitters spawn no more, their particles still expire
+    bool removed;
+} particle_emitter;
+
+// Emitters draw from a pool: the store is reserved once for capacity
+// particles and emitters never grow it past that, bursts that do not fit are
+// cut short and counted as dropped. Past that reservation and adding
+// emitters, spawning and expiring allocate nothing.
+typedef struct {
+    std::vector<particle_emitter> emitters;
+    int capacity = 0;
+    double time = 0;
+    long long spawned = 0;
+    long long expired = 0;
+    long long dropped = 0;
+} emitter_system;
+
+// Functions
+void initEmitters(emitter_system& system, ParticleStore& particles, int capacity);
+emitter_settings defaultEmitterSettings(float x, float y);
+int emitterRingSize(const emitter_settings& settings, int capacity);
+int addEmitter(emitter_system& system, const emitter_settings& settings);
+void removeEmitter(emitter_system& system, int index);
+int nearestEmitter(const emitter_system& system, float x, float y, float range);
+bool emittersActive(const emitter_system& system);
+void updateEmitters(emitter_system& system, ParticleStore& particles, double elapsed);
+int expireEmitterParticles(emitter_system& system, ParticleStore& particles);
+int emitParticles(emitter_system& system, particle_emitter& emitter, ParticleStore& particles);
+bool loadEmitterScene(const char* path, emitter_system& system, ParticleStore& particles);
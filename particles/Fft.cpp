@@ -0,0 +1,125 @@
+#include "Fft.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Rows per parallel chunk, and columns transformed together, a cache line
+const int FFT_LINES_PER_CHUNK = 8;
+const int FFT_COLUMN_BATCH = 16;
+
+// Functions
+void fftRows(const fft_plan& plan, float* re, float* im, int rows, bool inverse);
+void fftColumns(const fft_plan& plan, float* re, float* im, bool inverse);
+
+void initFftPlan(fft_plan& plan, int size) {
+    plan.size = size;
+    int bits = 0;
+    while ((1 << bits) < size) {
+        bits++;
+    }
+    plan.reversed.resize(size);
+    for (int i = 0; i < size; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        plan.reversed[i] = r;
+    }
+    plan.cosines.resize(std::max(size - 1, 0));
+    plan.sines.resize(std::max(size - 1, 0));
+    for (int span = 1; span < size; span *= 2) {
+        for (int k = 0; k < span; k++) {
+            const double angle = 3.14159265358979323846 * k / span;
+            plan.cosines[span - 1 + k] = static_cast<float>(std::cos(angle));
+            plan.sines[span - 1 + k] = static_cast<float>(std::sin(angle));
+        }
+    }
+}
+
+// Iterative Cooley-Tukey: bit reversal, then log2(size) passes of
+// butterflies. The forward transform uses e^(-i angle), the inverse e^(i angle).
+void fft(const fft_plan& plan, float* re, float* im, bool inverse) {
+    const int n = plan.size;
+    for (int i = 0; i < n; i++) {
+        const int r = plan.reversed[i];
+        if (r > i) {
+            std::swap(re[i], re[r]);
+            std::swap(im[i], im[r]);
+        }
+    }
+    const float sign = inverse ? 1.f : -1.f;
+    for (int span = 1; span < n; span *= 2) {
+        const float* cosines = plan.cosines.data() + span - 1;
+        const float* sines = plan.sines.data() + span - 1;
+        for (int start = 0; start < n; start += 2 * span) {
+            for (int k = 0; k < span; k++) {
+                const float wr = cosines[k];
+                const float wi = sign * sines[k];
+                const int a = start + k;
+                const int b = a + span;
+                const float tr = re[b] * wr - im[b] * wi;
+                const float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// Lines of the 2D transform, in place. Columns are copied out a cache line's
+// worth at a time into contiguous lines, transformed and copied back. Lines
+// are independent, so the result does not depend on the thread count.
+void fftRows(const fft_plan& plan, float* re, float* im, int rows, bool inverse) {
+    const int n = plan.size;
+    parallelFor(rows, FFT_LINES_PER_CHUNK, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            fft(plan, re + row * n, im + row * n, inverse);
+        }
+    });
+}
+
+void fftColumns(const fft_plan& plan, float* re, float* im, bool inverse) {
+    const int n = plan.size;
+    const int batches = (n + FFT_COLUMN_BATCH - 1) / FFT_COLUMN_BATCH;
+    parallelFor(batches, 1, [&](int begin, int end) {
+        std::vector<float> linesRe(FFT_COLUMN_BATCH * n);
+        std::vector<float> linesIm(FFT_COLUMN_BATCH * n);
+        for (int batch = begin; batch < end; batch++) {
+            const int first = batch * FFT_COLUMN_BATCH;
+            const int columns = std::min(FFT_COLUMN_BATCH, n - first);
+            for (int row = 0; row < n; row++) {
+                for (int c = 0; c < columns; c++) {
+                    linesRe[c * n + row] = re[row * n + first + c];
+                    linesIm[c * n + row] = im[row * n + first + c];
+                }
+            }
+            for (int c = 0; c < columns; c++) {
+                fft(plan, linesRe.data() + c * n, linesIm.data() + c * n, inverse);
+            }
+            for (int row = 0; row < n; row++) {
+                for (int c = 0; c < columns; c++) {
+                    re[row * n + first + c] = linesRe[c * n + row];
+                    im[row * n + first + c] = linesIm[c * n + row];
+                }
+            }
+        }
+    });
+}
+
+// size x size, row major. Only the first rows rows of the input are read by
+// the forward transform, the rest must be zero; only the first rows rows of
+// the output are written by the inverse. A grid zero padded to twice its
+// height skips a quarter of the work either way.
+void fft2d(const fft_plan& plan, float* re, float* im, int rows, bool inverse) {
+    if (inverse) {
+        fftColumns(plan, re, im, true);
+        fftRows(plan, re, im, rows, true);
+    }
+    else {
+        fftRows(plan, re, im, rows, false);
+        fftColumns(plan, re, im, false);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+
+// Radix-2 complex FFTs over split real and imaginary arrays, so the
+// butterflies are plain float loops. Sizes must be powers of two. Neither
+// direction scales, an inverse after a forward transform gives the input
+// times the number of points.
+typedef struct {
+    int size;
+    std::vector<int> reversed;
+    // Per pass, in order: the pass with butterflies span apart reads cos and
+    // sin of pi k / span, k below span, from index span - 1 on, so its loop
+    // over k reads them contiguously and vectorizes
+    std::vector<float> cosines;
+    std::vector<float> sines;
+} fft_plan;
+
+// Functions
+void initFftPlan(fft_plan& plan, int size);
+void fft(const fft_plan& plan, float* re, float* im, bool inverse);
+void fft2d(const fft_plan& plan, float* re, float* im, int rows, bool inverse);
@@ -0,0 +1,254 @@
+#include "LooseQuadtree.h"
+#include "Constants.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+// The tree stops getting deeper once its deepest level would have more than
+// this many leaves per object, like the grid's cell budget
+const int MIN_QUADTREE_LEAVES = 1024;
+const int QUADTREE_LEAVES_PER_OBJECT = 4;
+const int MAX_QUADTREE_DEPTH = 15;
+// Slack on every overlap test, so float rounding never drops a pair an exact
+// distance test would accept
+const float QUADTREE_PAD = 0.01f;
+
+// Functions
+int quadtreeLevelOffset(int level);
+void parallelInclusiveScan(std::vector<int>& values, std::vector<int>& blockOffset);
+void looseQuadtreeLevelRange(const loose_quadtree& tree, int level, float x, float y, float radius, int range[4]);
+
+// Id of the first node of a level: 1 + 4 + ... + 4^(level - 1)
+int quadtreeLevelOffset(int level) {
+    return ((1 << (2 * level)) - 1) / 3;
+}
+
+// Block-wise: every block is scanned in parallel, then offset by the sum of
+// the blocks before it. blockOffset is scratch.
+void parallelInclusiveScan(std::vector<int>& values, std::vector<int>& blockOffset) {
+    const int n = static_cast<int>(values.size());
+    const int blocks = std::min(n / PARALLEL_GRAIN, threadPoolSize() * 8);
+    if (blocks <= 1) {
+        for (int i = 1; i < n; i++) {
+            values[i] += values[i - 1];
+        }
+        return;
+    }
+    const int blockSize = (n + blocks - 1) / blocks;
+    blockOffset.assign(blocks, 0);
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            const int last = std::min(n, (b + 1) * blockSize);
+            for (int i = b * blockSize + 1; i < last; i++) {
+                values[i] += values[i - 1];
+            }
+        }
+    });
+    for (int b = 1; b < blocks; b++) {
+        blockOffset[b] = blockOffset[b - 1] + values[std::min(n, b * blockSize) - 1];
+    }
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = std::max(begin, 1); b < end; b++) {
+            const int last = std::min(n, (b + 1) * blockSize);
+            for (int i = b * blockSize; i < last; i++) {
+                values[i] += blockOffset[b];
+            }
+        }
+    });
+}
+
+// Every step is a parallelFor over objects or nodes. Objects land in a node
+// in whatever order the threads get there and are then sorted, so a node
+// lists its objects in ascending order whatever the thread count.
+void buildLooseQuadtree(loose_quadtree& tree, const ParticleStore& particles, const std::vector<attractive_particle>& attractive_particles) {
+    const int n = awakeParticleCount(particles);
+    const int objects = n + static_cast<int>(attractive_particles.size());
+    tree.particles = n;
+    tree.objectX.resize(objects);
+    tree.objectY.resize(objects);
+    tree.objectRadius.resize(objects);
+    tree.objectNode.resize(objects);
+    for (int a = 0; a < static_cast<int>(attractive_particles.size()); a++) {
+        const attractive_particle& p = attractive_particles[a];
+        tree.objectX[n + a] = p.position.x;
+        tree.objectY[n + a] = p.position.y;
+        tree.objectRadius[n + a] = p.removed ? -1.f : p.attractionRadius;
+    }
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            tree.objectX[i] = particles.x[i];
+            tree.objectY[i] = particles.y[i];
+            tree.objectRadius[i] = (particles.flags[i] & PARTICLE_REMOVED) ? -1.f : particles.radius[i];
+        }
+    });
+
+    // Bounds of the live objects' centres: the particles', widened by the
+    // attractors'
+    particle_bounds bounds = liveParticleBounds(particles, n);
+    for (int o = n; o < objects; o++) {
+        if (tree.objectRadius[o] < 0) {
+            continue;
+        }
+        if (bounds.alive == 0) {
+            bounds.minX = bounds.maxX = tree.objectX[o];
+            bounds.minY = bounds.maxY = tree.objectY[o];
+        }
+        bounds.minX = std::min(bounds.minX, tree.objectX[o]);
+        bounds.minY = std::min(bounds.minY, tree.objectY[o]);
+        bounds.maxX = std::max(bounds.maxX, tree.objectX[o]);
+        bounds.maxY = std::max(bounds.maxY, tree.objectY[o]);
+        bounds.alive++;
+    }
+
+    // Square root cell, a little bigger than the bounds so the far edge
+    // still falls inside the last column and row
+    tree.originX = bounds.minX;
+    tree.originY = bounds.minY;
+    tree.size = std::max(std::max(bounds.maxX - bounds.minX, bounds.maxY - bounds.minY) * 1.001f, 1.f);
+    const double maxLeaves = std::max(MIN_QUADTREE_LEAVES, bounds.alive * QUADTREE_LEAVES_PER_OBJECT);
+    tree.depth = 0;
+    while (tree.depth < MAX_QUADTREE_DEPTH && static_cast<double>(1 << (2 * (tree.depth + 1))) <= maxLeaves
+        && tree.size / (1 << (tree.depth + 1)) >= MIN_RADIUS * 2) {
+        tree.depth++;
+    }
+    const int nodes = quadtreeLevelOffset(tree.depth + 1);
+
+    parallelFor(objects, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int o = begin; o < end; o++) {
+            const float radius = tree.objectRadius[o];
+            if (radius < 0) {
+                tree.objectNode[o] = -1;
+                continue;
+            }
+            int level = tree.depth;
+            while (level > 0 && tree.size / (1 << level) < radius * 2) {
+                level--;
+            }
+            const int side = 1 << level;
+            const float cell = tree.size / side;
+            const int column = std::min(std::max(static_cast<int>((tree.objectX[o] - tree.originX) / cell), 0), side - 1);
+            const int row = std::min(std::max(static_cast<int>((tree.objectY[o] - tree.originY) / cell), 0), side - 1);
+            tree.objectNode[o] = quadtreeLevelOffset(level) + row * side + column;
+        }
+    });
+
+    // Counting sort of objects by node, with atomic counters
+    if (static_cast<int>(tree.nodeFill.size()) < nodes) {
+        tree.nodeFill = std::vector<std::atomic<int>>(nodes);
+    }
+    parallelFor(nodes, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            tree.nodeFill[k] = 0;
+        }
+    });
+    parallelFor(objects, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int o = begin; o < end; o++) {
+            if (tree.objectNode[o] >= 0) {
+                tree.nodeFill[tree.objectNode[o]]++;
+            }
+        }
+    });
+    tree.nodeStart.resize(nodes + 1);
+    tree.nodeStart[0] = 0;
+    parallelFor(nodes, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            tree.nodeStart[k + 1] = tree.nodeFill[k];
+        }
+    });
+    parallelInclusiveScan(tree.nodeStart, tree.scanOffsets);
+    parallelFor(nodes, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            tree.nodeFill[k] = tree.nodeStart[k];
+        }
+    });
+    tree.nodeObjects.resize(tree.nodeStart[nodes]);
+    parallelFor(objects, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int o = begin; o < end; o++) {
+            if (tree.objectNode[o] >= 0) {
+                tree.nodeObjects[tree.nodeFill[tree.objectNode[o]]++] = o;
+            }
+        }
+    });
+    parallelFor(nodes, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            std::sort(tree.nodeObjects.begin() + tree.nodeStart[k], tree.nodeObjects.begin() + tree.nodeStart[k + 1]);
+        }
+    });
+}
+
+// Appends every object whose bounding circle overlaps the circle at (x, y),
+// give or take QUADTREE_PAD; callers run their exact test on what comes back
+void queryLooseQuadtree(const loose_quadtree& tree, float x, float y, float radius, std::vector<int>& found) {
+    radius += QUADTREE_PAD;
+    for (int level = 0; level <= tree.depth; level++) {
+        int range[4];
+        looseQuadtreeLevelRange(tree, level, x, y, radius, range);
+        const int side = 1 << level;
+        const int offset = quadtreeLevelOffset(level);
+        for (int row = range[2]; row <= range[3]; row++) {
+            for (int column = range[0]; column <= range[1]; column++) {
+                const int node = offset + row * side + column;
+                for (int k = tree.nodeStart[node]; k < tree.nodeStart[node + 1]; k++) {
+                    const int o = tree.nodeObjects[k];
+                    const float reach = radius + tree.objectRadius[o];
+                    const float ox = tree.objectX[o] - x;
+                    const float oy = tree.objectY[o] - y;
+                    if (ox * ox + oy * oy <= reach * reach) {
+                        found.push_back(o);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Appends a contact with every particle below particle i that overlaps it.
+// Overlap is the exact test particleContacts uses, centre distance under the
+// sum of the radii. Nodes list objects in ascending order, so each node scan
+// stops at i.
+void looseQuadtreeContacts(const loose_quadtree& tree, int i, std::vector<particle_contact>& contacts) {
+    const float x = tree.objectX[i];
+    const float y = tree.objectY[i];
+    const float radius = tree.objectRadius[i];
+    const sf::Vector2f position(x, y);
+    for (int level = 0; level <= tree.depth; level++) {
+        int range[4];
+        looseQuadtreeLevelRange(tree, level, x, y, radius + QUADTREE_PAD, range);
+        const int side = 1 << level;
+        const int offset = quadtreeLevelOffset(level);
+        for (int row = range[2]; row <= range[3]; row++) {
+            for (int column = range[0]; column <= range[1]; column++) {
+                const int node = offset + row * side + column;
+                for (int k = tree.nodeStart[node]; k < tree.nodeStart[node + 1]; k++) {
+                    const int o = tree.nodeObjects[k];
+                    if (o >= i) {
+                        break;
+                    }
+                    float distance = distanceBetweenTwoPoints(position, sf::Vector2f(tree.objectX[o], tree.objectY[o]));
+                    if (distance < radius + tree.objectRadius[o]) {
+                        particle_contact contact;
+                        contact.a = o;
+                        contact.b = i;
+                        contact.distance = distance;
+                        contacts.push_back(contact);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Columns then rows, first and last, of the nodes of a level whose loose
+// bounds (a cell and a half either side of the node's corner) reach the
+// query box. Empty when the level holds no objects.
+void looseQuadtreeLevelRange(const loose_quadtree& tree, int level, float x, float y, float radius, int range[4]) {
+    const int side = 1 << level;
+    const float cell = tree.size / side;
+    range[0] = std::max(static_cast<int>(std::floor((x - radius - tree.originX) / cell - 1.5f)), 0);
+    range[1] = std::min(static_cast<int>(std::floor((x + radius - tree.originX) / cell + 0.5f)), side - 1);
+    range[2] = std::max(static_cast<int>(std::floor((y - radius - tree.originY) / cell - 1.5f)), 0);
+    range[3] = std::min(static_cast<int>(std::floor((y + radius - tree.originY) / cell + 0.5f)), side - 1);
+    if (tree.nodeStart.empty() || tree.nodeStart[quadtreeLevelOffset(level)] == tree.nodeStart[quadtreeLevelOffset(level + 1)]) {
+        range[1] = -1;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "Particle.h"
+#include "ParticleStore.h"
+
+// Loose quadtree over bounding circles of particles and attractors, rebuilt
+// every frame. Each object sits in the deepest node at least twice its
+// radius wide that holds its centre, and a node's loose bounds are its cell
+// grown by half a cell on every side, so they always hold the whole circle.
+// Small particles and 125 px attraction circles each end up at their own
+// depth instead of sharing one cell size.
+//
+// Nodes are implicit: level L is a 2^L x 2^L grid and node ids run level by
+// level from the root. A query walks each level that holds objects and only
+// visits the few nodes whose loose bounds reach it. Objects [0, particles)
+// are particle indices, the rest are attractor indices offset by particles.
+typedef struct {
+    float originX;
+    float originY;
+    float size;
+    int depth;
+    int particles;
+    std::vector<float> objectX;
+    std::vector<float> objectY;
+    std::vector<float> objectRadius;
+    std::vector<int> objectNode;
+    // Per node; objects of node k are nodeObjects[nodeStart[k], nodeStart[k + 1])
+    std::vector<int> nodeStart;
+    std::vector<int> nodeObjects;
+    std::vector<std::atomic<int>> nodeFill;
+    // Scratch of the scan over nodeStart, kept between builds
+    std::vector<int> scanOffsets;
+} loose_quadtree;
+
+// Functions
+void buildLooseQuadtree(loose_quadtree& tree, const ParticleStore& particles, const std::vector<attractive_particle>& attractive_particles);
+void queryLooseQuadtree(const loose_quadtree& tree, float x, float y, float radius, std::vector<int>& found);
+void looseQuadtreeContacts(const loose_quadtree& tree, int i, std::vector<particle_contact>& contacts);
@@ -0,0 +1,121 @@
+#include "MortonOrder.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <mutex>
+
+// Steps between reorders at most, and between two locality checks
+const int MORTON_REORDER_INTERVAL = 300;
+const int MORTON_CHECK_INTERVAL = 15;
+// Reorder early once neighbours in memory sit this many times further apart
+// on the curve, in bits, than right after the last reorder
+const float MORTON_LOCALITY_SLACK = 2.f;
+// Removed particles sort after every live one
+const unsigned int MORTON_REMOVED = 0xFFFFFFFFu;
+
+// Functions
+unsigned int spreadMortonBits(unsigned int v);
+int codeBitLength(unsigned int v);
+
+// Bits 0..15 of v moved to the even bits 0..30
+unsigned int spreadMortonBits(unsigned int v) {
+    v &= 0x0000FFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+// 16 bit x and y interleaved, x on the even bits
+unsigned int mortonCode(unsigned int x, unsigned int y) {
+    return spreadMortonBits(x) | (spreadMortonBits(y) << 1);
+}
+
+int codeBitLength(unsigned int v) {
+    int bits = 0;
+    while (v != 0) {
+        bits++;
+        v >>= 1;
+    }
+    return bits;
+}
+
+// Positions are quantised to 16 bits over the bounds of the live particles,
+// so the curve is as fine as it can be whatever the scene size
+void computeMortonCodes(const ParticleStore& particles, std::vector<unsigned int>& codes) {
+    const int n = awakeParticleCount(particles);
+    codes.resize(n);
+    const particle_bounds bounds = liveParticleBounds(particles, n);
+    const float scaleX = 65535.f / std::max(bounds.maxX - bounds.minX, 1.f);
+    const float scaleY = 65535.f / std::max(bounds.maxY - bounds.minY, 1.f);
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (particles.flags[i] & PARTICLE_REMOVED) {
+                codes[i] = MORTON_REMOVED;
+                continue;
+            }
+            const unsigned int qx = static_cast<unsigned int>(std::min((particles.x[i] - bounds.minX) * scaleX, 65535.f));
+            const unsigned int qy = static_cast<unsigned int>(std::min((particles.y[i] - bounds.minY) * scaleY, 65535.f));
+            codes[i] = mortonCode(qx, qy);
+        }
+    });
+}
+
+// Mean over live neighbours in the store; the sums are whole numbers, so
+// merging chunks in any order gives the same result
+float mortonLocality(const std::vector<unsigned int>& codes) {
+    const int n = static_cast<int>(codes.size());
+    std::mutex sumMutex;
+    long long bits = 0;
+    long long pairs = 0;
+    parallelFor(std::max(n - 1, 0), PARALLEL_GRAIN, [&](int begin, int end) {
+        long long chunkBits = 0;
+        long long chunkPairs = 0;
+        for (int i = begin; i < end; i++) {
+            if (codes[i] == MORTON_REMOVED || codes[i + 1] == MORTON_REMOVED) {
+                continue;
+            }
+            chunkBits += codeBitLength(codes[i] ^ codes[i + 1]);
+            chunkPairs++;
+        }
+        std::lock_guard<std::mutex> lock(sumMutex);
+        bits += chunkBits;
+        pairs += chunkPairs;
+    });
+    return pairs > 0 ? static_cast<float>(static_cast<double>(bits) / pairs) : 0.f;
+}
+
+// Sorts by the codes of the last check, which are up to date when called
+// from updateMortonOrder. Indices change, handles keep working.
+void reorderParticlesByMorton(morton_order& morton, ParticleStore& particles) {
+    const int n = awakeParticleCount(particles);
+    morton.order.resize(n);
+    for (int i = 0; i < n; i++) {
+        morton.order[i] = i;
+    }
+    parallelRadixSort(morton.codes, morton.order, morton.sortScratch);
+    permuteParticleStore(particles, morton.order, morton.permuteScratch);
+    morton.sortedLocality = mortonLocality(morton.codes);
+    morton.locality = morton.sortedLocality;
+    morton.stepsSinceReorder = 0;
+    morton.reorders++;
+}
+
+// Called once per step; returns true if the store was reordered
+bool updateMortonOrder(morton_order& morton, ParticleStore& particles) {
+    morton.stepsSinceReorder++;
+    const bool due = morton.stepsSinceReorder >= MORTON_REORDER_INTERVAL;
+    if (!due && morton.stepsSinceReorder % MORTON_CHECK_INTERVAL != 0) {
+        return false;
+    }
+    computeMortonCodes(particles, morton.codes);
+    if (!due) {
+        morton.locality = mortonLocality(morton.codes);
+        if (morton.reorders > 0 && morton.locality <= morton.sortedLocality + MORTON_LOCALITY_SLACK) {
+            return false;
+        }
+    }
+    reorderParticlesByMorton(morton, particles);
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include "ParticleStore.h"
+#include "RadixSort.h"
+
+// Keeps the store sorted along a Z curve, so particles that are close in
+// space are close in memory and a broad phase query touches a few cache
+// lines instead of one per neighbour. Particles drift out of order as they
+// move; the order is rebuilt every MORTON_REORDER_INTERVAL steps, or sooner
+// when the locality check finds it has decayed. Only the awake particles are
+// sorted, the sleepers stay at the end as they are.
+//
+// Locality is the mean bit length of code[i] ^ code[i + 1] over neighbours
+// in the store: how far along the curve, in powers of two, the next particle
+// in memory sits. A sorted store scores about log2(4^16 / n), a shuffled
+// one about 31.
+typedef struct {
+    std::vector<unsigned int> codes;
+    std::vector<int> order;
+    radix_sort_scratch sortScratch;
+    permute_scratch permuteScratch;
+    int stepsSinceReorder;
+    // Right after the last reorder, and at the last check
+    float sortedLocality;
+    float locality;
+    int reorders;
+} morton_order;
+
+// Functions
+unsigned int mortonCode(unsigned int x, unsigned int y);
+void computeMortonCodes(const ParticleStore& particles, std::vector<unsigned int>& codes);
+float mortonLocality(const std::vector<unsigned int>& codes);
+void reorderParticlesByMorton(morton_order& morton, ParticleStore& particles);
+bool updateMortonOrder(morton_order& morton, ParticleStore& particles);
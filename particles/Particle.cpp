@@ -0,0 +1,80 @@
+#include "Particle.h"
+#include "Constants.h"
+#include "Random.h"
+#include <cmath>
+
+unsigned char randomColorIndex() {
+    return static_cast<unsigned char>(nextRandomIndex(threadRandomStream(), COLORS_LENGTH));
+}
+
+particle_handle createParticle(ParticleStore& particles, float radius, bool freeze, sf::Vector2f position, sf::Vector2f velocity, unsigned char colorIndex) {
+    return pushParticle(particles, radius, freeze ? PARTICLE_FROZEN : 0, position, velocity, colorIndex);
+}
+
+int borderCollapse(const ParticleStore& particles, int i) {
+    if (particles.flags[i] & PARTICLE_REMOVED) {
+        return 0;
+    }
+    const float radius = particles.radius[i];
+    const float diameter = radius * 2;
+    if (particles.x[i] + diameter > WINDOW_WIDTH) {
+        return 2;
+    }
+    if (particles.x[i] - radius < 0) {
+        return -2;
+    }
+    if (particles.y[i] - diameter < 0) {
+        return -1;
+    }
+    if (particles.y[i] + diameter > WINDOW_HEIGHT) {
+        return 1;
+    }
+    return 0;
+}
+
+int borderCollapse(attractive_particle p) {
+    if (p.removed) {
+        return 0;
+    }
+    const float diameter = p.radius * 2;
+    if (p.position.x + diameter > WINDOW_WIDTH) {
+        return 2;
+    }
+    if (p.position.x - p.radius < 0) {
+        return -2;
+    }
+    if (p.position.y - diameter < 0) {
+        return -1;
+    }
+    if (p.position.y + diameter > WINDOW_HEIGHT) {
+        return 1;
+    }
+    return 0;
+}
+
+float randomFloat(float min, float max) {
+    return nextRandomFloat(threadRandomStream(), min, max);
+}
+
+float distanceBetweenTwoPoints(sf::Vector2f a, sf::Vector2f b) {
+    return sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2));
+}
+
+bool inParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB) {
+    float rangeX = positionA.x + MAX_RADIUS * 2;
+    float rangeY = positionA.y + MAX_RADIUS * 2;
+    return positionB.x <= rangeX && positionB.x >= -rangeX && positionB.y <= rangeY && positionB.y >= -rangeY;
+}
+
+bool inAttractionRadiusParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB, float attractionRadius) {
+    float rangeX = positionA.x + attractionRadius * 2;
+    float rangeY = positionA.y + attractionRadius * 2;
+    return positionB.x <= rangeX && positionB.x >= -rangeX && positionB.y <= rangeY && positionB.y >= -rangeY;
+}
+
+sf::Vector2f normalize(sf::Vector2f v) {
+    float mag = hypot(v.x, v.y);
+    v.x = v.x / mag;
+    v.y = v.y / mag;
+    return v;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <SFML/System/Vector2.hpp>
+#include "ParticleStore.h"
+
+// Types
+typedef struct {
+    int id;
+    float radius;
+    bool removed;
+    float attractionRadius;
+    sf::Vector2f attraction;
+    sf::Vector2f position;
+    sf::Vector2f previousPosition;
+    sf::Vector2f velocity;
+} attractive_particle;
+
+// Two overlapping particles, a < b, and the distance between their positions
+typedef struct {
+    int a;
+    int b;
+    float distance;
+} particle_contact;
+
+// Functions
+particle_handle createParticle(ParticleStore& particles, float radius, bool freeze, sf::Vector2f position, sf::Vector2f velocity, unsigned char colorIndex);
+int borderCollapse(const ParticleStore& particles, int i);
+int borderCollapse(attractive_particle p);
+float randomFloat(float min, float max);
+unsigned char randomColorIndex();
+float distanceBetweenTwoPoints(sf::Vector2f a, sf::Vector2f b);
+bool inParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB);
+bool inAttractionRadiusParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB, float attractionRadius);
+sf::Vector2f normalize(sf::Vector2f v);
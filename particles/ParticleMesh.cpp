@@ -0,0 +1,134 @@
+#include "ParticleMesh.h"
+#include "ThreadPool.h"
+#include <cmath>
+
+// Cells per parallel chunk of the per cell passes
+const int PARTICLE_MESH_CELL_GRAIN = 4096;
+
+// Functions
+int particleMeshBlocks(int particlesCount);
+
+// The kernel is laid out circularly: offsets 0 to size - 1 at the start of
+// each axis, -size + 1 to -1 at the end, and the middle line, which a
+// padded grid never reaches, left empty. Its transform is taken once here.
+void initParticleMesh(particle_mesh& mesh, int size, float extent, float softening) {
+    mesh.size = size;
+    mesh.cellSize = extent / size;
+    mesh.softening = softening;
+    const int padded = 2 * size;
+    initFftPlan(mesh.plan, padded);
+    mesh.kernelRe.assign(padded * padded, 0.f);
+    mesh.kernelIm.assign(padded * padded, 0.f);
+    const double softening2 = static_cast<double>(softening) * softening;
+    for (int row = 0; row < padded; row++) {
+        for (int column = 0; column < padded; column++) {
+            if (row == size || column == size) {
+                continue;
+            }
+            // From the receiving cell to the pulling one, so the kernel at an
+            // offset of d cells is minus the pull of a cell d away
+            const double dx = -(column < size ? column : column - padded) * static_cast<double>(mesh.cellSize);
+            const double dy = -(row < size ? row : row - padded) * static_cast<double>(mesh.cellSize);
+            const double r2 = dx * dx + dy * dy + softening2;
+            const double pull = 1 / (r2 * std::sqrt(r2));
+            mesh.kernelRe[row * padded + column] = static_cast<float>(pull * dx);
+            mesh.kernelIm[row * padded + column] = static_cast<float>(pull * dy);
+        }
+    }
+    fft2d(mesh.plan, mesh.kernelRe.data(), mesh.kernelIm.data(), padded, false);
+    const float scale = 1.f / (static_cast<float>(padded) * padded);
+    for (int k = 0; k < padded * padded; k++) {
+        mesh.kernelRe[k] *= scale;
+        mesh.kernelIm[k] *= scale;
+    }
+    mesh.mass.assign(size * size, 0.f);
+    mesh.forceX.assign(size * size, 0.f);
+    mesh.forceY.assign(size * size, 0.f);
+    mesh.re.assign(padded * padded, 0.f);
+    mesh.im.assign(padded * padded, 0.f);
+    mesh.totalMass = 0;
+}
+
+// Depends on the count only, so the sums, and the steps, do not depend on
+// the thread count
+int particleMeshBlocks(int particlesCount) {
+    return std::max(1, std::min(PARTICLE_MESH_DEPOSIT_BLOCKS, particlesCount / PARALLEL_GRAIN));
+}
+
+// Sleepers and frozen particles pull too; removed ones weigh nothing
+void depositParticleMesh(particle_mesh& mesh, const ParticleStore& particles) {
+    const int n = particleCount(particles);
+    const int cells = mesh.size * mesh.size;
+    const int blocks = particleMeshBlocks(n);
+    mesh.blocks.resize(static_cast<size_t>(blocks) * cells);
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            float* grid = mesh.blocks.data() + static_cast<size_t>(b) * cells;
+            std::fill(grid, grid + cells, 0.f);
+            const int first = static_cast<int>(static_cast<long long>(n) * b / blocks);
+            const int last = static_cast<int>(static_cast<long long>(n) * (b + 1) / blocks);
+            for (int i = first; i < last; i++) {
+                const float mass = (particles.flags[i] & PARTICLE_REMOVED) ? 0.f : particles.radius[i] * particles.radius[i];
+                float fx;
+                float fy;
+                const int cell = particleMeshCell(mesh, particles.x[i], particles.y[i], fx, fy);
+                grid[cell] += mass * (1 - fx) * (1 - fy);
+                grid[cell + 1] += mass * fx * (1 - fy);
+                grid[cell + mesh.size] += mass * (1 - fx) * fy;
+                grid[cell + mesh.size + 1] += mass * fx * fy;
+            }
+        }
+    });
+    parallelFor(cells, PARTICLE_MESH_CELL_GRAIN, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            float sum = 0;
+            for (int b = 0; b < blocks; b++) {
+                sum += mesh.blocks[static_cast<size_t>(b) * cells + c];
+            }
+            mesh.mass[c] = sum;
+        }
+    });
+    double total = 0;
+    for (int c = 0; c < cells; c++) {
+        total += mesh.mass[c];
+    }
+    mesh.totalMass = static_cast<float>(total);
+}
+
+// One forward transform of the mass, a product with the kernel, and one
+// inverse. Both pulls are real, so x and y come back together as the real
+// and imaginary parts of a single inverse.
+void solveParticleMesh(particle_mesh& mesh) {
+    const int size = mesh.size;
+    const int padded = 2 * size;
+    parallelFor(padded, PARTICLE_MESH_CELL_GRAIN / padded, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            float* re = mesh.re.data() + row * padded;
+            float* im = mesh.im.data() + row * padded;
+            std::fill(im, im + padded, 0.f);
+            if (row < size) {
+                std::copy(mesh.mass.begin() + row * size, mesh.mass.begin() + (row + 1) * size, re);
+                std::fill(re + size, re + padded, 0.f);
+            }
+            else {
+                std::fill(re, re + padded, 0.f);
+            }
+        }
+    });
+    fft2d(mesh.plan, mesh.re.data(), mesh.im.data(), size, false);
+    parallelFor(padded * padded, PARTICLE_MESH_CELL_GRAIN, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const float re = mesh.re[k] * mesh.kernelRe[k] - mesh.im[k] * mesh.kernelIm[k];
+            const float im = mesh.re[k] * mesh.kernelIm[k] + mesh.im[k] * mesh.kernelRe[k];
+            mesh.re[k] = re;
+            mesh.im[k] = im;
+        }
+    });
+    fft2d(mesh.plan, mesh.re.data(), mesh.im.data(), size, true);
+    parallelFor(size, PARTICLE_MESH_CELL_GRAIN / size, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            std::copy(mesh.re.begin() + row * padded, mesh.re.begin() + row * padded + size, mesh.forceX.begin() + row * size);
+            std::copy(mesh.im.begin() + row * padded, mesh.im.begin() + row * padded + size, mesh.forceY.begin() + row * size);
+        }
+    });
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "Fft.h"
+#include "ParticleStore.h"
+
+// Cells per side of the mesh over the window, a power of two. The error
+// against the direct sum falls about four times per doubling; 512 cells of
+// about 2 pixels, under a particle's radius, keep it near 3% of the pull.
+const int PARTICLE_MESH_SIZE = 512;
+// Mass is deposited into up to this many private grids, one per block of
+// particles, then summed cell by cell in block order
+const int PARTICLE_MESH_DEPOSIT_BLOCKS = 16;
+
+// Particle-mesh gravity, the same softened pull as the Barnes-Hut tree but
+// at a cost that barely grows past the deposit and the gather. Each particle's
+// mass, radius squared, is spread over the four nearest cell centres by
+// cloud-in-cell weights; the field of that mass is its convolution with the
+// pull of a single cell, done as a product in frequency space; the force at
+// a particle is the same four cells weighed back. The grid is padded to twice
+// its size with empty cells so the circular convolution does not wrap: the
+// window is isolated, not periodic.
+//
+// The pull is only resolved down to a cell or two. Below that the mesh
+// underestimates it, and the collision pass is what matters there anyway.
+typedef struct {
+    int size;
+    float cellSize;
+    float softening;
+    // Over the padded grid of twice size per side
+    fft_plan plan;
+    // Transform of the pull kernel, x pull in the real part and y pull in the
+    // imaginary, scaled for the unscaled inverse
+    std::vector<float> kernelRe;
+    std::vector<float> kernelIm;
+    std::vector<float> blocks;
+    std::vector<float> mass;
+    float totalMass;
+    std::vector<float> re;
+    std::vector<float> im;
+    // Acceleration at each cell centre, per unit of mass, size x size
+    std::vector<float> forceX;
+    std::vector<float> forceY;
+} particle_mesh;
+
+// Functions
+void initParticleMesh(particle_mesh& mesh, int size, float extent, float softening);
+void depositParticleMesh(particle_mesh& mesh, const ParticleStore& particles);
+void solveParticleMesh(particle_mesh& mesh);
+
+// Lower cell of the four around a point and the weights towards the upper
+// ones. Points are clamped into the grid; past the outer cell centres all
+// of the weight stays on the edge.
+inline int particleMeshCell(const particle_mesh& mesh, float x, float y, float& fx, float& fy) {
+    const float limit = mesh.size - 1.001f;
+    const float gx = std::min(std::max(x / mesh.cellSize - 0.5f, 0.f), limit);
+    const float gy = std::min(std::max(y / mesh.cellSize - 0.5f, 0.f), limit);
+    const int cx = static_cast<int>(gx);
+    const int cy = static_cast<int>(gy);
+    fx = gx - cx;
+    fy = gy - cy;
+    return cy * mesh.size + cx;
+}
+
+inline void particleMeshAcceleration(const particle_mesh& mesh, float x, float y, float& ax, float& ay) {
+    float fx;
+    float fy;
+    const int cell = particleMeshCell(mesh, x, y, fx, fy);
+    const int n = mesh.size;
+    const float w00 = (1 - fx) * (1 - fy);
+    const float w10 = fx * (1 - fy);
+    const float w01 = (1 - fx) * fy;
+    const float w11 = fx * fy;
+    ax = w00 * mesh.forceX[cell] + w10 * mesh.forceX[cell + 1] + w01 * mesh.forceX[cell + n] + w11 * mesh.forceX[cell + n + 1];
+    ay = w00 * mesh.forceY[cell] + w10 * mesh.forceY[cell + 1] + w01 * mesh.forceY[cell + n] + w11 * mesh.forceY[cell + n + 1];
+}
@@ -0,0 +1,347 @@
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <mutex>
+
+// Functions
+void moveParticle(ParticleStore& store, int from, int to);
+void popParticle(ParticleStore& store);
+void swapParticles(ParticleStore& store, int i, int j);
+void touchSleepingParticles(ParticleStore& store);
+template <typename T>
+void gatherColumn(std::vector<T>& column, std::vector<T>& scratch, const std::vector<int>& order);
+
+// Hands out sleepEpoch values, so no two store states share one
+unsigned int SLEEP_EPOCHS = 0;
+
+int particleCount(const ParticleStore& store) {
+    return static_cast<int>(store.x.size());
+}
+
+int awakeParticleCount(const ParticleStore& store) {
+    return particleCount(store) - store.sleeping;
+}
+
+particle_handle pushParticle(ParticleStore& store, float radius, unsigned char flags, sf::Vector2f position, sf::Vector2f velocity, unsigned char colorIndex) {
+    const int index = particleCount(store);
+    int slot;
+    if (!store.freeSlots.empty()) {
+        slot = store.freeSlots.back();
+        store.freeSlots.pop_back();
+        store.slotIndex[slot] = index;
+    }
+    else {
+        slot = static_cast<int>(store.slotIndex.size());
+        store.slotIndex.push_back(index);
+        store.slotGeneration.push_back(0);
+    }
+    store.slot.push_back(slot);
+    store.x.push_back(position.x);
+    store.y.push_back(position.y);
+    store.vx.push_back(velocity.x);
+    store.vy.push_back(velocity.y);
+    store.radius.push_back(radius);
+    store.flags.push_back(flags);
+    store.colorIndex.push_back(colorIndex);
+    store.previousX.push_back(position.x);
+    store.previousY.push_back(position.y);
+    // New particles are awake, the first sleeper makes room for them
+    if (store.sleeping > 0) {
+        swapParticles(store, index, index - store.sleeping);
+        return particleHandle(store, index - store.sleeping);
+    }
+    return particleHandle(store, index);
+}
+
+// Makes room for n awake particles at [first, first + n) and returns first,
+// for batches that fill the columns themselves. Slots are taken like n
+// pushParticle calls would take them, every other column is left to the
+// caller. Sleepers in the way move to the end.
+int appendParticles(ParticleStore& store, int n) {
+    const int count = particleCount(store);
+    const int first = count - store.sleeping;
+    store.slot.resize(count + n);
+    store.x.resize(count + n);
+    store.y.resize(count + n);
+    store.vx.resize(count + n);
+    store.vy.resize(count + n);
+    store.radius.resize(count + n);
+    store.flags.resize(count + n);
+    store.colorIndex.resize(count + n);
+    store.previousX.resize(count + n);
+    store.previousY.resize(count + n);
+    const int moved = std::min(n, store.sleeping);
+    for (int k = 0; k < moved; k++) {
+        moveParticle(store, first + k, count + n - moved + k);
+    }
+    for (int i = first; i < first + n; i++) {
+        int slot;
+        if (!store.freeSlots.empty()) {
+            slot = store.freeSlots.back();
+            store.freeSlots.pop_back();
+            store.slotIndex[slot] = i;
+        }
+        else {
+            slot = static_cast<int>(store.slotIndex.size());
+            store.slotIndex.push_back(i);
+            store.slotGeneration.push_back(0);
+        }
+        store.slot[i] = slot;
+    }
+    return first;
+}
+
+particle_handle particleHandle(const ParticleStore& store, int i) {
+    particle_handle handle;
+    handle.slot = store.slot[i];
+    handle.generation = store.slotGeneration[handle.slot];
+    return handle;
+}
+
+// Current index of the particle, or -1 if it has been removed since the
+// handle was taken
+int particleIndex(const ParticleStore& store, particle_handle handle) {
+    if (handle.slot < 0 || handle.slot >= static_cast<int>(store.slotIndex.size())) {
+        return -1;
+    }
+    if (store.slotGeneration[handle.slot] != handle.generation) {
+        return -1;
+    }
+    return store.slotIndex[handle.slot];
+}
+
+void moveParticle(ParticleStore& store, int from, int to) {
+    store.slot[to] = store.slot[from];
+    store.x[to] = store.x[from];
+    store.y[to] = store.y[from];
+    store.vx[to] = store.vx[from];
+    store.vy[to] = store.vy[from];
+    store.radius[to] = store.radius[from];
+    store.flags[to] = store.flags[from];
+    store.colorIndex[to] = store.colorIndex[from];
+    store.previousX[to] = store.previousX[from];
+    store.previousY[to] = store.previousY[from];
+    store.slotIndex[store.slot[to]] = to;
+}
+
+void popParticle(ParticleStore& store) {
+    store.slot.pop_back();
+    store.x.pop_back();
+    store.y.pop_back();
+    store.vx.pop_back();
+    store.vy.pop_back();
+    store.radius.pop_back();
+    store.flags.pop_back();
+    store.colorIndex.pop_back();
+    store.previousX.pop_back();
+    store.previousY.pop_back();
+}
+
+// O(1): the last particle takes the removed one's index. Handles to the
+// removed particle go stale, handles to the moved one keep working. With
+// sleepers around, an awake particle is replaced by the last awake one and
+// that one by the last sleeper, so the sleepers stay at the end.
+void removeParticle(ParticleStore& store, int i) {
+    const int slot = store.slot[i];
+    store.slotGeneration[slot]++;
+    store.freeSlots.push_back(slot);
+    const int last = particleCount(store) - 1;
+    const int lastAwake = awakeParticleCount(store) - 1;
+    if (i > lastAwake) {
+        store.sleeping--;
+        touchSleepingParticles(store);
+    }
+    else if (i != lastAwake) {
+        moveParticle(store, lastAwake, i);
+        i = lastAwake;
+    }
+    if (i != last) {
+        moveParticle(store, last, i);
+    }
+    popParticle(store);
+}
+
+void swapParticles(ParticleStore& store, int i, int j) {
+    std::swap(store.slot[i], store.slot[j]);
+    std::swap(store.x[i], store.x[j]);
+    std::swap(store.y[i], store.y[j]);
+    std::swap(store.vx[i], store.vx[j]);
+    std::swap(store.vy[i], store.vy[j]);
+    std::swap(store.radius[i], store.radius[j]);
+    std::swap(store.flags[i], store.flags[j]);
+    std::swap(store.colorIndex[i], store.colorIndex[j]);
+    std::swap(store.previousX[i], store.previousX[j]);
+    std::swap(store.previousY[i], store.previousY[j]);
+    store.slotIndex[store.slot[i]] = i;
+    store.slotIndex[store.slot[j]] = j;
+}
+
+void touchSleepingParticles(ParticleStore& store) {
+    store.sleepEpoch = ++SLEEP_EPOCHS;
+}
+
+// The awake particle i swaps with the last awake one and joins the sleepers
+void sleepParticle(ParticleStore& store, int i) {
+    swapParticles(store, i, awakeParticleCount(store) - 1);
+    store.sleeping++;
+    touchSleepingParticles(store);
+}
+
+// The sleeping particle i swaps with the first sleeper and joins the awake
+void wakeParticle(ParticleStore& store, int i) {
+    swapParticles(store, i, awakeParticleCount(store));
+    store.sleeping--;
+    touchSleepingParticles(store);
+}
+
+// Nothing moves, the sleepers are already where awake particles end
+void wakeAllParticles(ParticleStore& store) {
+    if (store.sleeping > 0) {
+        store.sleeping = 0;
+        touchSleepingParticles(store);
+    }
+}
+
+void setParticleFlag(ParticleStore& store, int i, unsigned char flag, bool value) {
+    if (value) {
+        store.flags[i] |= flag;
+    }
+    else {
+        store.flags[i] &= ~flag;
+    }
+}
+
+void reserveParticles(ParticleStore& store, int n) {
+    store.slot.reserve(n);
+    store.x.reserve(n);
+    store.y.reserve(n);
+    store.vx.reserve(n);
+    store.vy.reserve(n);
+    store.radius.reserve(n);
+    store.flags.reserve(n);
+    store.colorIndex.reserve(n);
+    store.previousX.reserve(n);
+    store.previousY.reserve(n);
+    store.slotIndex.reserve(n);
+    store.slotGeneration.reserve(n);
+    store.freeSlots.reserve(n);
+}
+
+// Every outstanding handle goes stale, slots are kept for reuse
+void clearParticleStore(ParticleStore& store) {
+    for (int slot : store.slot) {
+        store.slotGeneration[slot]++;
+        store.freeSlots.push_back(slot);
+    }
+    store.slot.clear();
+    store.x.clear();
+    store.y.clear();
+    store.vx.clear();
+    store.vy.clear();
+    store.radius.clear();
+    store.flags.clear();
+    store.colorIndex.clear();
+    store.previousX.clear();
+    store.previousY.clear();
+    wakeAllParticles(store);
+}
+
+// Drops every removed particle with swap-and-pop, O(n) however many left
+void compactParticleStore(ParticleStore& store) {
+    int i = 0;
+    while (i < particleCount(store)) {
+        if (store.flags[i] & PARTICLE_REMOVED) {
+            removeParticle(store, i);
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+// Rebuilds every column so that index k holds the particle that was at
+// order[k]; order must be a permutation of the indices. Handles keep working.
+// A shorter order only permutes that many leading particles, which is how the
+// awake particles are reordered without touching the sleepers.
+void permuteParticleStore(ParticleStore& store, const std::vector<int>& order, permute_scratch& scratch) {
+    gatherColumn(store.slot, scratch.ints, order);
+    gatherColumn(store.x, scratch.floats, order);
+    gatherColumn(store.y, scratch.floats, order);
+    gatherColumn(store.vx, scratch.floats, order);
+    gatherColumn(store.vy, scratch.floats, order);
+    gatherColumn(store.radius, scratch.floats, order);
+    gatherColumn(store.flags, scratch.bytes, order);
+    gatherColumn(store.colorIndex, scratch.bytes, order);
+    gatherColumn(store.previousX, scratch.floats, order);
+    gatherColumn(store.previousY, scratch.floats, order);
+    parallelFor(static_cast<int>(order.size()), PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            store.slotIndex[store.slot[i]] = i;
+        }
+    });
+}
+
+// column[k] = old column[order[k]] for k below order.size(), through scratch,
+// which ends up holding the old column so the next call can reuse it
+template <typename T>
+void gatherColumn(std::vector<T>& column, std::vector<T>& scratch, const std::vector<int>& order) {
+    const int n = static_cast<int>(order.size());
+    // The column takes over the scratch's buffer, which keeps its reservation
+    scratch.reserve(column.capacity());
+    scratch.resize(column.size());
+    std::copy(column.begin() + n, column.end(), scratch.begin() + n);
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            scratch[i] = column[order[i]];
+        }
+    });
+    column.swap(scratch);
+}
+
+// Called at the start of every simulation step
+void saveParticlePositions(ParticleStore& store) {
+    store.previousX = store.x;
+    store.previousY = store.y;
+}
+
+// Over the first count particles, merged chunk by chunk; min and max do not
+// care about the order the chunks come in
+particle_bounds liveParticleBounds(const ParticleStore& store, int count) {
+    std::mutex boundsMutex;
+    particle_bounds bounds = {0.f, 0.f, 0.f, 0.f, 0};
+    parallelFor(count, PARALLEL_GRAIN, [&](int begin, int end) {
+        particle_bounds chunk = {0.f, 0.f, 0.f, 0.f, 0};
+        for (int i = begin; i < end; i++) {
+            if (store.flags[i] & PARTICLE_REMOVED) {
+                continue;
+            }
+            if (chunk.alive == 0) {
+                chunk.minX = chunk.maxX = store.x[i];
+                chunk.minY = chunk.maxY = store.y[i];
+            }
+            chunk.minX = std::min(chunk.minX, store.x[i]);
+            chunk.minY = std::min(chunk.minY, store.y[i]);
+            chunk.maxX = std::max(chunk.maxX, store.x[i]);
+            chunk.maxY = std::max(chunk.maxY, store.y[i]);
+            chunk.alive++;
+        }
+        if (chunk.alive == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(boundsMutex);
+        if (bounds.alive == 0) {
+            bounds = chunk;
+            return;
+        }
+        bounds.minX = std::min(bounds.minX, chunk.minX);
+        bounds.minY = std::min(bounds.minY, chunk.minY);
+        bounds.maxX = std::max(bounds.maxX, chunk.maxX);
+        bounds.maxY = std::max(bounds.maxY, chunk.maxY);
+        bounds.alive += chunk.alive;
+    });
+    return bounds;
+}
+
+int particleStoreBytesPerParticle() {
+    return sizeof(int) + sizeof(float) * 7 + sizeof(unsigned char) * 2 + sizeof(int) + sizeof(unsigned int);
+}
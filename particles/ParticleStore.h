@@ -0,0 +1,84 @@
+#pragma once
+#include <SFML/System/Vector2.hpp>
+#include <vector>
+
+// Particle flags
+const unsigned char PARTICLE_FROZEN = 1 << 0;
+const unsigned char PARTICLE_REMOVED = 1 << 1;
+
+// Stable reference to a particle. The slot never changes while the particle
+// lives, whatever removals do to its index in the store, and the generation
+// tells a handle to a removed particle apart from the slot's next owner.
+typedef struct {
+    int slot;
+    unsigned int generation;
+} particle_handle;
+
+// Structure of arrays particle storage. Every field is its own contiguous
+// column, so a loop only pulls the fields it reads into cache. There is no
+// SFML drawable per particle: the renderer builds its shapes from x, y,
+// radius and colorIndex.
+//
+// The columns are dense and removal is swap-and-pop, so particles do move
+// between indices; slotIndex/slotGeneration map handles to current indices.
+//
+// Sleeping particles are kept at the end: [0, count - sleeping) are awake and
+// every simulation pass only runs over them.
+typedef struct {
+    std::vector<int> slot;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> radius;
+    std::vector<unsigned char> flags;
+    std::vector<unsigned char> colorIndex;
+    // Position at the start of the last simulation step, the renderer
+    // interpolates from there to x, y
+    std::vector<float> previousX;
+    std::vector<float> previousY;
+    // Per slot
+    std::vector<int> slotIndex;
+    std::vector<unsigned int> slotGeneration;
+    std::vector<int> freeSlots;
+    int sleeping = 0;
+    // Changes whenever the set of sleeping particles does, unique across stores
+    unsigned int sleepEpoch = 0;
+} ParticleStore;
+
+// Bounds of the live particles' centres, all 0 when none is alive
+typedef struct {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    int alive;
+} particle_bounds;
+
+// Kept by the caller across permutes, so reordering every few steps does not
+// allocate once the buffers have grown to the store's reservation
+typedef struct {
+    std::vector<float> floats;
+    std::vector<unsigned char> bytes;
+    std::vector<int> ints;
+} permute_scratch;
+
+// Functions
+int particleCount(const ParticleStore& store);
+int awakeParticleCount(const ParticleStore& store);
+particle_handle pushParticle(ParticleStore& store, float radius, unsigned char flags, sf::Vector2f position, sf::Vector2f velocity, unsigned char colorIndex);
+int appendParticles(ParticleStore& store, int n);
+particle_handle particleHandle(const ParticleStore& store, int i);
+int particleIndex(const ParticleStore& store, particle_handle handle);
+void removeParticle(ParticleStore& store, int i);
+void setParticleFlag(ParticleStore& store, int i, unsigned char flag, bool value);
+void reserveParticles(ParticleStore& store, int n);
+void clearParticleStore(ParticleStore& store);
+void compactParticleStore(ParticleStore& store);
+void permuteParticleStore(ParticleStore& store, const std::vector<int>& order, permute_scratch& scratch);
+void sleepParticle(ParticleStore& store, int i);
+void wakeParticle(ParticleStore& store, int i);
+void wakeAllParticles(ParticleStore& store);
+void saveParticlePositions(ParticleStore& store);
+particle_bounds liveParticleBounds(const ParticleStore& store, int count);
+int particleStoreBytesPerParticle();
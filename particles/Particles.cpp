@@ -0,0 +1,886 @@
+#include "Particles.h"
+#include "Constants.h"
+#include "Random.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+// Broad phases. The grid and the quadtree are rebuilt by every
+// collideParticles call, the sweep order and the Verlet lists carry over from
+// the previous step.
+spatial_grid PARTICLES_GRID;
+sweep_and_prune PARTICLES_SWEEP;
+loose_quadtree PARTICLES_QUADTREE;
+verlet_list PARTICLES_VERLET;
+// Tree of every live particle for n-body gravity, and the accelerations it
+// gives, in tree order
+barnes_hut_tree PARTICLES_GRAVITY_TREE;
+std::vector<float> GRAVITY_AX;
+std::vector<float> GRAVITY_AY;
+// Mass and force grids for particle-mesh gravity
+particle_mesh PARTICLES_GRAVITY_MESH;
+// Z-curve order of the store, kept across steps
+morton_order PARTICLES_MORTON;
+// Collision query results, filled in parallel and applied serially. Every
+// overlapping pair is one contact, a < b, in (b, a) order.
+std::vector<particle_contact> PARTICLE_CONTACTS;
+std::vector<std::vector<particle_contact>> BLOCK_CONTACTS;
+std::vector<int> BLOCK_CONTACT_START;
+std::vector<unsigned char> BORDER_COLLAPSED;
+// The same contacts in colour batches, for the solver
+contact_batches CONTACT_BATCHES;
+// Sleeping particles by cell, the freeze settings they fell asleep under, and
+// the slots of the sleepers touched this step
+sleeper_grid PARTICLES_SLEEPERS;
+bool SLEPT_FREEZE_ON_COLLAPSE = false;
+bool SLEPT_FREEZE_ON_BORDER_COLLAPSE = false;
+std::vector<int> TOUCHED_SLEEPERS;
+sleep_stats SLEEP_STATS;
+// Attractors rasterised into the PARTICLES_GRID cells their radius reaches,
+// laid out like the grid's own cell lists and in attractor order per cell
+std::vector<int> ATTRACTOR_CELL_START;
+std::vector<int> ATTRACTOR_CELL_FILL;
+std::vector<int> ATTRACTOR_CELLS;
+// Particles each attractor reaches, from quadtree queries, and the same
+// turned around into attractors per particle, in attractor order
+std::vector<std::vector<int>> ATTRACTOR_HITS;
+std::vector<int> PARTICLE_ATTRACTOR_START;
+std::vector<int> PARTICLE_ATTRACTOR_FILL;
+std::vector<int> PARTICLE_ATTRACTORS;
+
+// Every attractor's pull, for CACHE_ATTRACTOR_FIELD
+attractor_field PARTICLES_ATTRACTOR_FIELD;
+
+// Emitters placed with the mouse or loaded from a scene
+emitter_system PARTICLES_EMITTERS;
+
+// Below this many attractors scanning every particle is cheaper than
+// rebuilding the grid for the attraction pass
+const int GRID_ATTRACTION_MIN_ATTRACTORS = 2;
+
+// TIME is tuned for BASE_SIMULATION_RATE steps per second; scaling it keeps
+// the motion per real second the same at any SIMULATION_RATE.
+float stepTime() {
+    return TIME * (static_cast<float>(BASE_SIMULATION_RATE) / SIMULATION_RATE);
+}
+
+void clearRemovedParticlesAndReallocate(ParticleStore& particles) {
+    compactParticleStore(particles);
+}
+
+// Returns true if the store was reordered this step
+bool keepParticlesInMortonOrder(ParticleStore& particles) {
+    if (!MORTON_REORDER) {
+        return false;
+    }
+    return updateMortonOrder(PARTICLES_MORTON, particles);
+}
+
+void spawnMoreParticlesOnMousePositionRange(sf::Vector2i mousePosition, ParticleStore& particles) {
+    float minX = mousePosition.x - MOUSE_CLICK_SPAWN_RANGE;
+    if (minX <= 0) {
+        minX = mousePosition.x + BASE_SPAWN_MARGIN;
+    }
+    float maxX = mousePosition.x + MOUSE_CLICK_SPAWN_RANGE;
+    if (maxX >= WINDOW_WIDTH) {
+        maxX = mousePosition.x - BASE_SPAWN_MARGIN;
+    }
+    float minY = mousePosition.y - MOUSE_CLICK_SPAWN_RANGE;
+    if (minY <= 0) {
+        minX = mousePosition.y + BASE_SPAWN_MARGIN;
+    }
+    float maxY = mousePosition.y + MOUSE_CLICK_SPAWN_RANGE;
+    if (maxY >= WINDOW_HEIGHT) {
+        maxX = mousePosition.y - BASE_SPAWN_MARGIN;
+    }
+    spawnRandomParticles(particles, MOUSE_CLICK_PARTICLES_SPAWN_COUNT, minX, maxX, minY, maxY);
+}
+
+// n particles spread uniformly over the box, with random radii, velocities
+// and colours, generated column by column
+void spawnRandomParticles(ParticleStore& particles, int n, float minX, float maxX, float minY, float maxY) {
+    const int first = appendParticles(particles, n);
+    fillRandomFloats(particles.radius.data() + first, n, MIN_RADIUS, MAX_RADIUS);
+    fillRandomFloats(particles.x.data() + first, n, minX, maxX);
+    fillRandomFloats(particles.y.data() + first, n, minY, maxY);
+    fillRandomFloats(particles.vx.data() + first, n, -10, 10);
+    fillRandomFloats(particles.vy.data() + first, n, -10, 10);
+    fillRandomIndices(particles.colorIndex.data() + first, n, COLORS_LENGTH);
+    std::fill(particles.flags.begin() + first, particles.flags.begin() + first + n, 0);
+    std::copy(particles.x.begin() + first, particles.x.begin() + first + n, particles.previousX.begin() + first);
+    std::copy(particles.y.begin() + first, particles.y.begin() + first + n, particles.previousY.begin() + first);
+}
+
+emitter_system& particleEmitters() {
+    return PARTICLES_EMITTERS;
+}
+
+// Emitter time runs with the simulation, so slow motion slows the emitters
+// too. Returns true if any emitter had something to do.
+bool updateParticleEmitters(ParticleStore& particles) {
+    const bool active = emittersActive(PARTICLES_EMITTERS);
+    updateEmitters(PARTICLES_EMITTERS, particles, stepTime() / BASE_SIMULATION_RATE);
+    return active;
+}
+
+void placeEmitterOnMousePosition(sf::Vector2i mousePosition) {
+    addEmitter(PARTICLES_EMITTERS, defaultEmitterSettings(static_cast<float>(mousePosition.x), static_cast<float>(mousePosition.y)));
+}
+
+void removeEmitterOnMousePosition(sf::Vector2i mousePosition) {
+    const int nearest = nearestEmitter(PARTICLES_EMITTERS, static_cast<float>(mousePosition.x), static_cast<float>(mousePosition.y), EMITTER_PICK_RANGE);
+    if (nearest >= 0) {
+        removeEmitter(PARTICLES_EMITTERS, nearest);
+    }
+}
+
+void reloadParticles(ParticleStore& particles, std::vector<attractive_particle>& attractive_particles) {
+    clearParticles(particles, attractive_particles);
+    initParticles(PARTICLES_COUNT, particles);
+}
+
+void clearParticles(ParticleStore& particles, std::vector<attractive_particle>& attractive_particles) {
+    clearParticleStore(particles);
+    LAST_ATTRACTIVE_PARTICLE_ID = -1;
+    attractive_particles.clear();
+    resetParticleSchedules();
+}
+
+// The broad phases and the reorder schedule carry over between steps; a
+// world that is cleared or loaded starts them over, so it steps like a
+// fresh one
+void resetParticleSchedules() {
+    PARTICLES_SWEEP = sweep_and_prune();
+    PARTICLES_VERLET = verlet_list();
+    PARTICLES_MORTON = morton_order();
+}
+
+void initParticles(int n, ParticleStore& particles) {
+    spawnRandomParticles(particles, n, BASE_SPAWN_MARGIN, WINDOW_WIDTH - BASE_SPAWN_MARGIN, BASE_SPAWN_MARGIN, WINDOW_HEIGHT - BASE_SPAWN_MARGIN);
+}
+
+const char* broadPhaseName(int broadPhase) {
+    switch (broadPhase) {
+    case BROAD_PHASE_SWEEP:
+        return "sweep";
+    case BROAD_PHASE_QUADTREE:
+        return "quadtree";
+    case BROAD_PHASE_VERLET:
+        return "verlet";
+    default:
+        return "grid";
+    }
+}
+
+const char* nbodyGravityName(int nbodyGravity) {
+    switch (nbodyGravity) {
+    case NBODY_GRAVITY_BARNES_HUT:
+        return "barnes-hut";
+    case NBODY_GRAVITY_MESH:
+        return "mesh";
+    default:
+        return "off";
+    }
+}
+
+// Two phases: the contact queries only read positions, then the freezes are
+// applied from the contact buffer. Every overlapping pair is in the buffer
+// once, so which particles freeze does not depend on their order in the
+// store, the thread count or the broad phase.
+//
+// Only awake particles are queried against each other; contacts with
+// sleepers come from the sleeper grid and wake them. Two sleepers never need
+// testing: neither moves, and the contact between them already did all it
+// could when the second one fell asleep.
+void collideParticles(ParticleStore& particles) {
+    if (!SLEEP_FROZEN_PARTICLES || SLEPT_FREEZE_ON_COLLAPSE != FREEZE_PARTICLES_ON_COLLAPSE
+        || SLEPT_FREEZE_ON_BORDER_COLLAPSE != FREEZE_PARTICLES_ON_BORDER_COLLAPSE) {
+        wakeAllParticles(particles);
+    }
+    const int n = awakeParticleCount(particles);
+    BORDER_COLLAPSED.resize(n);
+    if (BROAD_PHASE == BROAD_PHASE_SWEEP) {
+        findContactsBySweep(particles);
+    }
+    else if (BROAD_PHASE == BROAD_PHASE_QUADTREE) {
+        findContactsInQuadtree(particles);
+    }
+    else if (BROAD_PHASE == BROAD_PHASE_VERLET) {
+        findContactsInVerletList(particles);
+    }
+    else {
+        findContactsInGrid(particles);
+    }
+    const int awakeContacts = static_cast<int>(PARTICLE_CONTACTS.size());
+    if (particles.sleeping > 0) {
+        findContactsWithSleepers(particles);
+    }
+    freezeCollidedParticles(particles);
+    if (static_cast<int>(PARTICLE_CONTACTS.size()) > awakeContacts) {
+        wakeTouchedSleepers(particles, awakeContacts);
+    }
+}
+
+void freezeCollidedParticles(ParticleStore& particles) {
+    currentUpdateKernels().freeze(particles);
+}
+
+// Reads the freeze flags for every particle and contact
+void freezeCollidedParticlesGeneric(ParticleStore& particles) {
+    for (int i = 0; i < static_cast<int>(BORDER_COLLAPSED.size()); i++) {
+        if (BORDER_COLLAPSED[i]) {
+            setParticleFlag(particles, i, PARTICLE_FROZEN, FREEZE_PARTICLES_ON_BORDER_COLLAPSE);
+        }
+    }
+    for (const particle_contact& contact : PARTICLE_CONTACTS) {
+        setParticleFlag(particles, contact.a, PARTICLE_FROZEN, FREEZE_PARTICLES_ON_COLLAPSE);
+        setParticleFlag(particles, contact.b, PARTICLE_FROZEN, FREEZE_PARTICLES_ON_COLLAPSE);
+    }
+}
+
+// Border collapses are 0 or 1, so the border loop sets or clears the frozen
+// bit without a branch and vectorizes
+template <int Flags>
+void freezeCollidedParticlesFor(ParticleStore& particles) {
+    unsigned char* flags = particles.flags.data();
+    const unsigned char* border = BORDER_COLLAPSED.data();
+    const int n = static_cast<int>(BORDER_COLLAPSED.size());
+    for (int i = 0; i < n; i++) {
+        const unsigned char frozen = static_cast<unsigned char>(border[i] * PARTICLE_FROZEN);
+        if (Flags & UPDATE_FREEZE_ON_BORDER_COLLAPSE) {
+            flags[i] |= frozen;
+        }
+        else {
+            flags[i] &= static_cast<unsigned char>(~frozen);
+        }
+    }
+    for (const particle_contact& contact : PARTICLE_CONTACTS) {
+        if (Flags & UPDATE_FREEZE_ON_COLLAPSE) {
+            flags[contact.a] |= PARTICLE_FROZEN;
+            flags[contact.b] |= PARTICLE_FROZEN;
+        }
+        else {
+            flags[contact.a] &= static_cast<unsigned char>(~PARTICLE_FROZEN);
+            flags[contact.b] &= static_cast<unsigned char>(~PARTICLE_FROZEN);
+        }
+    }
+}
+
+template <int Flags>
+update_kernels makeUpdateKernels() {
+    update_kernels kernels;
+    kernels.freeze = freezeCollidedParticlesFor<Flags>;
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+        kernels.integrate[level] = integrateKernelFor(level, Flags);
+    }
+    return kernels;
+}
+
+int updateFlags() {
+    return (GRAVITY_ENABLED ? UPDATE_GRAVITY : 0)
+        | (FREEZE_PARTICLES_ON_COLLAPSE ? UPDATE_FREEZE_ON_COLLAPSE : 0)
+        | (FREEZE_PARTICLES_ON_BORDER_COLLAPSE ? UPDATE_FREEZE_ON_BORDER_COLLAPSE : 0);
+}
+
+const update_kernels& updateKernels(int flags) {
+    static const update_kernels kernels[UPDATE_FLAG_COMBINATIONS] = {
+        makeUpdateKernels<0>(), makeUpdateKernels<1>(), makeUpdateKernels<2>(), makeUpdateKernels<3>(),
+        makeUpdateKernels<4>(), makeUpdateKernels<5>(), makeUpdateKernels<6>(), makeUpdateKernels<7>()
+    };
+    return kernels[flags];
+}
+
+// Integration is the gravity one, fed a zero gravity when it is off
+update_kernels makeGenericUpdateKernels() {
+    update_kernels kernels;
+    kernels.freeze = freezeCollidedParticlesGeneric;
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+        kernels.integrate[level] = integrateKernelFor(level, UPDATE_GRAVITY);
+    }
+    return kernels;
+}
+
+const update_kernels& genericUpdateKernels() {
+    static const update_kernels kernels = makeGenericUpdateKernels();
+    return kernels;
+}
+
+// The flags only change between passes, on a key or a snapshot load, so
+// picking per pass is picking when they change
+const update_kernels& currentUpdateKernels() {
+    return SPECIALISE_UPDATE_KERNELS ? updateKernels(updateFlags()) : genericUpdateKernels();
+}
+
+// Fills BORDER_COLLAPSED, and PARTICLE_CONTACTS from emit(i, contacts), which
+// appends the contacts of particle i with earlier particles. Fixed blocks of
+// particles run in parallel, each into its own buffer, and each particle's
+// contacts are sorted by a; the buffers are then concatenated, so the buffer
+// is in (b, a) order whatever the thread count.
+template <typename Emit>
+void gatherContacts(ParticleStore& particles, Emit emit) {
+    const int n = awakeParticleCount(particles);
+    const int blocks = (n + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+    // Never shrunk, so the buffers of blocks past the live count keep their
+    // capacity for when it grows back
+    BLOCK_CONTACTS.resize(std::max(blocks, static_cast<int>(BLOCK_CONTACTS.size())));
+    BLOCK_CONTACT_START.resize(blocks);
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            const int first = b * PARALLEL_GRAIN;
+            const int last = std::min(n, first + PARALLEL_GRAIN);
+            borderKernel(SIMD_LEVEL, particles, first, last, BORDER_COLLAPSED.data());
+            std::vector<particle_contact>& buffer = BLOCK_CONTACTS[b];
+            buffer.clear();
+            for (int i = first; i < last; i++) {
+                if (particles.flags[i] & PARTICLE_REMOVED) {
+                    continue;
+                }
+                const size_t from = buffer.size();
+                emit(i, buffer);
+                std::sort(buffer.begin() + from, buffer.end(), contactBefore);
+            }
+        }
+    });
+    int total = 0;
+    for (int b = 0; b < blocks; b++) {
+        BLOCK_CONTACT_START[b] = total;
+        total += static_cast<int>(BLOCK_CONTACTS[b].size());
+    }
+    PARTICLE_CONTACTS.resize(total);
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            std::copy(BLOCK_CONTACTS[b].begin(), BLOCK_CONTACTS[b].end(), PARTICLE_CONTACTS.begin() + BLOCK_CONTACT_START[b]);
+        }
+    });
+}
+
+// Buffer order: by b, then by a
+bool contactBefore(const particle_contact& first, const particle_contact& second) {
+    return first.b != second.b ? first.b < second.b : first.a < second.a;
+}
+
+void findContactsInGrid(ParticleStore& particles) {
+    buildSpatialGrid(PARTICLES_GRID, particles);
+    gatherContacts(particles, [&](int i, std::vector<particle_contact>& contacts) {
+        particleContacts(i, particles, PARTICLES_GRID, contacts);
+    });
+}
+
+// The sweep finds the same pairs in sweep order, sorted here into buffer order
+void findContactsBySweep(ParticleStore& particles) {
+    parallelFor(awakeParticleCount(particles), PARALLEL_GRAIN, [&](int begin, int end) {
+        borderKernel(SIMD_LEVEL, particles, begin, end, BORDER_COLLAPSED.data());
+    });
+    updateSweepAndPrune(PARTICLES_SWEEP, particles);
+    sweepOverlappingPairs(PARTICLES_SWEEP, particles, PARTICLE_CONTACTS);
+    std::sort(PARTICLE_CONTACTS.begin(), PARTICLE_CONTACTS.end(), contactBefore);
+}
+
+// The tree only holds particles here, attractors take no part in collisions
+void findContactsInQuadtree(ParticleStore& particles) {
+    buildLooseQuadtree(PARTICLES_QUADTREE, particles, std::vector<attractive_particle>());
+    gatherContacts(particles, [&](int i, std::vector<particle_contact>& contacts) {
+        looseQuadtreeContacts(PARTICLES_QUADTREE, i, contacts);
+    });
+}
+
+// The grid is only built on the steps where the lists have to be rebuilt
+void findContactsInVerletList(ParticleStore& particles) {
+    PARTICLES_VERLET.steps++;
+    if (!verletListValid(PARTICLES_VERLET, particles, VERLET_SKIN)) {
+        buildSpatialGrid(PARTICLES_GRID, particles);
+        buildVerletList(PARTICLES_VERLET, particles, PARTICLES_GRID, VERLET_SKIN);
+    }
+    gatherContacts(particles, [&](int i, std::vector<particle_contact>& contacts) {
+        verletListContacts(PARTICLES_VERLET, particles, i, contacts);
+    });
+}
+
+// Appends the contacts of every awake particle with the sleepers, a awake and
+// b asleep, so a < b still holds. Blocks of awake particles query the grid in
+// parallel into their own buffers, which are concatenated in block order.
+void findContactsWithSleepers(ParticleStore& particles) {
+    const sleeper_grid& grid = currentSleeperGrid(particles);
+    const int n = awakeParticleCount(particles);
+    const int blocks = (n + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+    BLOCK_CONTACTS.resize(std::max(blocks, static_cast<int>(BLOCK_CONTACTS.size())));
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        std::vector<int> found;
+        for (int b = begin; b < end; b++) {
+            std::vector<particle_contact>& buffer = BLOCK_CONTACTS[b];
+            buffer.clear();
+            for (int i = b * PARALLEL_GRAIN; i < std::min(n, (b + 1) * PARALLEL_GRAIN); i++) {
+                if (particles.flags[i] & PARTICLE_REMOVED) {
+                    continue;
+                }
+                const sf::Vector2f position(particles.x[i], particles.y[i]);
+                const float radius = particles.radius[i];
+                found.clear();
+                sleepersNear(grid, particles, position.x, position.y, radius + MAX_RADIUS, found);
+                for (int other : found) {
+                    float distance = distanceBetweenTwoPoints(position, sf::Vector2f(particles.x[other], particles.y[other]));
+                    if (distance < radius + particles.radius[other]) {
+                        particle_contact contact;
+                        contact.a = i;
+                        contact.b = other;
+                        contact.distance = distance;
+                        buffer.push_back(contact);
+                    }
+                }
+            }
+        }
+    });
+    for (int b = 0; b < blocks; b++) {
+        PARTICLE_CONTACTS.insert(PARTICLE_CONTACTS.end(), BLOCK_CONTACTS[b].begin(), BLOCK_CONTACTS[b].end());
+    }
+}
+
+// Wakes the sleepers in the contacts from first on, lowest index first, and
+// points those contacts at where the sleepers went. Waking only swaps
+// sleepers among themselves, so the awake indices in the buffer stay valid.
+void wakeTouchedSleepers(ParticleStore& particles, int first) {
+    sleeper_grid& grid = currentSleeperGrid(particles);
+    TOUCHED_SLEEPERS.clear();
+    for (int c = first; c < static_cast<int>(PARTICLE_CONTACTS.size()); c++) {
+        TOUCHED_SLEEPERS.push_back(PARTICLE_CONTACTS[c].b);
+        PARTICLE_CONTACTS[c].b = particles.slot[PARTICLE_CONTACTS[c].b];
+    }
+    std::sort(TOUCHED_SLEEPERS.begin(), TOUCHED_SLEEPERS.end());
+    TOUCHED_SLEEPERS.erase(std::unique(TOUCHED_SLEEPERS.begin(), TOUCHED_SLEEPERS.end()), TOUCHED_SLEEPERS.end());
+    for (int& sleeper : TOUCHED_SLEEPERS) {
+        sleeper = particles.slot[sleeper];
+    }
+    for (int slot : TOUCHED_SLEEPERS) {
+        removeSleeper(grid, slot);
+        wakeParticle(particles, particles.slotIndex[slot]);
+    }
+    grid.epoch = particles.sleepEpoch;
+    SLEEP_STATS.woken += static_cast<int>(TOUCHED_SLEEPERS.size());
+    for (int c = first; c < static_cast<int>(PARTICLE_CONTACTS.size()); c++) {
+        PARTICLE_CONTACTS[c].b = particles.slotIndex[PARTICLE_CONTACTS[c].b];
+    }
+    std::sort(PARTICLE_CONTACTS.begin() + first, PARTICLE_CONTACTS.end(), contactBefore);
+}
+
+// The grid follows the store through sleepParticle and wakeParticle calls made
+// here; anything else that changed the sleepers, like a clear, shows as a
+// different epoch and costs a rebuild, as does another store
+sleeper_grid& currentSleeperGrid(const ParticleStore& particles) {
+    if (PARTICLES_SLEEPERS.store != &particles || PARTICLES_SLEEPERS.epoch != particles.sleepEpoch) {
+        buildSleeperGrid(PARTICLES_SLEEPERS, particles);
+    }
+    return PARTICLES_SLEEPERS;
+}
+
+// Wakes the sleepers an attractor may reach this step, since attraction
+// changes the velocity of frozen particles too
+void wakeAttractedSleepers(const std::vector<attractive_particle>& attractive_particles, ParticleStore& particles) {
+    sleeper_grid& grid = currentSleeperGrid(particles);
+    TOUCHED_SLEEPERS.clear();
+    std::vector<int> found;
+    for (const auto& p : attractive_particles) {
+        if (p.removed) {
+            continue;
+        }
+        found.clear();
+        sleepersNear(grid, particles, p.position.x, p.position.y, p.attractionRadius + MAX_RADIUS * 2, found);
+        for (int i : found) {
+            TOUCHED_SLEEPERS.push_back(particles.slot[i]);
+        }
+    }
+    std::sort(TOUCHED_SLEEPERS.begin(), TOUCHED_SLEEPERS.end(), [&](int first, int second) {
+        return particles.slotIndex[first] < particles.slotIndex[second];
+    });
+    TOUCHED_SLEEPERS.erase(std::unique(TOUCHED_SLEEPERS.begin(), TOUCHED_SLEEPERS.end()), TOUCHED_SLEEPERS.end());
+    for (int slot : TOUCHED_SLEEPERS) {
+        removeSleeper(grid, slot);
+        wakeParticle(particles, particles.slotIndex[slot]);
+    }
+    grid.epoch = particles.sleepEpoch;
+    SLEEP_STATS.woken += static_cast<int>(TOUCHED_SLEEPERS.size());
+}
+
+// Puts the awake particles to sleep that nothing can change any more: frozen
+// ones, except those on the border when border collapses unfreeze. Runs at
+// the end of a step, when frozen particles are where the step's collisions
+// saw them. Highest index first, so every swap brings in a particle that was
+// already looked at.
+void settleParticles(ParticleStore& particles) {
+    if (!SLEEP_FROZEN_PARTICLES) {
+        return;
+    }
+    sleeper_grid& grid = currentSleeperGrid(particles);
+    SLEPT_FREEZE_ON_COLLAPSE = FREEZE_PARTICLES_ON_COLLAPSE;
+    SLEPT_FREEZE_ON_BORDER_COLLAPSE = FREEZE_PARTICLES_ON_BORDER_COLLAPSE;
+    for (int i = awakeParticleCount(particles) - 1; i >= 0; i--) {
+        if ((particles.flags[i] & (PARTICLE_FROZEN | PARTICLE_REMOVED)) != PARTICLE_FROZEN
+            || (!FREEZE_PARTICLES_ON_BORDER_COLLAPSE && borderCollapse(particles, i) != 0)) {
+            continue;
+        }
+        sleepParticle(particles, i);
+        insertSleeper(grid, particles, awakeParticleCount(particles));
+        SLEEP_STATS.fellAsleep++;
+    }
+    grid.epoch = particles.sleepEpoch;
+}
+
+const sleep_stats& particleSleepStats() {
+    return SLEEP_STATS;
+}
+
+// Collision response for the contacts of the last collideParticles call.
+// Batches share no particle, so the result is the same for any thread count.
+void solveParticleContacts(ParticleStore& particles) {
+    colorContacts(CONTACT_BATCHES, PARTICLE_CONTACTS, particleCount(particles));
+    solveContacts(CONTACT_BATCHES, particles, SOLVER_ITERATIONS, RESTITUTION);
+}
+
+const contact_batches& particleContactBatches() {
+    return CONTACT_BATCHES;
+}
+
+// Contacts found by the last collideParticles call
+const std::vector<particle_contact>& particleContactBuffer() {
+    return PARTICLE_CONTACTS;
+}
+
+// Rebuild and list size stats of the Verlet broad phase
+const verlet_list& particlesVerletList() {
+    return PARTICLES_VERLET;
+}
+
+void updateAttractiveParticles(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles) {
+    const float time = stepTime();
+    for (auto& p : attractive_particles) {
+        if (p.removed) {
+            continue;
+        }
+        if (GRAVITY_ENABLED) {
+            p.velocity += GRAVITY_FORCE * time;
+        }
+        int borderCollapsed = borderCollapse(p);
+        if (borderCollapsed == 0) {
+            p.position += p.velocity * time;
+        }
+    }
+    // Attractor positions do not depend on particles, so they all move first.
+    // Both passes sum each particle's velocity in attractor order, so they
+    // give the same result and the cheaper one can be picked freely.
+    int attractors = 0;
+    for (auto& p : attractive_particles) {
+        if (!p.removed) {
+            attractors++;
+        }
+    }
+    if (attractors > 0 && particles.sleeping > 0) {
+        wakeAttractedSleepers(attractive_particles, particles);
+    }
+    if (attractors > 0 && CACHE_ATTRACTOR_FIELD) {
+        attractParticlesWithField(attractive_particles, particles);
+    }
+    else if (attractors > 0 && BROAD_PHASE == BROAD_PHASE_QUADTREE) {
+        attractParticlesWithQuadtree(attractive_particles, particles);
+    }
+    else if (attractors >= GRID_ATTRACTION_MIN_ATTRACTORS) {
+        attractParticlesWithGrid(attractive_particles, particles);
+    }
+    else if (attractors > 0) {
+        attractParticles(attractive_particles, particles);
+    }
+}
+
+// Every attractor against every particle. Each chunk applies the attractors
+// in order, like the serial loop did.
+void attractParticles(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles) {
+    parallelFor(awakeParticleCount(particles), PARALLEL_GRAIN, [&](int begin, int end) {
+        for (auto& p : attractive_particles) {
+            computeAttraction(p, particles, begin, end);
+        }
+    });
+}
+
+// Each attractor only visits the grid cells its radius reaches. The grid is
+// rebuilt because particles moved since collideParticles built it. Chunks own
+// whole cells, so every particle is written by one chunk only.
+void attractParticlesWithGrid(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles) {
+    buildSpatialGrid(PARTICLES_GRID, particles);
+    rasterizeAttractors(attractive_particles, PARTICLES_GRID);
+    const spatial_grid& grid = PARTICLES_GRID;
+    const float time = stepTime();
+    parallelFor(grid.columns * grid.rows, PARALLEL_GRAIN / 4, [&](int begin, int end) {
+        for (int cell = begin; cell < end; cell++) {
+            for (int a = ATTRACTOR_CELL_START[cell]; a < ATTRACTOR_CELL_START[cell + 1]; a++) {
+                const attractive_particle& p = attractive_particles[ATTRACTOR_CELLS[a]];
+                for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+                    applyAttraction(p, particles, grid.cellParticles[k], time);
+                }
+            }
+        }
+    });
+}
+
+// Particles and attractors share one tree. Each attractor runs a radius
+// query in parallel, then the hits are turned around so every particle
+// applies its attractors in order, in parallel and without write conflicts.
+void attractParticlesWithQuadtree(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles) {
+    buildLooseQuadtree(PARTICLES_QUADTREE, particles, attractive_particles);
+    const int n = awakeParticleCount(particles);
+    const int attractors = static_cast<int>(attractive_particles.size());
+    ATTRACTOR_HITS.resize(attractors);
+    parallelFor(attractors, 16, [&](int begin, int end) {
+        std::vector<int> found;
+        for (int a = begin; a < end; a++) {
+            const attractive_particle& p = attractive_particles[a];
+            ATTRACTOR_HITS[a].clear();
+            if (p.removed) {
+                continue;
+            }
+            found.clear();
+            queryLooseQuadtree(PARTICLES_QUADTREE, p.position.x, p.position.y, p.attractionRadius, found);
+            for (int o : found) {
+                if (o < n) {
+                    ATTRACTOR_HITS[a].push_back(o);
+                }
+            }
+        }
+    });
+
+    PARTICLE_ATTRACTOR_START.assign(n + 1, 0);
+    for (int a = 0; a < attractors; a++) {
+        for (int i : ATTRACTOR_HITS[a]) {
+            PARTICLE_ATTRACTOR_START[i + 1]++;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        PARTICLE_ATTRACTOR_START[i + 1] += PARTICLE_ATTRACTOR_START[i];
+    }
+    PARTICLE_ATTRACTOR_FILL.assign(PARTICLE_ATTRACTOR_START.begin(), PARTICLE_ATTRACTOR_START.end() - 1);
+    PARTICLE_ATTRACTORS.resize(PARTICLE_ATTRACTOR_START[n]);
+    for (int a = 0; a < attractors; a++) {
+        for (int i : ATTRACTOR_HITS[a]) {
+            PARTICLE_ATTRACTORS[PARTICLE_ATTRACTOR_FILL[i]++] = a;
+        }
+    }
+
+    const float time = stepTime();
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            for (int k = PARTICLE_ATTRACTOR_START[i]; k < PARTICLE_ATTRACTOR_START[i + 1]; k++) {
+                applyAttraction(attractive_particles[PARTICLE_ATTRACTORS[k]], particles, i, time);
+            }
+        }
+    });
+}
+
+// One bilinear sample per particle, whatever the number of attractors. Not
+// the same sums as the exact passes: see attractorFieldErrorBound.
+void attractParticlesWithField(const std::vector<attractive_particle>& attractive_particles, ParticleStore& particles) {
+    attractor_field& field = PARTICLES_ATTRACTOR_FIELD;
+    if (attractorFieldStale(field, attractive_particles)) {
+        buildAttractorField(field, attractive_particles, static_cast<float>(WINDOW_WIDTH), static_cast<float>(WINDOW_HEIGHT), ATTRACTOR_FIELD_CELL_SIZE);
+    }
+    const float time = stepTime();
+    parallelFor(awakeParticleCount(particles), PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float ax;
+            float ay;
+            sampleAttractorField(field, particles.x[i], particles.y[i], ax, ay);
+            const float pull = (particles.flags[i] & PARTICLE_REMOVED) ? 0.f : time;
+            particles.vx[i] += ax * pull;
+            particles.vy[i] += ay * pull;
+        }
+    });
+}
+
+const attractor_field& particlesAttractorField() {
+    return PARTICLES_ATTRACTOR_FIELD;
+}
+
+void attractParticlesByGravity(ParticleStore& particles) {
+    switch (NBODY_GRAVITY) {
+    case NBODY_GRAVITY_BARNES_HUT:
+        attractParticlesByTree(particles);
+        break;
+    case NBODY_GRAVITY_MESH:
+        attractParticlesByMesh(particles);
+        break;
+    }
+}
+
+// Sleepers and frozen particles pull but are not pulled, they cannot move.
+// Each leaf writes only its own bodies, so leaves run in parallel freely.
+void attractParticlesByTree(ParticleStore& particles) {
+    barnes_hut_tree& tree = PARTICLES_GRAVITY_TREE;
+    buildBarnesHutTree(tree, particles);
+    if (barnesHutBodyCount(tree) < 2) {
+        return;
+    }
+    const float strength = NBODY_PULL * NBODY_PULL_DISTANCE * NBODY_PULL_DISTANCE / tree.nodes[0].mass * stepTime();
+    const int awake = awakeParticleCount(particles);
+    GRAVITY_AX.resize(barnesHutBodyCount(tree));
+    GRAVITY_AY.resize(barnesHutBodyCount(tree));
+    parallelFor(static_cast<int>(tree.leaves.size()), PARALLEL_GRAIN / BARNES_HUT_LEAF_BODIES, [&](int begin, int end) {
+        for (int l = begin; l < end; l++) {
+            const barnes_hut_node& leaf = tree.nodes[tree.leaves[l]];
+            barnesHutLeafAccelerations(tree, tree.leaves[l], BARNES_HUT_THETA, NBODY_SOFTENING, GRAVITY_AX.data(), GRAVITY_AY.data());
+            for (int k = leaf.begin; k < leaf.end; k++) {
+                const int i = tree.order[k];
+                if (i < awake && !(particles.flags[i] & PARTICLE_FROZEN)) {
+                    particles.vx[i] += GRAVITY_AX[k] * strength;
+                    particles.vy[i] += GRAVITY_AY[k] * strength;
+                }
+            }
+        }
+    });
+}
+
+// The mesh is rebuilt when the window or the softening it was made for
+// changes; its kernel transform is the only costly part to set up
+void attractParticlesByMesh(ParticleStore& particles) {
+    particle_mesh& mesh = PARTICLES_GRAVITY_MESH;
+    const float extent = static_cast<float>(std::max(WINDOW_WIDTH, WINDOW_HEIGHT));
+    if (mesh.size != PARTICLE_MESH_SIZE || mesh.cellSize != extent / PARTICLE_MESH_SIZE || mesh.softening != NBODY_SOFTENING) {
+        initParticleMesh(mesh, PARTICLE_MESH_SIZE, extent, NBODY_SOFTENING);
+    }
+    depositParticleMesh(mesh, particles);
+    if (mesh.totalMass <= 0) {
+        return;
+    }
+    solveParticleMesh(mesh);
+    const float strength = NBODY_PULL * NBODY_PULL_DISTANCE * NBODY_PULL_DISTANCE / mesh.totalMass * stepTime();
+    parallelFor(awakeParticleCount(particles), PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float ax;
+            float ay;
+            particleMeshAcceleration(mesh, particles.x[i], particles.y[i], ax, ay);
+            const float pull = (particles.flags[i] & (PARTICLE_FROZEN | PARTICLE_REMOVED)) ? 0.f : strength;
+            particles.vx[i] += ax * pull;
+            particles.vy[i] += ay * pull;
+        }
+    });
+}
+
+// A particle is attracted when its distance to the attractor is at most
+// attractionRadius + its radius, which is at most MAX_RADIUS; the box gets
+// another MAX_RADIUS of room for rounding. Attractors whose box misses the grid are left out.
+void rasterizeAttractors(const std::vector<attractive_particle>& attractive_particles, const spatial_grid& grid) {
+    const int cells = grid.columns * grid.rows;
+    const float gridRight = grid.originX + grid.columns * grid.cellSize;
+    const float gridBottom = grid.originY + grid.rows * grid.cellSize;
+    ATTRACTOR_CELL_START.assign(cells + 1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int a = 0; a < static_cast<int>(attractive_particles.size()); a++) {
+            const attractive_particle& p = attractive_particles[a];
+            const float reach = p.attractionRadius + MAX_RADIUS * 2;
+            if (p.removed || p.position.x + reach < grid.originX || p.position.x - reach > gridRight
+                || p.position.y + reach < grid.originY || p.position.y - reach > gridBottom) {
+                continue;
+            }
+            const int firstColumn = spatialGridColumn(grid, p.position.x - reach);
+            const int lastColumn = spatialGridColumn(grid, p.position.x + reach);
+            const int firstRow = spatialGridRow(grid, p.position.y - reach);
+            const int lastRow = spatialGridRow(grid, p.position.y + reach);
+            for (int y = firstRow; y <= lastRow; y++) {
+                for (int x = firstColumn; x <= lastColumn; x++) {
+                    const int cell = y * grid.columns + x;
+                    if (pass == 0) {
+                        ATTRACTOR_CELL_START[cell + 1]++;
+                    }
+                    else {
+                        ATTRACTOR_CELLS[ATTRACTOR_CELL_FILL[cell]++] = a;
+                    }
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int c = 0; c < cells; c++) {
+                ATTRACTOR_CELL_START[c + 1] += ATTRACTOR_CELL_START[c];
+            }
+            ATTRACTOR_CELL_FILL.assign(ATTRACTOR_CELL_START.begin(), ATTRACTOR_CELL_START.end() - 1);
+            ATTRACTOR_CELLS.resize(ATTRACTOR_CELL_START[cells]);
+        }
+    }
+}
+
+// Also flags the particles that left the screen. Attraction only changes
+// velocities and removed particles never move, so flagging here sees the same
+// positions the separate off-screen pass after attraction used to.
+void integrateParticles(ParticleStore& particles) {
+    const float time = stepTime();
+    const float gravityX = GRAVITY_ENABLED ? GRAVITY_FORCE.x * time : 0.f;
+    const float gravityY = GRAVITY_ENABLED ? GRAVITY_FORCE.y * time : 0.f;
+    const integrate_kernel integrate = currentUpdateKernels().integrate[SIMD_LEVEL];
+    parallelFor(awakeParticleCount(particles), PARALLEL_GRAIN, [&](int begin, int end) {
+        integrate(particles, begin, end, gravityX, gravityY, time);
+    });
+}
+
+// Appends a contact with every earlier particle overlapping particle index.
+// Cell entries are sorted by index, so each cell scan stops at index.
+void particleContacts(int index, const ParticleStore& particles, const spatial_grid& grid, std::vector<particle_contact>& contacts) {
+    const sf::Vector2f position(particles.x[index], particles.y[index]);
+    const float radius = particles.radius[index];
+    const int column = spatialGridColumn(grid, position.x);
+    const int row = spatialGridRow(grid, position.y);
+    for (int y = std::max(row - 1, 0); y <= std::min(row + 1, grid.rows - 1); y++) {
+        for (int x = std::max(column - 1, 0); x <= std::min(column + 1, grid.columns - 1); x++) {
+            const int cell = y * grid.columns + x;
+            for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+                const int other = grid.cellParticles[k];
+                if (other >= index) {
+                    break;
+                }
+                float distance = distanceBetweenTwoPoints(position, sf::Vector2f(particles.x[other], particles.y[other]));
+                if (distance < radius + particles.radius[other]) {
+                    particle_contact contact;
+                    contact.a = other;
+                    contact.b = index;
+                    contact.distance = distance;
+                    contacts.push_back(contact);
+                }
+            }
+        }
+    }
+}
+
+void spawnAttractiveParticlesOnMousePosition(sf::Vector2i mousePosition, std::vector<attractive_particle>& attractive_particles) {
+    attractive_particle p;
+    p.id = LAST_ATTRACTIVE_PARTICLE_ID--;
+    p.removed = false;
+    p.radius = randomFloat(0.5 + MAX_RADIUS / 2, MAX_RADIUS);
+    p.attractionRadius = pow(p.radius, 3);
+    p.attraction = sf::Vector2f(10.f, 10.f);
+    p.position = sf::Vector2f(static_cast<float>(mousePosition.x), static_cast<float>(mousePosition.y));
+    p.previousPosition = p.position;
+    p.velocity = sf::Vector2f(0.f, 0.f);
+    attractive_particles.push_back(p);
+}
+
+void computeAttraction(attractive_particle& p, ParticleStore& particles, int begin, int end) {
+    if (p.removed) {
+        return;
+    }
+    const float time = stepTime();
+    for (int i = begin; i < end; i++) {
+        applyAttraction(p, particles, i, time);
+    }
+}
+
+void applyAttraction(const attractive_particle& p, ParticleStore& particles, int i, float time) {
+    const sf::Vector2f position(particles.x[i], particles.y[i]);
+    if ((particles.flags[i] & PARTICLE_REMOVED) || !inAttractionRadiusParticleCollapsePositionRange(p.position, position, p.attractionRadius)) {
+        return;
+    }
+    sf::Vector2f distance = p.position - position;
+    float absoluteDistance = hypot(distance.x, distance.y);
+    if (absoluteDistance > p.attractionRadius + particles.radius[i]) {
+        return;
+    }
+    sf::Vector2f distanceNorm = normalize(distance);
+    sf::Vector2f attraction(distanceNorm.x, distanceNorm.y);
+    attraction.x *= p.attraction.x;
+    attraction.y *= p.attraction.y;
+    particles.vx[i] += attraction.x * time;
+    particles.vy[i] += attraction.y * time;
+}
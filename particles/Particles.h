@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include "AttractorField.h"
+#include "BarnesHut.h"
+#include "ContactSolver.h"
+#include "Emitter.h"
+#include "LooseQuadtree.h"
+#include "MortonOrder.h"
+#include "Particle.h"
+#include "ParticleMesh.h"
+#include "ParticleStore.h"
+#include "Simd.h"
+#include "SleeperGrid.h"
+#include "SpatialGrid.h"
+#include "SweepAndPrune.h"
+#include "VerletList.h"
+
+// The per particle passes of a step, compiled for one combination of the
+// UPDATE_ feature flags or, for the generic set, reading them as they go
+typedef struct {
+    // Freezes or unfreezes the particles the last collideParticles call
+    // found touching or on the border
+    void (*freeze)(ParticleStore& particles);
+    integrate_kernel integrate[SIMD_AVX512 + 1];
+} update_kernels;
+
+// Functions
+void initParticles(int n, ParticleStore& particles);
+void collideParticles(ParticleStore& particles);
+void findContactsInGrid(ParticleStore& particles);
+void findContactsBySweep(ParticleStore& particles);
+void findContactsInQuadtree(ParticleStore& particles);
+void findContactsInVerletList(ParticleStore& particles);
+void findContactsWithSleepers(ParticleStore& particles);
+void wakeTouchedSleepers(ParticleStore& particles, int first);
+sleeper_grid& currentSleeperGrid(const ParticleStore& particles);
+void wakeAttractedSleepers(const std::vector<attractive_particle>& attractive_particles, ParticleStore& particles);
+void settleParticles(ParticleStore& particles);
+const sleep_stats& particleSleepStats();
+bool contactBefore(const particle_contact& first, const particle_contact& second);
+const std::vector<particle_contact>& particleContactBuffer();
+void solveParticleContacts(ParticleStore& particles);
+const contact_batches& particleContactBatches();
+const verlet_list& particlesVerletList();
+const char* broadPhaseName(int broadPhase);
+const char* nbodyGravityName(int nbodyGravity);
+void integrateParticles(ParticleStore& particles);
+void freezeCollidedParticles(ParticleStore& particles);
+void freezeCollidedParticlesGeneric(ParticleStore& particles);
+int updateFlags();
+const update_kernels& updateKernels(int flags);
+update_kernels makeGenericUpdateKernels();
+const update_kernels& genericUpdateKernels();
+const update_kernels& currentUpdateKernels();
+void updateAttractiveParticles(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles);
+void particleContacts(int index, const ParticleStore& particles, const spatial_grid& grid, std::vector<particle_contact>& contacts);
+void clearParticles(ParticleStore& particles, std::vector<attractive_particle>& attractive_particles);
+void resetParticleSchedules();
+void reloadParticles(ParticleStore& particles, std::vector<attractive_particle>& attractive_particles);
+void spawnMoreParticlesOnMousePositionRange(sf::Vector2i mousePosition, ParticleStore& particles);
+void spawnRandomParticles(ParticleStore& particles, int n, float minX, float maxX, float minY, float maxY);
+emitter_system& particleEmitters();
+bool updateParticleEmitters(ParticleStore& particles);
+void placeEmitterOnMousePosition(sf::Vector2i mousePosition);
+void removeEmitterOnMousePosition(sf::Vector2i mousePosition);
+void clearRemovedParticlesAndReallocate(ParticleStore& particles);
+bool keepParticlesInMortonOrder(ParticleStore& particles);
+void spawnAttractiveParticlesOnMousePosition(sf::Vector2i mousePosition, std::vector<attractive_particle>& attractive_particles);
+void attractParticles(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles);
+void attractParticlesWithGrid(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles);
+void attractParticlesWithQuadtree(std::vector<attractive_particle>& attractive_particles, ParticleStore& particles);
+void attractParticlesWithField(const std::vector<attractive_particle>& attractive_particles, ParticleStore& particles);
+const attractor_field& particlesAttractorField();
+void attractParticlesByGravity(ParticleStore& particles);
+void attractParticlesByTree(ParticleStore& particles);
+void attractParticlesByMesh(ParticleStore& particles);
+void rasterizeAttractors(const std::vector<attractive_particle>& attractive_particles, const spatial_grid& grid);
+void computeAttraction(attractive_particle& p, ParticleStore& particles, int begin, int end);
+void applyAttraction(const attractive_particle& p, ParticleStore& particles, int i, float time);
+float stepTime();
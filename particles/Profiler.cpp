@@ -0,0 +1,234 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdio>
+
+const char* const PROFILE_STAGE_NAMES[PROFILE_STAGES] = {
+    "events", "step", "spawn", "collide", "solve", "integrate", "attraction",
+    "compaction", "reorder", "sleep", "render", "display", "frame"
+};
+bool PROFILE_FRAMES = false;
+frame_profiler PROFILER;
+
+// Functions
+int profileBucket(unsigned long long nanoseconds);
+unsigned long long profileBucketLower(int bucket);
+unsigned long long profileBucketUpper(int bucket);
+void clearProfileHistogram(profile_histogram& histogram);
+void addProfileSample(profile_histogram& histogram, int bucket, unsigned long long nanoseconds);
+void foldProfileHistogram(profile_histogram& into, const profile_histogram& from);
+double profilePercentile(const unsigned long long* counts, unsigned long long samples, unsigned long long maxNanoseconds, double fraction);
+profile_summary summarizeProfile(const profile_histogram* const* histograms, int count);
+double profileSeconds();
+
+int profileBucket(unsigned long long nanoseconds) {
+    if (nanoseconds < PROFILE_SUB_BUCKETS) {
+        return static_cast<int>(nanoseconds);
+    }
+    // Highest set bit, then the three bits below it pick the sub bucket
+    int top = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (nanoseconds >> (top + shift)) {
+            top += shift;
+        }
+    }
+    const int bucket = PROFILE_SUB_BUCKETS + (top - 3) * PROFILE_SUB_BUCKETS + static_cast<int>((nanoseconds >> (top - 3)) & 7);
+    return std::min(bucket, PROFILE_BUCKETS - 1);
+}
+
+unsigned long long profileBucketLower(int bucket) {
+    if (bucket < PROFILE_SUB_BUCKETS) {
+        return bucket;
+    }
+    const int octave = (bucket - PROFILE_SUB_BUCKETS) / PROFILE_SUB_BUCKETS;
+    const int sub = (bucket - PROFILE_SUB_BUCKETS) % PROFILE_SUB_BUCKETS;
+    return static_cast<unsigned long long>(PROFILE_SUB_BUCKETS + sub) << octave;
+}
+
+unsigned long long profileBucketUpper(int bucket) {
+    if (bucket < PROFILE_SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    return profileBucketLower(bucket) + (1ull << ((bucket - PROFILE_SUB_BUCKETS) / PROFILE_SUB_BUCKETS));
+}
+
+void clearProfileHistogram(profile_histogram& histogram) {
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+        histogram.counts[b].store(0, std::memory_order_relaxed);
+    }
+    histogram.totalNanoseconds.store(0, std::memory_order_relaxed);
+    histogram.maxNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+void addProfileSample(profile_histogram& histogram, int bucket, unsigned long long nanoseconds) {
+    histogram.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    unsigned long long max = histogram.maxNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds > max && !histogram.maxNanoseconds.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+// Only called on windows that are not current, nobody records into them
+void foldProfileHistogram(profile_histogram& into, const profile_histogram& from) {
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+        into.counts[b].fetch_add(from.counts[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    into.totalNanoseconds.fetch_add(from.totalNanoseconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    const unsigned long long max = from.maxNanoseconds.load(std::memory_order_relaxed);
+    if (max > into.maxNanoseconds.load(std::memory_order_relaxed)) {
+        into.maxNanoseconds.store(max, std::memory_order_relaxed);
+    }
+}
+
+// Middle of the bucket the rank falls in, never past the largest sample
+double profilePercentile(const unsigned long long* counts, unsigned long long samples, unsigned long long maxNanoseconds, double fraction) {
+    if (samples == 0) {
+        return 0;
+    }
+    const unsigned long long rank = std::max(1ull, static_cast<unsigned long long>(fraction * samples + 0.5));
+    unsigned long long seen = 0;
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= rank) {
+            const double middle = 0.5 * (profileBucketLower(b) + profileBucketUpper(b));
+            return std::min(middle, static_cast<double>(maxNanoseconds)) * 1e-6;
+        }
+    }
+    return maxNanoseconds * 1e-6;
+}
+
+// Merges the histograms, which may still be recorded into; the figures are
+// then a moment's worth off, not torn
+profile_summary summarizeProfile(const profile_histogram* const* histograms, int count) {
+    unsigned long long counts[PROFILE_BUCKETS] = {0};
+    unsigned long long samples = 0;
+    unsigned long long total = 0;
+    unsigned long long max = 0;
+    for (int h = 0; h < count; h++) {
+        for (int b = 0; b < PROFILE_BUCKETS; b++) {
+            const unsigned long long n = histograms[h]->counts[b].load(std::memory_order_relaxed);
+            counts[b] += n;
+            samples += n;
+        }
+        total += histograms[h]->totalNanoseconds.load(std::memory_order_relaxed);
+        max = std::max(max, histograms[h]->maxNanoseconds.load(std::memory_order_relaxed));
+    }
+    profile_summary summary;
+    summary.samples = samples;
+    summary.meanMs = samples > 0 ? total * 1e-6 / samples : 0;
+    summary.p50Ms = profilePercentile(counts, samples, max, 0.5);
+    summary.p99Ms = profilePercentile(counts, samples, max, 0.99);
+    summary.maxMs = max * 1e-6;
+    return summary;
+}
+
+double profileSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void resetFrameProfiler(frame_profiler& profiler) {
+    for (int s = 0; s < PROFILE_STAGES; s++) {
+        clearProfileHistogram(profiler.windows[0][s]);
+        clearProfileHistogram(profiler.windows[1][s]);
+        clearProfileHistogram(profiler.run[s]);
+    }
+    profiler.current.store(0);
+    profiler.windowStart = profileSeconds();
+}
+
+void recordProfileSample(frame_profiler& profiler, int stage, unsigned long long nanoseconds) {
+    addProfileSample(profiler.windows[profiler.current.load(std::memory_order_relaxed)][stage], profileBucket(nanoseconds), nanoseconds);
+}
+
+void recordProfileMilliseconds(frame_profiler& profiler, int stage, double milliseconds) {
+    recordProfileSample(profiler, stage, static_cast<unsigned long long>(std::max(0.0, milliseconds) * 1e6));
+}
+
+// Stages a step skipped are left out rather than counted as zero, so the
+// once a second compaction gets percentiles of its own runs
+void recordStepTimings(frame_profiler& profiler, const frame_timings& timings) {
+    if (!PROFILE_FRAMES) {
+        return;
+    }
+    const double stages[] = {timings.spawn, timings.collide, timings.solve, timings.integrate, timings.attraction, timings.compaction, timings.reorder, timings.sleep};
+    for (int s = 0; s < 8; s++) {
+        if (stages[s] > 0) {
+            recordProfileMilliseconds(profiler, PROFILE_SPAWN + s, stages[s]);
+        }
+    }
+}
+
+// Once a window has passed, the older window is folded into the run, cleared
+// and made current. Returns true when it did, which is when the figures
+// change. Only one thread may rotate.
+bool rotateFrameProfiler(frame_profiler& profiler) {
+    const double now = profileSeconds();
+    if (now - profiler.windowStart < PROFILE_WINDOW_SECONDS) {
+        return false;
+    }
+    const int older = 1 - profiler.current.load();
+    for (int s = 0; s < PROFILE_STAGES; s++) {
+        foldProfileHistogram(profiler.run[s], profiler.windows[older][s]);
+        clearProfileHistogram(profiler.windows[older][s]);
+    }
+    profiler.current.store(older);
+    profiler.windowStart = now;
+    return true;
+}
+
+profile_summary rollingProfileSummary(const frame_profiler& profiler, int stage) {
+    const profile_histogram* histograms[] = {&profiler.windows[0][stage], &profiler.windows[1][stage]};
+    return summarizeProfile(histograms, 2);
+}
+
+profile_summary runProfileSummary(const frame_profiler& profiler, int stage) {
+    const profile_histogram* histograms[] = {&profiler.run[stage], &profiler.windows[0][stage], &profiler.windows[1][stage]};
+    return summarizeProfile(histograms, 3);
+}
+
+// One line per stage that has samples in the rolling windows. Returns the
+// length written, like snprintf.
+int formatProfileReport(const frame_profiler& profiler, char* text, int size) {
+    int length = snprintf(text, size, "%-11s %6s %8s %8s %8s\n", "ms", "n", "p50", "p99", "max");
+    for (int s = 0; s < PROFILE_STAGES && length < size; s++) {
+        const profile_summary summary = rollingProfileSummary(profiler, s);
+        if (summary.samples == 0) {
+            continue;
+        }
+        length += snprintf(text + length, size - length, "%-11s %6llu %8.3f %8.3f %8.3f\n",
+            PROFILE_STAGE_NAMES[s], summary.samples, summary.p50Ms, summary.p99Ms, summary.maxMs);
+    }
+    return std::min(length, size - 1);
+}
+
+// Whole run figures, not the rolling ones
+bool writeProfileCsv(const frame_profiler& profiler, const char* path, const char* histogramPath) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot write profile '%s'\n", path);
+        return false;
+    }
+    fprintf(file, "stage,samples,meanMs,p50Ms,p99Ms,maxMs\n");
+    for (int s = 0; s < PROFILE_STAGES; s++) {
+        const profile_summary summary = runProfileSummary(profiler, s);
+        fprintf(file, "%s,%llu,%.6f,%.6f,%.6f,%.6f\n", PROFILE_STAGE_NAMES[s], summary.samples, summary.meanMs, summary.p50Ms, summary.p99Ms, summary.maxMs);
+    }
+    fclose(file);
+
+    file = fopen(histogramPath, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot write profile '%s'\n", histogramPath);
+        return false;
+    }
+    fprintf(file, "stage,lowerMs,upperMs,count\n");
+    for (int s = 0; s < PROFILE_STAGES; s++) {
+        for (int b = 0; b < PROFILE_BUCKETS; b++) {
+            const unsigned int count = profiler.run[s].counts[b].load(std::memory_order_relaxed)
+                + profiler.windows[0][s].counts[b].load(std::memory_order_relaxed) + profiler.windows[1][s].counts[b].load(std::memory_order_relaxed);
+            if (count > 0) {
+                fprintf(file, "%s,%.6f,%.6f,%u\n", PROFILE_STAGE_NAMES[s], profileBucketLower(b) * 1e-6, profileBucketUpper(b) * 1e-6, count);
+            }
+        }
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include "Simulation.h"
+
+// Stages of a window frame. The step stages come from simulateStep's
+// frame_timings, the others are timed around the main loop.
+const int PROFILE_EVENTS = 0;
+const int PROFILE_STEP = 1;
+const int PROFILE_SPAWN = 2;
+const int PROFILE_COLLIDE = 3;
+const int PROFILE_SOLVE = 4;
+const int PROFILE_INTEGRATE = 5;
+const int PROFILE_ATTRACTION = 6;
+const int PROFILE_COMPACTION = 7;
+const int PROFILE_REORDER = 8;
+const int PROFILE_SLEEP = 9;
+const int PROFILE_RENDER = 10;
+const int PROFILE_DISPLAY = 11;
+const int PROFILE_FRAME = 12;
+const int PROFILE_STAGES = 13;
+
+// Log scale buckets over nanoseconds: exact below 8 ns, then 8 per doubling,
+// so a percentile is off by at most an eighth. Anything past half an hour
+// lands in the last one.
+const int PROFILE_SUB_BUCKETS = 8;
+const int PROFILE_BUCKETS = 8 + 38 * PROFILE_SUB_BUCKETS;
+// Rolling figures cover the last one to two windows
+const double PROFILE_WINDOW_SECONDS = 1.0;
+// Written on exit: one summary row per stage, and the run histograms
+const char* const PROFILE_CSV_PATH = "profile.csv";
+const char* const PROFILE_HISTOGRAM_CSV_PATH = "profile_histogram.csv";
+
+// Counts only ever grow between clears, so any thread can record into a
+// histogram without a lock, pool workers included. The sample count is the
+// sum of the buckets.
+typedef struct {
+    std::atomic<unsigned int> counts[PROFILE_BUCKETS];
+    std::atomic<unsigned long long> totalNanoseconds;
+    std::atomic<unsigned long long> maxNanoseconds;
+} profile_histogram;
+
+// Per stage, two rolling windows, recorded into whichever is current. A
+// window is folded into the run totals before it is cleared for reuse, so
+// the whole run is those plus both windows.
+typedef struct {
+    profile_histogram windows[2][PROFILE_STAGES];
+    profile_histogram run[PROFILE_STAGES];
+    std::atomic<int> current;
+    double windowStart;
+} frame_profiler;
+
+typedef struct {
+    unsigned long long samples;
+    double meanMs;
+    double p50Ms;
+    double p99Ms;
+    double maxMs;
+} profile_summary;
+
+extern const char* const PROFILE_STAGE_NAMES[PROFILE_STAGES];
+// Off by default, scopes then cost one branch and never read the clock
+extern bool PROFILE_FRAMES;
+extern frame_profiler PROFILER;
+
+// Times its own lifetime into a stage of PROFILER, or up to stop()
+struct profile_scope {
+    int stage;
+    bool timing;
+    std::chrono::steady_clock::time_point start;
+
+    explicit profile_scope(int profiledStage);
+    ~profile_scope();
+    void stop();
+};
+
+// Functions
+void resetFrameProfiler(frame_profiler& profiler);
+void recordProfileSample(frame_profiler& profiler, int stage, unsigned long long nanoseconds);
+void recordProfileMilliseconds(frame_profiler& profiler, int stage, double milliseconds);
+void recordStepTimings(frame_profiler& profiler, const frame_timings& timings);
+bool rotateFrameProfiler(frame_profiler& profiler);
+profile_summary rollingProfileSummary(const frame_profiler& profiler, int stage);
+profile_summary runProfileSummary(const frame_profiler& profiler, int stage);
+int formatProfileReport(const frame_profiler& profiler, char* text, int size);
+bool writeProfileCsv(const frame_profiler& profiler, const char* path, const char* histogramPath);
+
+inline profile_scope::profile_scope(int profiledStage) : stage(profiledStage), timing(PROFILE_FRAMES) {
+    if (timing) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+inline profile_scope::~profile_scope() {
+    stop();
+}
+
+inline void profile_scope::stop() {
+    if (timing) {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        recordProfileSample(PROFILER, stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        timing = false;
+    }
+}
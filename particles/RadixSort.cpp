@@ -0,0 +1,71 @@
+#include "RadixSort.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+// 8 bit digits, so 4 passes over 32 bit keys
+const int RADIX_BITS = 8;
+const int RADIX_BUCKETS = 1 << RADIX_BITS;
+// Most blocks a sort is cut into, each at least PARALLEL_GRAIN keys
+const int RADIX_SORT_BLOCKS = 64;
+
+// Stable LSD radix sort of keys, carrying values along. Each pass cuts the
+// input into fixed blocks: every block counts its digits in parallel, the
+// counts give each (digit, block) pair its place, and every block scatters
+// its own elements in parallel. The blocks depend on n alone, not on the
+// thread count, like every other parallel pass.
+void parallelRadixSort(std::vector<unsigned int>& keys, std::vector<int>& values, radix_sort_scratch& scratch) {
+    const int n = static_cast<int>(keys.size());
+    const int blocks = std::max(1, std::min(RADIX_SORT_BLOCKS, n / PARALLEL_GRAIN));
+    const int blockSize = (n + blocks - 1) / std::max(blocks, 1);
+    std::vector<unsigned int>& keyScratch = scratch.keys;
+    std::vector<int>& valueScratch = scratch.values;
+    std::vector<int>& offsets = scratch.offsets;
+    keyScratch.resize(n);
+    valueScratch.resize(n);
+    offsets.resize(blocks * RADIX_BUCKETS);
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallelFor(blocks, 1, [&](int begin, int end) {
+            for (int b = begin; b < end; b++) {
+                int* counts = &offsets[b * RADIX_BUCKETS];
+                const int last = std::min(n, (b + 1) * blockSize);
+                for (int i = b * blockSize; i < last; i++) {
+                    counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+            }
+        });
+        // A digit every key shares leaves the order as it is
+        bool skip = false;
+        for (int digit = 0; digit < RADIX_BUCKETS && !skip; digit++) {
+            int total = 0;
+            for (int b = 0; b < blocks; b++) {
+                total += offsets[b * RADIX_BUCKETS + digit];
+            }
+            skip = total == n;
+        }
+        if (skip) {
+            continue;
+        }
+        int position = 0;
+        for (int digit = 0; digit < RADIX_BUCKETS; digit++) {
+            for (int b = 0; b < blocks; b++) {
+                const int count = offsets[b * RADIX_BUCKETS + digit];
+                offsets[b * RADIX_BUCKETS + digit] = position;
+                position += count;
+            }
+        }
+        parallelFor(blocks, 1, [&](int begin, int end) {
+            for (int b = begin; b < end; b++) {
+                int* next = &offsets[b * RADIX_BUCKETS];
+                const int last = std::min(n, (b + 1) * blockSize);
+                for (int i = b * blockSize; i < last; i++) {
+                    const int to = next[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                    keyScratch[to] = keys[i];
+                    valueScratch[to] = values[i];
+                }
+            }
+        });
+        keys.swap(keyScratch);
+        values.swap(valueScratch);
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <vector>
+
+// Kept by the caller across sorts, so sorting every step does not allocate
+// once the buffers have grown to the input
+typedef struct {
+    std::vector<unsigned int> keys;
+    std::vector<int> values;
+    std::vector<int> offsets;
+} radix_sort_scratch;
+
+// Functions
+void parallelRadixSort(std::vector<unsigned int>& keys, std::vector<int>& values, radix_sort_scratch& scratch);
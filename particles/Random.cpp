@@ -0,0 +1,126 @@
+#include "Random.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+
+// Values per batch block, each block has its own stream
+const int RANDOM_BLOCK = PARALLEL_GRAIN;
+const float RANDOM_FLOAT_UNIT = 1.f / 16777216.f;
+
+// The seed of the run, and how many times it was set, so thread streams can
+// tell they were seeded from an older one
+unsigned long long RANDOM_SEED = 0;
+std::atomic<unsigned int> RANDOM_GENERATION(1);
+std::atomic<unsigned long long> RANDOM_THREADS(1);
+thread_local random_stream THREAD_RANDOM;
+thread_local unsigned int THREAD_RANDOM_GENERATION = 0;
+thread_local unsigned long long THREAD_RANDOM_SEQUENCE = 0;
+
+// Functions
+unsigned long long splitMix64(unsigned long long& state);
+unsigned int rotateLeft(unsigned int v, int bits);
+template <typename Draw>
+void fillRandomBlocks(int n, Draw draw);
+
+unsigned long long splitMix64(unsigned long long& state) {
+    unsigned long long z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+unsigned int rotateLeft(unsigned int v, int bits) {
+    return (v << bits) | (v >> (32 - bits));
+}
+
+// Seeds the calling thread's stream, the others reseed on their next draw
+void seedRandom(unsigned long long seed) {
+    RANDOM_SEED = seed;
+    const unsigned int generation = ++RANDOM_GENERATION;
+    THREAD_RANDOM_SEQUENCE = 0;
+    seedRandomStream(THREAD_RANDOM, seed, 0);
+    THREAD_RANDOM_GENERATION = generation;
+}
+
+unsigned long long randomSeed() {
+    return RANDOM_SEED;
+}
+
+// Streams with different sequences start far apart in the splitmix64 output
+void seedRandomStream(random_stream& stream, unsigned long long seed, unsigned long long sequence) {
+    unsigned long long state = seed ^ (sequence * 0xD1B54A32D192ED03ull);
+    const unsigned long long low = splitMix64(state);
+    const unsigned long long high = splitMix64(state);
+    stream.s[0] = static_cast<unsigned int>(low);
+    stream.s[1] = static_cast<unsigned int>(low >> 32);
+    stream.s[2] = static_cast<unsigned int>(high);
+    stream.s[3] = static_cast<unsigned int>(high >> 32);
+    // All zero is the one state xoshiro never leaves
+    if ((stream.s[0] | stream.s[1] | stream.s[2] | stream.s[3]) == 0) {
+        stream.s[0] = 1;
+    }
+}
+
+unsigned int nextRandom(random_stream& stream) {
+    unsigned int* s = stream.s;
+    const unsigned int result = s[0] + s[3];
+    const unsigned int t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 11);
+    return result;
+}
+
+// From the top 24 bits, the low ones of xoshiro128+ are weak
+float nextRandomFloat(random_stream& stream, float min, float max) {
+    return min + (max - min) * static_cast<float>(nextRandom(stream) >> 8) * RANDOM_FLOAT_UNIT;
+}
+
+// Uniform in [0, count), the top 24 bits scaled rather than a modulo
+int nextRandomIndex(random_stream& stream, int count) {
+    return static_cast<int>((static_cast<unsigned long long>(nextRandom(stream) >> 8) * count) >> 24);
+}
+
+random_stream& threadRandomStream() {
+    const unsigned int generation = RANDOM_GENERATION;
+    if (THREAD_RANDOM_GENERATION != generation) {
+        if (THREAD_RANDOM_GENERATION == 0) {
+            THREAD_RANDOM_SEQUENCE = RANDOM_THREADS++;
+        }
+        seedRandomStream(THREAD_RANDOM, RANDOM_SEED, THREAD_RANDOM_SEQUENCE);
+        THREAD_RANDOM_GENERATION = generation;
+    }
+    return THREAD_RANDOM;
+}
+
+// Calls draw(stream, i) for every i below n, with the stream of i's block
+template <typename Draw>
+void fillRandomBlocks(int n, Draw draw) {
+    random_stream& thread = threadRandomStream();
+    const unsigned long long batch = (static_cast<unsigned long long>(nextRandom(thread)) << 32) | nextRandom(thread);
+    const int blocks = (n + RANDOM_BLOCK - 1) / RANDOM_BLOCK;
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        random_stream stream;
+        for (int b = begin; b < end; b++) {
+            seedRandomStream(stream, batch, b);
+            for (int i = b * RANDOM_BLOCK; i < std::min(n, (b + 1) * RANDOM_BLOCK); i++) {
+                draw(stream, i);
+            }
+        }
+    });
+}
+
+void fillRandomFloats(float* out, int n, float min, float max) {
+    fillRandomBlocks(n, [&](random_stream& stream, int i) {
+        out[i] = nextRandomFloat(stream, min, max);
+    });
+}
+
+void fillRandomIndices(unsigned char* out, int n, int count) {
+    fillRandomBlocks(n, [&](random_stream& stream, int i) {
+        out[i] = static_cast<unsigned char>(nextRandomIndex(stream, count));
+    });
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// xoshiro128+ generators. Every thread draws from its own stream, derived
+// from the seed and the thread, so randomFloat is safe to call anywhere and a
+// run is reproducible from its seed. The calling thread of seedRandom gets
+// stream 0, the others one each in the order they first draw.
+//
+// Batches fill whole columns in parallel. They are cut into fixed blocks,
+// each with a stream seeded from the block number and a 64 bit draw of the
+// calling thread's stream, so a batch comes out the same for any thread
+// count and moves the calling thread's stream on by two draws.
+typedef struct {
+    unsigned int s[4];
+} random_stream;
+
+// Functions
+void seedRandom(unsigned long long seed);
+unsigned long long randomSeed();
+void seedRandomStream(random_stream& stream, unsigned long long seed, unsigned long long sequence);
+unsigned int nextRandom(random_stream& stream);
+float nextRandomFloat(random_stream& stream, float min, float max);
+int nextRandomIndex(random_stream& stream, int count);
+random_stream& threadRandomStream();
+void fillRandomFloats(float* out, int n, float min, float max);
+void fillRandomIndices(unsigned char* out, int n, int count);
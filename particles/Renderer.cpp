@@ -0,0 +1,109 @@
+#include "Renderer.h"
+#include <cmath>
+
+const float PI = 3.14159265f;
+const sf::Color ATTRACTIVE_PARTICLE_COLOR(255, 0, 0);
+const sf::Color ATTRACTION_RING_COLOR(255, 0, 0, 60);
+
+sf::Color COLORS[COLORS_LENGTH] = {sf::Color::White, sf::Color::Green, sf::Color::Blue, sf::Color::Yellow, sf::Color::Red, sf::Color::Magenta, sf::Color::Cyan};
+
+// Functions
+void buildUnitCircle(std::vector<sf::Vector2f>& circle, int segments);
+sf::Vertex* appendCircle(sf::Vertex* out, const std::vector<sf::Vector2f>& unitCircle, sf::Vector2f center, float radius, sf::Color color);
+sf::Vertex* appendRing(sf::Vertex* out, const std::vector<sf::Vector2f>& unitRing, sf::Vector2f center, float innerRadius, float outerRadius, sf::Color color);
+
+void initParticleBatch(particle_batch& batch) {
+    buildUnitCircle(batch.unitCircle, CIRCLE_SEGMENTS);
+    buildUnitCircle(batch.unitRing, ATTRACTION_RING_SEGMENTS);
+    batch.vertices.setPrimitiveType(sf::Triangles);
+    batch.vertices.clear();
+}
+
+// segments + 1 points, the last one closes the circle so no wrap is needed
+void buildUnitCircle(std::vector<sf::Vector2f>& circle, int segments) {
+    circle.resize(segments + 1);
+    for (int s = 0; s <= segments; s++) {
+        float angle = 2 * PI * (s % segments) / segments;
+        circle[s] = sf::Vector2f(cos(angle), sin(angle));
+    }
+}
+
+sf::Vertex* appendCircle(sf::Vertex* out, const std::vector<sf::Vector2f>& unitCircle, sf::Vector2f center, float radius, sf::Color color) {
+    const int segments = static_cast<int>(unitCircle.size()) - 1;
+    for (int s = 0; s < segments; s++) {
+        out[0].position = center;
+        out[1].position = center + unitCircle[s] * radius;
+        out[2].position = center + unitCircle[s + 1] * radius;
+        out[0].color = color;
+        out[1].color = color;
+        out[2].color = color;
+        out += 3;
+    }
+    return out;
+}
+
+sf::Vertex* appendRing(sf::Vertex* out, const std::vector<sf::Vector2f>& unitRing, sf::Vector2f center, float innerRadius, float outerRadius, sf::Color color) {
+    const int segments = static_cast<int>(unitRing.size()) - 1;
+    for (int s = 0; s < segments; s++) {
+        sf::Vector2f innerA = center + unitRing[s] * innerRadius;
+        sf::Vector2f outerA = center + unitRing[s] * outerRadius;
+        sf::Vector2f innerB = center + unitRing[s + 1] * innerRadius;
+        sf::Vector2f outerB = center + unitRing[s + 1] * outerRadius;
+        out[0].position = innerA;
+        out[1].position = outerA;
+        out[2].position = outerB;
+        out[3].position = innerA;
+        out[4].position = outerB;
+        out[5].position = innerB;
+        for (int v = 0; v < 6; v++) {
+            out[v].color = color;
+        }
+        out += 6;
+    }
+    return out;
+}
+
+// Positions in the store are the top left corner of the particle's bounding
+// box, like sf::CircleShape positions were, so circles are centred at +radius.
+// Everything is drawn alpha of the way from its previous to its current
+// position, see simulation_clock.
+void buildParticleBatchVertices(particle_batch& batch, const ParticleStore& particles, const std::vector<attractive_particle>& attractive_particles, float alpha) {
+    const int n = particleCount(particles);
+    int alive = 0;
+    for (int i = 0; i < n; i++) {
+        if (!(particles.flags[i] & PARTICLE_REMOVED)) {
+            alive++;
+        }
+    }
+    int attractors = 0;
+    for (auto& p : attractive_particles) {
+        if (!p.removed) {
+            attractors++;
+        }
+    }
+    const int circleVertices = CIRCLE_SEGMENTS * 3;
+    const int ringVertices = ATTRACTION_RING_SEGMENTS * 6;
+    batch.vertices.resize(alive * circleVertices + attractors * (ringVertices + circleVertices));
+    if (batch.vertices.getVertexCount() == 0) {
+        return;
+    }
+    sf::Vertex* out = &batch.vertices[0];
+    for (int i = 0; i < n; i++) {
+        if (particles.flags[i] & PARTICLE_REMOVED) {
+            continue;
+        }
+        const float radius = particles.radius[i];
+        const float x = particles.previousX[i] + (particles.x[i] - particles.previousX[i]) * alpha;
+        const float y = particles.previousY[i] + (particles.y[i] - particles.previousY[i]) * alpha;
+        sf::Vector2f center(x + radius, y + radius);
+        out = appendCircle(out, batch.unitCircle, center, radius, COLORS[particles.colorIndex[i]]);
+    }
+    for (auto& p : attractive_particles) {
+        if (p.removed) {
+            continue;
+        }
+        sf::Vector2f center = p.previousPosition + (p.position - p.previousPosition) * alpha + sf::Vector2f(p.radius, p.radius);
+        out = appendRing(out, batch.unitRing, center, p.attractionRadius, p.attractionRadius + ATTRACTION_RING_THICKNESS, ATTRACTION_RING_COLOR);
+        out = appendCircle(out, batch.unitCircle, center, p.radius, ATTRACTIVE_PARTICLE_COLOR);
+    }
+}
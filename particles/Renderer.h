@@ -0,0 +1,28 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include "Constants.h"
+#include "Particle.h"
+#include "ParticleStore.h"
+
+// Triangles per circle. Particles are at most 10 px wide, so a few segments
+// already look round; attraction rings are up to 250 px wide and need more.
+const int CIRCLE_SEGMENTS = 12;
+const int ATTRACTION_RING_SEGMENTS = 48;
+const float ATTRACTION_RING_THICKNESS = 1.f;
+
+// Colors, indexed by ParticleStore::colorIndex
+extern sf::Color COLORS[COLORS_LENGTH];
+
+// Every particle and attractor of a frame, as one triangle list drawn with a
+// single window.draw call. The unit circles are shared templates that get
+// scaled and translated per particle.
+typedef struct {
+    std::vector<sf::Vector2f> unitCircle;
+    std::vector<sf::Vector2f> unitRing;
+    sf::VertexArray vertices;
+} particle_batch;
+
+// Functions
+void initParticleBatch(particle_batch& batch);
+void buildParticleBatchVertices(particle_batch& batch, const ParticleStore& particles, const std::vector<attractive_particle>& attractive_particles, float alpha);
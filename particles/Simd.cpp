@@ -0,0 +1,574 @@
+#include "Simd.h"
+#include "Constants.h"
+#include "Particle.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+// MSVC lets any function use any intrinsic, GCC and Clang need the
+// instruction set enabled per function. Every level has to give the same
+// bits as the scalar paths, so nothing in this file may fuse a multiply and
+// an add, even when the whole build targets a CPU with FMA (-march=native,
+// /arch:AVX2). MSVC and Clang turn contraction off for the file by pragma;
+// GCC ignores both, so SIMD_EXACT turns it off per function instead, on the
+// scalar kernels and through SIMD_TARGET on the vector ones.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#define SIMD_EXACT
+#define SIMD_TARGET(isa)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#pragma clang fp contract(off)
+#define SIMD_EXACT
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_EXACT __attribute__((optimize("fp-contract=off")))
+#define SIMD_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+
+int SIMD_LEVEL = detectSimdLevel();
+// Partial sums of the gravity kernel, one AVX-512 register wide
+const int GRAVITY_LANES = 16;
+
+// Functions
+template <int Flags>
+integrate_kernel integrateKernelAt(int level);
+template <int Flags>
+SIMD_EXACT
+void integrateScalar(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time);
+void borderScalar(const ParticleStore& particles, int begin, int end, unsigned char* border);
+void applyRemovedMask(unsigned char* flags, int mask, int lanes);
+SIMD_EXACT
+void gravityScalar(const float* pointX, const float* pointY, const float* pointMass, int from, int points, float x, float y, float softening2, float* sumX, float* sumY);
+#if SIMD_X86
+void cpuid(int leaf, int subleaf, unsigned int registers[4]);
+unsigned long long xgetbv0();
+template <int Flags>
+SIMD_TARGET("sse2")
+void integrateSse2(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time);
+template <int Flags>
+SIMD_TARGET("avx2")
+void integrateAvx2(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time);
+template <int Flags>
+SIMD_TARGET("avx512f")
+void integrateAvx512(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time);
+void borderSse2(const ParticleStore& particles, int begin, int end, unsigned char* border);
+void borderAvx2(const ParticleStore& particles, int begin, int end, unsigned char* border);
+void borderAvx512(const ParticleStore& particles, int begin, int end, unsigned char* border);
+int gravitySse2(const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float* sumX, float* sumY);
+int gravityAvx2(const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float* sumX, float* sumY);
+int gravityAvx512(const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float* sumX, float* sumY);
+#endif
+
+const char* simdLevelName(int level) {
+    switch (level) {
+    case SIMD_SSE2:
+        return "sse2";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+#if SIMD_X86
+void cpuid(int leaf, int subleaf, unsigned int registers[4]) {
+#if defined(_MSC_VER)
+    __cpuidex(reinterpret_cast<int*>(registers), leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+unsigned long long xgetbv0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax;
+    unsigned int edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+// The CPU has to support the instructions and the OS has to save the wider
+// registers (XCR0) for AVX and AVX-512 to be usable
+int detectSimdLevel() {
+#if SIMD_X86
+    unsigned int registers[4];
+    cpuid(0, 0, registers);
+    const unsigned int maxLeaf = registers[0];
+    cpuid(1, 0, registers);
+    if (!(registers[3] & (1u << 26))) {
+        return SIMD_SCALAR;
+    }
+    const bool osxsave = (registers[2] & (1u << 27)) != 0;
+    const bool avx = (registers[2] & (1u << 28)) != 0;
+    if (!osxsave || !avx || maxLeaf < 7) {
+        return SIMD_SSE2;
+    }
+    const unsigned long long xcr0 = xgetbv0();
+    cpuid(7, 0, registers);
+    const bool avx2 = (registers[1] & (1u << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    const bool avx512 = (registers[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    if (avx512) {
+        return SIMD_AVX512;
+    }
+    if (avx2) {
+        return SIMD_AVX2;
+    }
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// Gravity, integration and off-screen flagging in one pass. Every SIMD path
+// does the same float operations in the same order (no FMA) as this one, so
+// results are bit-identical whatever level runs. This is the generic kernel,
+// gravity comes in as arguments and is zero when it is off.
+void integrateKernel(int level, ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time) {
+    integrateKernelFor(level, UPDATE_GRAVITY)(particles, begin, end, gravityX, gravityY, time);
+}
+
+// The kernel compiled for the feature flags. Only UPDATE_GRAVITY changes
+// integration; without it the gravity arguments are ignored and the add
+// is not there at all.
+template <int Flags>
+integrate_kernel integrateKernelAt(int level) {
+#if SIMD_X86
+    switch (level) {
+    case SIMD_AVX512:
+        return integrateAvx512<Flags>;
+    case SIMD_AVX2:
+        return integrateAvx2<Flags>;
+    case SIMD_SSE2:
+        return integrateSse2<Flags>;
+    default:
+        break;
+    }
+#else
+    (void)level;
+#endif
+    return integrateScalar<Flags>;
+}
+
+integrate_kernel integrateKernelFor(int level, int flags) {
+    return (flags & UPDATE_GRAVITY) ? integrateKernelAt<UPDATE_GRAVITY>(level) : integrateKernelAt<0>(level);
+}
+
+// border[i] is 1 where borderCollapse(particles, i) != 0
+void borderKernel(int level, const ParticleStore& particles, int begin, int end, unsigned char* border) {
+#if SIMD_X86
+    switch (level) {
+    case SIMD_AVX512:
+        borderAvx512(particles, begin, end, border);
+        return;
+    case SIMD_AVX2:
+        borderAvx2(particles, begin, end, border);
+        return;
+    case SIMD_SSE2:
+        borderSse2(particles, begin, end, border);
+        return;
+    default:
+        break;
+    }
+#endif
+    borderScalar(particles, begin, end, border);
+}
+
+// Pull of every point on (x, y) for unit gravity. Point p adds into lane
+// p % GRAVITY_LANES, and the lanes are summed in order at the end; every
+// level keeps those lanes in its registers, so all of them give the same
+// bits. Softening has to be above zero for a point on (x, y) to add nothing.
+SIMD_EXACT
+void gravityKernel(int level, const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float& ax, float& ay) {
+    float sumX[GRAVITY_LANES] = {0};
+    float sumY[GRAVITY_LANES] = {0};
+    int done = 0;
+#if SIMD_X86
+    switch (level) {
+    case SIMD_AVX512:
+        done = gravityAvx512(pointX, pointY, pointMass, points, x, y, softening2, sumX, sumY);
+        break;
+    case SIMD_AVX2:
+        done = gravityAvx2(pointX, pointY, pointMass, points, x, y, softening2, sumX, sumY);
+        break;
+    case SIMD_SSE2:
+        done = gravitySse2(pointX, pointY, pointMass, points, x, y, softening2, sumX, sumY);
+        break;
+    default:
+        break;
+    }
+#endif
+    gravityScalar(pointX, pointY, pointMass, done, points, x, y, softening2, sumX, sumY);
+    ax = 0.f;
+    ay = 0.f;
+    for (int l = 0; l < GRAVITY_LANES; l++) {
+        ax += sumX[l];
+        ay += sumY[l];
+    }
+}
+
+template <int Flags>
+SIMD_EXACT
+void integrateScalar(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time) {
+    for (int i = begin; i < end; i++) {
+        if (!(particles.flags[i] & (PARTICLE_FROZEN | PARTICLE_REMOVED))) {
+            if (Flags & UPDATE_GRAVITY) {
+                particles.vx[i] += gravityX;
+                particles.vy[i] += gravityY;
+            }
+            particles.x[i] += particles.vx[i] * time;
+            particles.y[i] += particles.vy[i] * time;
+        }
+        const float margin = particles.radius[i] * 2;
+        bool offX = particles.x[i] + margin < 0.f || particles.x[i] - margin > WINDOW_WIDTH;
+        bool offY = particles.y[i] + margin < 0.f || particles.y[i] - margin > WINDOW_HEIGHT;
+        setParticleFlag(particles, i, PARTICLE_REMOVED, offX || offY);
+    }
+}
+
+void borderScalar(const ParticleStore& particles, int begin, int end, unsigned char* border) {
+    for (int i = begin; i < end; i++) {
+        border[i] = borderCollapse(particles, i) != 0;
+    }
+}
+
+// Points from `from` on, into the lanes they belong to
+SIMD_EXACT
+void gravityScalar(const float* pointX, const float* pointY, const float* pointMass, int from, int points, float x, float y, float softening2, float* sumX, float* sumY) {
+    for (int p = from; p < points; p++) {
+        const float dx = pointX[p] - x;
+        const float dy = pointY[p] - y;
+        const float r2 = dx * dx + dy * dy + softening2;
+        const float pull = pointMass[p] / (r2 * std::sqrt(r2));
+        sumX[p % GRAVITY_LANES] += pull * dx;
+        sumY[p % GRAVITY_LANES] += pull * dy;
+    }
+}
+
+// Bit k of mask is the off-screen test of lane k
+void applyRemovedMask(unsigned char* flags, int mask, int lanes) {
+    for (int k = 0; k < lanes; k++) {
+        if (mask & (1 << k)) {
+            flags[k] |= PARTICLE_REMOVED;
+        }
+        else {
+            flags[k] &= ~PARTICLE_REMOVED;
+        }
+    }
+}
+
+#if SIMD_X86
+template <int Flags>
+SIMD_TARGET("sse2")
+void integrateSse2(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time) {
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* vx = particles.vx.data();
+    float* vy = particles.vy.data();
+    const float* radius = particles.radius.data();
+    unsigned char* flags = particles.flags.data();
+    const __m128 gravityXs = _mm_set1_ps(gravityX);
+    const __m128 gravityYs = _mm_set1_ps(gravityY);
+    const __m128 times = _mm_set1_ps(time);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 width = _mm_set1_ps(static_cast<float>(WINDOW_WIDTH));
+    const __m128 height = _mm_set1_ps(static_cast<float>(WINDOW_HEIGHT));
+    const __m128i skip = _mm_set1_epi32(PARTICLE_FROZEN | PARTICLE_REMOVED);
+    const __m128i zeroi = _mm_setzero_si128();
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        int packed;
+        memcpy(&packed, flags + i, sizeof(packed));
+        __m128i f = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zeroi), zeroi);
+        __m128 active = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(f, skip), zeroi));
+        __m128 xs = _mm_loadu_ps(x + i);
+        __m128 ys = _mm_loadu_ps(y + i);
+        __m128 vxs = _mm_loadu_ps(vx + i);
+        __m128 vys = _mm_loadu_ps(vy + i);
+        __m128 nvx = (Flags & UPDATE_GRAVITY) ? _mm_add_ps(vxs, gravityXs) : vxs;
+        __m128 nvy = (Flags & UPDATE_GRAVITY) ? _mm_add_ps(vys, gravityYs) : vys;
+        __m128 nx = _mm_add_ps(xs, _mm_mul_ps(nvx, times));
+        __m128 ny = _mm_add_ps(ys, _mm_mul_ps(nvy, times));
+        vxs = _mm_or_ps(_mm_and_ps(active, nvx), _mm_andnot_ps(active, vxs));
+        vys = _mm_or_ps(_mm_and_ps(active, nvy), _mm_andnot_ps(active, vys));
+        xs = _mm_or_ps(_mm_and_ps(active, nx), _mm_andnot_ps(active, xs));
+        ys = _mm_or_ps(_mm_and_ps(active, ny), _mm_andnot_ps(active, ys));
+        _mm_storeu_ps(vx + i, vxs);
+        _mm_storeu_ps(vy + i, vys);
+        _mm_storeu_ps(x + i, xs);
+        _mm_storeu_ps(y + i, ys);
+        __m128 margin = _mm_mul_ps(_mm_loadu_ps(radius + i), two);
+        __m128 offX = _mm_or_ps(_mm_cmplt_ps(_mm_add_ps(xs, margin), zero), _mm_cmpgt_ps(_mm_sub_ps(xs, margin), width));
+        __m128 offY = _mm_or_ps(_mm_cmplt_ps(_mm_add_ps(ys, margin), zero), _mm_cmpgt_ps(_mm_sub_ps(ys, margin), height));
+        applyRemovedMask(flags + i, _mm_movemask_ps(_mm_or_ps(offX, offY)), 4);
+    }
+    integrateScalar<Flags>(particles, i, end, gravityX, gravityY, time);
+}
+
+template <int Flags>
+SIMD_TARGET("avx2")
+void integrateAvx2(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time) {
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* vx = particles.vx.data();
+    float* vy = particles.vy.data();
+    const float* radius = particles.radius.data();
+    unsigned char* flags = particles.flags.data();
+    const __m256 gravityXs = _mm256_set1_ps(gravityX);
+    const __m256 gravityYs = _mm256_set1_ps(gravityY);
+    const __m256 times = _mm256_set1_ps(time);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 width = _mm256_set1_ps(static_cast<float>(WINDOW_WIDTH));
+    const __m256 height = _mm256_set1_ps(static_cast<float>(WINDOW_HEIGHT));
+    const __m256i skip = _mm256_set1_epi32(PARTICLE_FROZEN | PARTICLE_REMOVED);
+    const __m256i zeroi = _mm256_setzero_si256();
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256i f = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(flags + i)));
+        __m256 active = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(f, skip), zeroi));
+        __m256 xs = _mm256_loadu_ps(x + i);
+        __m256 ys = _mm256_loadu_ps(y + i);
+        __m256 vxs = _mm256_loadu_ps(vx + i);
+        __m256 vys = _mm256_loadu_ps(vy + i);
+        __m256 nvx = (Flags & UPDATE_GRAVITY) ? _mm256_add_ps(vxs, gravityXs) : vxs;
+        __m256 nvy = (Flags & UPDATE_GRAVITY) ? _mm256_add_ps(vys, gravityYs) : vys;
+        __m256 nx = _mm256_add_ps(xs, _mm256_mul_ps(nvx, times));
+        __m256 ny = _mm256_add_ps(ys, _mm256_mul_ps(nvy, times));
+        vxs = _mm256_blendv_ps(vxs, nvx, active);
+        vys = _mm256_blendv_ps(vys, nvy, active);
+        xs = _mm256_blendv_ps(xs, nx, active);
+        ys = _mm256_blendv_ps(ys, ny, active);
+        _mm256_storeu_ps(vx + i, vxs);
+        _mm256_storeu_ps(vy + i, vys);
+        _mm256_storeu_ps(x + i, xs);
+        _mm256_storeu_ps(y + i, ys);
+        __m256 margin = _mm256_mul_ps(_mm256_loadu_ps(radius + i), two);
+        __m256 offX = _mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(xs, margin), zero, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_sub_ps(xs, margin), width, _CMP_GT_OQ));
+        __m256 offY = _mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(ys, margin), zero, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_sub_ps(ys, margin), height, _CMP_GT_OQ));
+        applyRemovedMask(flags + i, _mm256_movemask_ps(_mm256_or_ps(offX, offY)), 8);
+    }
+    integrateScalar<Flags>(particles, i, end, gravityX, gravityY, time);
+}
+
+template <int Flags>
+SIMD_TARGET("avx512f")
+void integrateAvx512(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time) {
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* vx = particles.vx.data();
+    float* vy = particles.vy.data();
+    const float* radius = particles.radius.data();
+    unsigned char* flags = particles.flags.data();
+    const __m512 gravityXs = _mm512_set1_ps(gravityX);
+    const __m512 gravityYs = _mm512_set1_ps(gravityY);
+    const __m512 times = _mm512_set1_ps(time);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 two = _mm512_set1_ps(2.f);
+    const __m512 width = _mm512_set1_ps(static_cast<float>(WINDOW_WIDTH));
+    const __m512 height = _mm512_set1_ps(static_cast<float>(WINDOW_HEIGHT));
+    const __m512i skip = _mm512_set1_epi32(PARTICLE_FROZEN | PARTICLE_REMOVED);
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512i f = _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)));
+        __mmask16 active = _mm512_testn_epi32_mask(f, skip);
+        __m512 xs = _mm512_loadu_ps(x + i);
+        __m512 ys = _mm512_loadu_ps(y + i);
+        __m512 vxs = _mm512_loadu_ps(vx + i);
+        __m512 vys = _mm512_loadu_ps(vy + i);
+        if (Flags & UPDATE_GRAVITY) {
+            vxs = _mm512_mask_add_ps(vxs, active, vxs, gravityXs);
+            vys = _mm512_mask_add_ps(vys, active, vys, gravityYs);
+        }
+        xs = _mm512_mask_add_ps(xs, active, xs, _mm512_mul_ps(vxs, times));
+        ys = _mm512_mask_add_ps(ys, active, ys, _mm512_mul_ps(vys, times));
+        _mm512_storeu_ps(vx + i, vxs);
+        _mm512_storeu_ps(vy + i, vys);
+        _mm512_storeu_ps(x + i, xs);
+        _mm512_storeu_ps(y + i, ys);
+        __m512 margin = _mm512_mul_ps(_mm512_loadu_ps(radius + i), two);
+        __mmask16 off = _mm512_cmp_ps_mask(_mm512_add_ps(xs, margin), zero, _CMP_LT_OQ)
+            | _mm512_cmp_ps_mask(_mm512_sub_ps(xs, margin), width, _CMP_GT_OQ)
+            | _mm512_cmp_ps_mask(_mm512_add_ps(ys, margin), zero, _CMP_LT_OQ)
+            | _mm512_cmp_ps_mask(_mm512_sub_ps(ys, margin), height, _CMP_GT_OQ);
+        applyRemovedMask(flags + i, off, 16);
+    }
+    integrateScalar<Flags>(particles, i, end, gravityX, gravityY, time);
+}
+
+SIMD_TARGET("sse2")
+void borderSse2(const ParticleStore& particles, int begin, int end, unsigned char* border) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* radius = particles.radius.data();
+    const unsigned char* flags = particles.flags.data();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 width = _mm_set1_ps(static_cast<float>(WINDOW_WIDTH));
+    const __m128 height = _mm_set1_ps(static_cast<float>(WINDOW_HEIGHT));
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 xs = _mm_loadu_ps(x + i);
+        __m128 ys = _mm_loadu_ps(y + i);
+        __m128 r = _mm_loadu_ps(radius + i);
+        __m128 diameter = _mm_mul_ps(r, two);
+        __m128 hit = _mm_or_ps(
+            _mm_or_ps(_mm_cmpgt_ps(_mm_add_ps(xs, diameter), width), _mm_cmplt_ps(_mm_sub_ps(xs, r), zero)),
+            _mm_or_ps(_mm_cmplt_ps(_mm_sub_ps(ys, diameter), zero), _mm_cmpgt_ps(_mm_add_ps(ys, diameter), height)));
+        int mask = _mm_movemask_ps(hit);
+        for (int k = 0; k < 4; k++) {
+            border[i + k] = !(flags[i + k] & PARTICLE_REMOVED) && (mask & (1 << k));
+        }
+    }
+    borderScalar(particles, i, end, border);
+}
+
+SIMD_TARGET("avx2")
+void borderAvx2(const ParticleStore& particles, int begin, int end, unsigned char* border) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* radius = particles.radius.data();
+    const unsigned char* flags = particles.flags.data();
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 width = _mm256_set1_ps(static_cast<float>(WINDOW_WIDTH));
+    const __m256 height = _mm256_set1_ps(static_cast<float>(WINDOW_HEIGHT));
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 xs = _mm256_loadu_ps(x + i);
+        __m256 ys = _mm256_loadu_ps(y + i);
+        __m256 r = _mm256_loadu_ps(radius + i);
+        __m256 diameter = _mm256_mul_ps(r, two);
+        __m256 hit = _mm256_or_ps(
+            _mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(xs, diameter), width, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_sub_ps(xs, r), zero, _CMP_LT_OQ)),
+            _mm256_or_ps(_mm256_cmp_ps(_mm256_sub_ps(ys, diameter), zero, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_add_ps(ys, diameter), height, _CMP_GT_OQ)));
+        int mask = _mm256_movemask_ps(hit);
+        for (int k = 0; k < 8; k++) {
+            border[i + k] = !(flags[i + k] & PARTICLE_REMOVED) && (mask & (1 << k));
+        }
+    }
+    borderScalar(particles, i, end, border);
+}
+
+SIMD_TARGET("avx512f")
+void borderAvx512(const ParticleStore& particles, int begin, int end, unsigned char* border) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* radius = particles.radius.data();
+    const unsigned char* flags = particles.flags.data();
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 two = _mm512_set1_ps(2.f);
+    const __m512 width = _mm512_set1_ps(static_cast<float>(WINDOW_WIDTH));
+    const __m512 height = _mm512_set1_ps(static_cast<float>(WINDOW_HEIGHT));
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512 xs = _mm512_loadu_ps(x + i);
+        __m512 ys = _mm512_loadu_ps(y + i);
+        __m512 r = _mm512_loadu_ps(radius + i);
+        __m512 diameter = _mm512_mul_ps(r, two);
+        __mmask16 hit = _mm512_cmp_ps_mask(_mm512_add_ps(xs, diameter), width, _CMP_GT_OQ)
+            | _mm512_cmp_ps_mask(_mm512_sub_ps(xs, r), zero, _CMP_LT_OQ)
+            | _mm512_cmp_ps_mask(_mm512_sub_ps(ys, diameter), zero, _CMP_LT_OQ)
+            | _mm512_cmp_ps_mask(_mm512_add_ps(ys, diameter), height, _CMP_GT_OQ);
+        for (int k = 0; k < 16; k++) {
+            border[i + k] = !(flags[i + k] & PARTICLE_REMOVED) && (hit & (1 << k));
+        }
+    }
+    borderScalar(particles, i, end, border);
+}
+
+// The SIMD gravity paths run whole blocks of GRAVITY_LANES points and return
+// how many points they did, the scalar path finishes the rest
+SIMD_TARGET("sse2")
+int gravitySse2(const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float* sumX, float* sumY) {
+    const __m128 xs = _mm_set1_ps(x);
+    const __m128 ys = _mm_set1_ps(y);
+    const __m128 softening2s = _mm_set1_ps(softening2);
+    __m128 sumXs[4];
+    __m128 sumYs[4];
+    for (int v = 0; v < 4; v++) {
+        sumXs[v] = _mm_setzero_ps();
+        sumYs[v] = _mm_setzero_ps();
+    }
+    int p = 0;
+    for (; p + GRAVITY_LANES <= points; p += GRAVITY_LANES) {
+        for (int v = 0; v < 4; v++) {
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(pointX + p + v * 4), xs);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(pointY + p + v * 4), ys);
+            const __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), softening2s);
+            const __m128 pull = _mm_div_ps(_mm_loadu_ps(pointMass + p + v * 4), _mm_mul_ps(r2, _mm_sqrt_ps(r2)));
+            sumXs[v] = _mm_add_ps(sumXs[v], _mm_mul_ps(pull, dx));
+            sumYs[v] = _mm_add_ps(sumYs[v], _mm_mul_ps(pull, dy));
+        }
+    }
+    for (int v = 0; v < 4; v++) {
+        _mm_storeu_ps(sumX + v * 4, sumXs[v]);
+        _mm_storeu_ps(sumY + v * 4, sumYs[v]);
+    }
+    return p;
+}
+
+SIMD_TARGET("avx2")
+int gravityAvx2(const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float* sumX, float* sumY) {
+    const __m256 xs = _mm256_set1_ps(x);
+    const __m256 ys = _mm256_set1_ps(y);
+    const __m256 softening2s = _mm256_set1_ps(softening2);
+    __m256 sumXs[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    __m256 sumYs[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    int p = 0;
+    for (; p + GRAVITY_LANES <= points; p += GRAVITY_LANES) {
+        for (int v = 0; v < 2; v++) {
+            const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(pointX + p + v * 8), xs);
+            const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(pointY + p + v * 8), ys);
+            const __m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), softening2s);
+            const __m256 pull = _mm256_div_ps(_mm256_loadu_ps(pointMass + p + v * 8), _mm256_mul_ps(r2, _mm256_sqrt_ps(r2)));
+            sumXs[v] = _mm256_add_ps(sumXs[v], _mm256_mul_ps(pull, dx));
+            sumYs[v] = _mm256_add_ps(sumYs[v], _mm256_mul_ps(pull, dy));
+        }
+    }
+    for (int v = 0; v < 2; v++) {
+        _mm256_storeu_ps(sumX + v * 8, sumXs[v]);
+        _mm256_storeu_ps(sumY + v * 8, sumYs[v]);
+    }
+    return p;
+}
+
+SIMD_TARGET("avx512f")
+int gravityAvx512(const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float* sumX, float* sumY) {
+    const __m512 xs = _mm512_set1_ps(x);
+    const __m512 ys = _mm512_set1_ps(y);
+    const __m512 softening2s = _mm512_set1_ps(softening2);
+    __m512 sumXs = _mm512_setzero_ps();
+    __m512 sumYs = _mm512_setzero_ps();
+    int p = 0;
+    for (; p + GRAVITY_LANES <= points; p += GRAVITY_LANES) {
+        const __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(pointX + p), xs);
+        const __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(pointY + p), ys);
+        const __m512 r2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), softening2s);
+        const __m512 pull = _mm512_div_ps(_mm512_loadu_ps(pointMass + p), _mm512_mul_ps(r2, _mm512_maskz_sqrt_ps(0xFFFF, r2)));
+        sumXs = _mm512_add_ps(sumXs, _mm512_mul_ps(pull, dx));
+        sumYs = _mm512_add_ps(sumYs, _mm512_mul_ps(pull, dy));
+    }
+    _mm512_storeu_ps(sumX, sumXs);
+    _mm512_storeu_ps(sumY, sumYs);
+    return p;
+}
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#include "ParticleStore.h"
+
+// Instruction sets the particle kernels can run on, best last
+const int SIMD_SCALAR = 0;
+const int SIMD_SSE2 = 1;
+const int SIMD_AVX2 = 2;
+const int SIMD_AVX512 = 3;
+
+// Level the kernels use, the best one the CPU supports unless overridden
+extern int SIMD_LEVEL;
+
+// Integrate pass over [begin, end), see integrateKernel
+typedef void (*integrate_kernel)(ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time);
+
+// Functions
+int detectSimdLevel();
+const char* simdLevelName(int level);
+void integrateKernel(int level, ParticleStore& particles, int begin, int end, float gravityX, float gravityY, float time);
+integrate_kernel integrateKernelFor(int level, int flags);
+void borderKernel(int level, const ParticleStore& particles, int begin, int end, unsigned char* border);
+void gravityKernel(int level, const float* pointX, const float* pointY, const float* pointMass, int points, float x, float y, float softening2, float& ax, float& ay);
@@ -0,0 +1,96 @@
+#include "Simulation.h"
+#include "Constants.h"
+#include "Particles.h"
+#include <algorithm>
+#include <chrono>
+
+// Mouse spawning happens this many times per simulated second
+const int SPAWNS_PER_SECOND = 15;
+
+// Functions
+double lapMilliseconds(std::chrono::steady_clock::time_point& since);
+
+// Milliseconds since `since`, which is moved to now for the next stage
+double lapMilliseconds(std::chrono::steady_clock::time_point& since) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double, std::milli>(now - since).count();
+    since = now;
+    return elapsed;
+}
+
+void initSimulationClock(simulation_clock& clock, int rate, int maxSubsteps) {
+    clock.step = 1.0 / rate;
+    clock.maxSubsteps = maxSubsteps;
+    clock.accumulator = 0;
+    clock.alpha = 0;
+    clock.steps = 0;
+    clock.droppedSeconds = 0;
+}
+
+// Returns how many steps to run for elapsedSeconds of real time. When steps
+// take longer than they simulate, the backlog past maxSubsteps is dropped so
+// the frame rate degrades instead of spiralling down.
+int advanceSimulationClock(simulation_clock& clock, double elapsedSeconds) {
+    clock.accumulator += elapsedSeconds;
+    int substeps = static_cast<int>(clock.accumulator / clock.step);
+    if (substeps > clock.maxSubsteps) {
+        const double dropped = (substeps - clock.maxSubsteps) * clock.step;
+        clock.droppedSeconds += dropped;
+        clock.accumulator -= dropped;
+        substeps = clock.maxSubsteps;
+    }
+    clock.accumulator -= substeps * clock.step;
+    clock.alpha = std::min(1.f, std::max(0.f, static_cast<float>(clock.accumulator / clock.step)));
+    clock.steps += substeps;
+    return substeps;
+}
+
+// One fixed step of everything the simulation does, so the same step can run
+// from the window loop or headless. spawnPosition stands in for the mouse
+// while the left button is held. Emitters expire and spawn in the spawn
+// stage too.
+void simulateStep(ParticleStore& particles, std::vector<attractive_particle>& attractive_particles, bool spawning, sf::Vector2i spawnPosition, frame_timings& timings) {
+    timings = frame_timings();
+    auto stage = std::chrono::steady_clock::now();
+    FRAMES++;
+    if (FRAMES >= SIMULATION_RATE) {
+        SECONDS++;
+        FRAMES = 0;
+        clearRemovedParticlesAndReallocate(particles);
+        timings.compaction = lapMilliseconds(stage);
+    }
+    // Paused steps only keep compaction on schedule. Nothing moves, so the
+    // positions are not saved either; the renderer draws x, y as they are.
+    if (PAUSED) {
+        return;
+    }
+    saveParticlePositions(particles);
+    for (auto& p : attractive_particles) {
+        p.previousPosition = p.position;
+    }
+    if (keepParticlesInMortonOrder(particles)) {
+        timings.reorder = lapMilliseconds(stage);
+    }
+    const bool mouseSpawn = spawning && FRAMES % std::max(1, SIMULATION_RATE / SPAWNS_PER_SECOND) == 0;
+    if (mouseSpawn) {
+        spawnMoreParticlesOnMousePositionRange(spawnPosition, particles);
+    }
+    if (updateParticleEmitters(particles) || mouseSpawn) {
+        timings.spawn = lapMilliseconds(stage);
+    }
+    // Collisions are detected against the positions at the start of the step,
+    // then everything is integrated, so the grid never goes stale mid-step
+    collideParticles(particles);
+    timings.collide = lapMilliseconds(stage);
+    if (SOLVE_COLLISIONS) {
+        solveParticleContacts(particles);
+        timings.solve = lapMilliseconds(stage);
+    }
+    integrateParticles(particles);
+    timings.integrate = lapMilliseconds(stage);
+    updateAttractiveParticles(attractive_particles, particles);
+    attractParticlesByGravity(particles);
+    timings.attraction = lapMilliseconds(stage);
+    settleParticles(particles);
+    timings.sleep = lapMilliseconds(stage);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <SFML/System/Vector2.hpp>
+#include <vector>
+#include "Particle.h"
+#include "ParticleStore.h"
+
+// Fixed timestep clock. Real time goes into the accumulator and comes out as
+// whole steps; what is left over, as a fraction of a step, is how far the
+// render should be interpolated past the previous state.
+typedef struct {
+    double step;
+    int maxSubsteps;
+    double accumulator;
+    float alpha;
+    long long steps;
+    // Real time thrown away by the substep cap, in seconds
+    double droppedSeconds;
+} simulation_clock;
+
+// Time spent in each stage of one simulation step, in milliseconds
+typedef struct {
+    double spawn;
+    double collide;
+    double solve;
+    double integrate;
+    double attraction;
+    double compaction;
+    double reorder;
+    double sleep;
+} frame_timings;
+
+// Functions
+void initSimulationClock(simulation_clock& clock, int rate, int maxSubsteps);
+int advanceSimulationClock(simulation_clock& clock, double elapsedSeconds);
+void simulateStep(ParticleStore& particles, std::vector<attractive_particle>& attractive_particles, bool spawning, sf::Vector2i spawnPosition, frame_timings& timings);
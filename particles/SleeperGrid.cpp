@@ -0,0 +1,93 @@
+#include "SleeperGrid.h"
+#include "Constants.h"
+#include <algorithm>
+#include <cmath>
+
+// Same cell budget as the spatial grid
+const int MIN_SLEEPER_CELLS = 1024;
+const int SLEEPER_CELLS_PER_PARTICLE = 2;
+
+// Functions
+int sleeperCell(const sleeper_grid& grid, float x, float y);
+
+// Positions outside the grid clamp to its edge cells, on insert and on query
+// alike, so particles that fall asleep after the build are still found
+int sleeperCell(const sleeper_grid& grid, float x, float y) {
+    const int column = std::min(std::max(static_cast<int>((x - grid.originX) / grid.cellSize), 0), grid.columns - 1);
+    const int row = std::min(std::max(static_cast<int>((y - grid.originY) / grid.cellSize), 0), grid.rows - 1);
+    return row * grid.columns + column;
+}
+
+// Covers every live particle, awake ones included, since they are the ones
+// that fall asleep next
+void buildSleeperGrid(sleeper_grid& grid, const ParticleStore& particles) {
+    const int n = particleCount(particles);
+    const particle_bounds bounds = liveParticleBounds(particles, n);
+    const double maxCells = std::max(MIN_SLEEPER_CELLS, bounds.alive * SLEEPER_CELLS_PER_PARTICLE);
+    grid.cellSize = MAX_RADIUS * 2.f;
+    while ((std::floor((bounds.maxX - bounds.minX) / grid.cellSize) + 1) * (std::floor((bounds.maxY - bounds.minY) / grid.cellSize) + 1) > maxCells) {
+        grid.cellSize *= 2.f;
+    }
+    grid.originX = bounds.minX;
+    grid.originY = bounds.minY;
+    grid.columns = static_cast<int>((bounds.maxX - bounds.minX) / grid.cellSize) + 1;
+    grid.rows = static_cast<int>((bounds.maxY - bounds.minY) / grid.cellSize) + 1;
+    grid.cellHead.assign(grid.columns * grid.rows, -1);
+    const int slots = static_cast<int>(particles.slotIndex.size());
+    grid.slotNext.assign(slots, -1);
+    grid.slotPrevious.assign(slots, -1);
+    grid.slotCell.assign(slots, -1);
+    for (int i = awakeParticleCount(particles); i < n; i++) {
+        insertSleeper(grid, particles, i);
+    }
+    grid.store = &particles;
+    grid.epoch = particles.sleepEpoch;
+}
+
+void insertSleeper(sleeper_grid& grid, const ParticleStore& particles, int i) {
+    const int slot = particles.slot[i];
+    if (slot >= static_cast<int>(grid.slotCell.size())) {
+        grid.slotNext.resize(slot + 1, -1);
+        grid.slotPrevious.resize(slot + 1, -1);
+        grid.slotCell.resize(slot + 1, -1);
+    }
+    const int cell = sleeperCell(grid, particles.x[i], particles.y[i]);
+    grid.slotCell[slot] = cell;
+    grid.slotPrevious[slot] = -1;
+    grid.slotNext[slot] = grid.cellHead[cell];
+    if (grid.cellHead[cell] >= 0) {
+        grid.slotPrevious[grid.cellHead[cell]] = slot;
+    }
+    grid.cellHead[cell] = slot;
+}
+
+void removeSleeper(sleeper_grid& grid, int slot) {
+    const int previous = grid.slotPrevious[slot];
+    const int next = grid.slotNext[slot];
+    if (previous >= 0) {
+        grid.slotNext[previous] = next;
+    }
+    else {
+        grid.cellHead[grid.slotCell[slot]] = next;
+    }
+    if (next >= 0) {
+        grid.slotPrevious[next] = previous;
+    }
+    grid.slotCell[slot] = -1;
+}
+
+// Appends the index of every sleeper in the cells the box around (x, y)
+// covers; callers run their exact test on what comes back
+void sleepersNear(const sleeper_grid& grid, const ParticleStore& particles, float x, float y, float reach, std::vector<int>& found) {
+    const int first = sleeperCell(grid, x - reach, y - reach);
+    const int last = sleeperCell(grid, x + reach, y + reach);
+    const int firstColumn = first % grid.columns;
+    const int lastColumn = last % grid.columns;
+    for (int row = first / grid.columns; row <= last / grid.columns; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            for (int slot = grid.cellHead[row * grid.columns + column]; slot >= 0; slot = grid.slotNext[slot]) {
+                found.push_back(particles.slotIndex[slot]);
+            }
+        }
+    }
+}
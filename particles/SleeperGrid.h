@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include "ParticleStore.h"
+
+// Sleeping particles by cell, so awake particles and attractors can find the
+// sleepers they touch without the sleepers being in any per frame structure.
+// Cells hold doubly linked lists through slots, so particles fall asleep and
+// wake in O(1) and index changes do not matter. Sleepers never move; the grid
+// only has to be rebuilt when the store's sleepers changed behind its back,
+// which epoch tells, or when it is asked about another store: copies of a
+// store share its epoch.
+typedef struct {
+    float cellSize;
+    float originX;
+    float originY;
+    int columns;
+    int rows;
+    // First slot per cell, -1 when empty
+    std::vector<int> cellHead;
+    // Per slot, -1 at the ends
+    std::vector<int> slotNext;
+    std::vector<int> slotPrevious;
+    std::vector<int> slotCell;
+    const ParticleStore* store;
+    unsigned int epoch;
+} sleeper_grid;
+
+// Running totals, for the HUD and the benchmark
+typedef struct {
+    int fellAsleep;
+    int woken;
+} sleep_stats;
+
+// Functions
+void buildSleeperGrid(sleeper_grid& grid, const ParticleStore& particles);
+void insertSleeper(sleeper_grid& grid, const ParticleStore& particles, int i);
+void removeSleeper(sleeper_grid& grid, int slot);
+void sleepersNear(const sleeper_grid& grid, const ParticleStore& particles, float x, float y, float reach, std::vector<int>& found);
@@ -0,0 +1,339 @@
+#include "Snapshot.h"
+#include "Constants.h"
+#include "Particles.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// File layout, native byte order: the header, then each column of
+// SNAPSHOT_COLUMNS in order, each starting on a SNAPSHOT_ALIGNMENT boundary
+// at the offset the header gives, then the attractors. Bump SNAPSHOT_VERSION
+// on any change; older files are refused rather than misread.
+const char SNAPSHOT_MAGIC[8] = {'P', 'A', 'R', 'T', 'S', 'N', 'A', 'P'};
+const unsigned int SNAPSHOT_VERSION = 1;
+const unsigned long long SNAPSHOT_ALIGNMENT = 64;
+const int SNAPSHOT_COLUMNS = 9;
+// Columns whose values are checked on load, in SNAPSHOT_COLUMNS order
+const int SNAPSHOT_RADIUS_COLUMN = 4;
+const int SNAPSHOT_COLOR_COLUMN = 8;
+
+// Types
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int headerBytes;
+    unsigned long long particles;
+    unsigned long long attractors;
+    unsigned long long columnOffset[SNAPSHOT_COLUMNS];
+    unsigned long long attractorOffset;
+    unsigned long long fileBytes;
+    float time;
+    int seconds;
+    int frames;
+    int lastAttractiveParticleId;
+    unsigned int random[4];
+    unsigned char gravity;
+    unsigned char freezeOnCollapse;
+    unsigned char freezeOnBorderCollapse;
+    unsigned char padding[5];
+} snapshot_header;
+
+// attractive_particle with a fixed layout, 4 byte fields only
+typedef struct {
+    int id;
+    int removed;
+    float radius;
+    float attractionRadius;
+    float attractionX;
+    float attractionY;
+    float x;
+    float y;
+    float previousX;
+    float previousY;
+    float vx;
+    float vy;
+} snapshot_attractor;
+
+// A read only view of a whole file
+typedef struct {
+    const unsigned char* data;
+    unsigned long long size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} mapped_file;
+
+// Functions
+unsigned long long alignSnapshotOffset(unsigned long long offset);
+void snapshotColumns(const ParticleStore& particles, const void* data[SNAPSHOT_COLUMNS], int elementBytes[SNAPSHOT_COLUMNS]);
+bool snapshotRangeValid(unsigned long long offset, unsigned long long count, unsigned long long elementBytes, unsigned long long size);
+bool snapshotValuesValid(const mapped_file& file, const snapshot_header& header);
+bool mapFile(const char* path, mapped_file& file);
+void unmapFile(mapped_file& file);
+
+unsigned long long alignSnapshotOffset(unsigned long long offset) {
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+// The stored columns, in file order. Slots are not stored, a load hands out
+// new ones.
+void snapshotColumns(const ParticleStore& particles, const void* data[SNAPSHOT_COLUMNS], int elementBytes[SNAPSHOT_COLUMNS]) {
+    const void* columns[SNAPSHOT_COLUMNS] = {
+        particles.x.data(), particles.y.data(), particles.vx.data(), particles.vy.data(), particles.radius.data(),
+        particles.previousX.data(), particles.previousY.data(), particles.flags.data(), particles.colorIndex.data()
+    };
+    const int bytes[SNAPSHOT_COLUMNS] = {4, 4, 4, 4, 4, 4, 4, 1, 1};
+    for (int c = 0; c < SNAPSHOT_COLUMNS; c++) {
+        data[c] = columns[c];
+        elementBytes[c] = bytes[c];
+    }
+}
+
+bool saveSnapshot(const char* path, const ParticleStore& particles, const std::vector<attractive_particle>& attractive_particles) {
+    const unsigned long long n = particleCount(particles);
+    const void* columns[SNAPSHOT_COLUMNS];
+    int elementBytes[SNAPSHOT_COLUMNS];
+    snapshotColumns(particles, columns, elementBytes);
+
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerBytes = sizeof(header);
+    header.particles = n;
+    header.attractors = attractive_particles.size();
+    unsigned long long offset = sizeof(header);
+    for (int c = 0; c < SNAPSHOT_COLUMNS; c++) {
+        offset = alignSnapshotOffset(offset);
+        header.columnOffset[c] = offset;
+        offset += n * elementBytes[c];
+    }
+    header.attractorOffset = alignSnapshotOffset(offset);
+    header.fileBytes = header.attractorOffset + header.attractors * sizeof(snapshot_attractor);
+    header.time = TIME;
+    header.seconds = SECONDS;
+    header.frames = FRAMES;
+    header.lastAttractiveParticleId = LAST_ATTRACTIVE_PARTICLE_ID;
+    memcpy(header.random, threadRandomStream().s, sizeof(header.random));
+    header.gravity = GRAVITY_ENABLED;
+    header.freezeOnCollapse = FREEZE_PARTICLES_ON_COLLAPSE;
+    header.freezeOnBorderCollapse = FREEZE_PARTICLES_ON_BORDER_COLLAPSE;
+
+    std::vector<snapshot_attractor> attractors(attractive_particles.size());
+    for (size_t a = 0; a < attractive_particles.size(); a++) {
+        const attractive_particle& p = attractive_particles[a];
+        snapshot_attractor& out = attractors[a];
+        out.id = p.id;
+        out.removed = p.removed;
+        out.radius = p.radius;
+        out.attractionRadius = p.attractionRadius;
+        out.attractionX = p.attraction.x;
+        out.attractionY = p.attraction.y;
+        out.x = p.position.x;
+        out.y = p.position.y;
+        out.previousX = p.previousPosition.x;
+        out.previousY = p.previousPosition.y;
+        out.vx = p.velocity.x;
+        out.vy = p.velocity.y;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot write snapshot '%s'\n", path);
+        return false;
+    }
+    const char zeros[SNAPSHOT_ALIGNMENT] = {0};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    offset = sizeof(header);
+    for (int c = 0; c < SNAPSHOT_COLUMNS && written; c++) {
+        written = fwrite(zeros, 1, header.columnOffset[c] - offset, file) == header.columnOffset[c] - offset
+            && fwrite(columns[c], elementBytes[c], n, file) == n;
+        offset = header.columnOffset[c] + n * elementBytes[c];
+    }
+    written = written && fwrite(zeros, 1, header.attractorOffset - offset, file) == header.attractorOffset - offset
+        && fwrite(attractors.data(), sizeof(snapshot_attractor), attractors.size(), file) == attractors.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        fprintf(stderr, "cannot write snapshot '%s'\n", path);
+    }
+    return written;
+}
+
+// The store and attractors are only replaced once the whole file checks out
+bool loadSnapshot(const char* path, ParticleStore& particles, std::vector<attractive_particle>& attractive_particles) {
+    mapped_file file;
+    if (!mapFile(path, file)) {
+        fprintf(stderr, "cannot read snapshot '%s'\n", path);
+        return false;
+    }
+    snapshot_header header;
+    bool valid = file.size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, file.data, sizeof(header));
+        valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0;
+    }
+    if (valid && header.version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "snapshot '%s' is version %u, this build reads version %u\n", path, header.version, SNAPSHOT_VERSION);
+        unmapFile(file);
+        return false;
+    }
+    if (valid && header.headerBytes != sizeof(header)) {
+        fprintf(stderr, "snapshot '%s' has a %u byte header, this build reads %u bytes\n", path, header.headerBytes,
+            static_cast<unsigned int>(sizeof(header)));
+        unmapFile(file);
+        return false;
+    }
+    valid = valid && header.fileBytes == file.size && header.particles <= 0x7FFFFFFF
+        && snapshotRangeValid(header.attractorOffset, header.attractors, sizeof(snapshot_attractor), file.size);
+    const void* ignored[SNAPSHOT_COLUMNS];
+    int elementBytes[SNAPSHOT_COLUMNS];
+    snapshotColumns(particles, ignored, elementBytes);
+    for (int c = 0; c < SNAPSHOT_COLUMNS && valid; c++) {
+        valid = header.columnOffset[c] % SNAPSHOT_ALIGNMENT == 0 && snapshotRangeValid(header.columnOffset[c], header.particles, elementBytes[c], file.size);
+    }
+    valid = valid && snapshotValuesValid(file, header);
+    if (!valid) {
+        fprintf(stderr, "'%s' is not a valid snapshot\n", path);
+        unmapFile(file);
+        return false;
+    }
+
+    const int n = static_cast<int>(header.particles);
+    clearParticleStore(particles);
+    resetParticleSchedules();
+    reserveParticles(particles, n);
+    appendParticles(particles, n);
+    void* columns[SNAPSHOT_COLUMNS] = {
+        particles.x.data(), particles.y.data(), particles.vx.data(), particles.vy.data(), particles.radius.data(),
+        particles.previousX.data(), particles.previousY.data(), particles.flags.data(), particles.colorIndex.data()
+    };
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int c = 0; c < SNAPSHOT_COLUMNS; c++) {
+            memcpy(static_cast<unsigned char*>(columns[c]) + static_cast<size_t>(begin) * elementBytes[c],
+                file.data + header.columnOffset[c] + static_cast<size_t>(begin) * elementBytes[c],
+                static_cast<size_t>(end - begin) * elementBytes[c]);
+        }
+    });
+
+    attractive_particles.resize(header.attractors);
+    for (size_t a = 0; a < attractive_particles.size(); a++) {
+        snapshot_attractor in;
+        memcpy(&in, file.data + header.attractorOffset + a * sizeof(snapshot_attractor), sizeof(in));
+        attractive_particle& p = attractive_particles[a];
+        p.id = in.id;
+        p.removed = in.removed != 0;
+        p.radius = in.radius;
+        p.attractionRadius = in.attractionRadius;
+        p.attraction = sf::Vector2f(in.attractionX, in.attractionY);
+        p.position = sf::Vector2f(in.x, in.y);
+        p.previousPosition = sf::Vector2f(in.previousX, in.previousY);
+        p.velocity = sf::Vector2f(in.vx, in.vy);
+    }
+    TIME = header.time;
+    SECONDS = header.seconds;
+    FRAMES = header.frames;
+    LAST_ATTRACTIVE_PARTICLE_ID = header.lastAttractiveParticleId;
+    memcpy(threadRandomStream().s, header.random, sizeof(header.random));
+    GRAVITY_ENABLED = header.gravity != 0;
+    FREEZE_PARTICLES_ON_COLLAPSE = header.freezeOnCollapse != 0;
+    FREEZE_PARTICLES_ON_BORDER_COLLAPSE = header.freezeOnBorderCollapse != 0;
+    unmapFile(file);
+    return true;
+}
+
+// Whether count elements from offset fit in size bytes, without letting the
+// sums wrap around
+bool snapshotRangeValid(unsigned long long offset, unsigned long long count, unsigned long long elementBytes, unsigned long long size) {
+    return offset <= size && count <= (size - offset) / elementBytes;
+}
+
+// Radii and colours index into fixed tables and bound the broad phases'
+// reach, so a file with any out of range is refused before anything is
+// replaced. NaN radii fail the comparison too. Column ranges must have been
+// checked already.
+bool snapshotValuesValid(const mapped_file& file, const snapshot_header& header) {
+    const float* radius = reinterpret_cast<const float*>(file.data + header.columnOffset[SNAPSHOT_RADIUS_COLUMN]);
+    const unsigned char* colorIndex = file.data + header.columnOffset[SNAPSHOT_COLOR_COLUMN];
+    std::atomic<bool> valid(true);
+    parallelFor(static_cast<int>(header.particles), PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end && valid; i++) {
+            if (!(radius[i] > 0 && radius[i] <= MAX_RADIUS) || colorIndex[i] >= COLORS_LENGTH) {
+                valid = false;
+            }
+        }
+    });
+    return valid;
+}
+
+bool mapFile(const char* path, mapped_file& file) {
+    file.data = nullptr;
+    file.size = 0;
+#if defined(_WIN32)
+    file.mapping = nullptr;
+    file.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file.file, &size) || size.QuadPart == 0) {
+        CloseHandle(file.file);
+        return false;
+    }
+    file.size = size.QuadPart;
+    file.mapping = CreateFileMappingA(file.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file.mapping == nullptr) {
+        CloseHandle(file.file);
+        return false;
+    }
+    file.data = static_cast<const unsigned char*>(MapViewOfFile(file.mapping, FILE_MAP_READ, 0, 0, 0));
+    if (file.data == nullptr) {
+        CloseHandle(file.mapping);
+        CloseHandle(file.file);
+        return false;
+    }
+    return true;
+#else
+    const int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close(descriptor);
+        return false;
+    }
+    file.size = status.st_size;
+    void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, file.size, MADV_SEQUENTIAL);
+    file.data = static_cast<const unsigned char*>(data);
+    return true;
+#endif
+}
+
+void unmapFile(mapped_file& file) {
+#if defined(_WIN32)
+    UnmapViewOfFile(file.data);
+    CloseHandle(file.mapping);
+    CloseHandle(file.file);
+#else
+    munmap(const_cast<unsigned char*>(file.data), file.size);
+#endif
+    file.data = nullptr;
+}
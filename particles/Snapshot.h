@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+#include "Particle.h"
+#include "ParticleStore.h"
+
+// Binary snapshots of the whole world: every particle column, the
+// attractors, the simulation settings and clock, and the random stream of
+// the calling thread, so a loaded run carries on exactly like the saved one
+// would have. Columns are stored one after the other, so saving is one write
+// per column and loading maps the file and copies columns in bulk, in
+// parallel, with no per-particle parsing. Handles do not survive a load.
+const char* const SNAPSHOT_PATH = "particles.snapshot";
+
+// Functions
+bool saveSnapshot(const char* path, const ParticleStore& particles, const std::vector<attractive_particle>& attractive_particles);
+bool loadSnapshot(const char* path, ParticleStore& particles, std::vector<attractive_particle>& attractive_particles);
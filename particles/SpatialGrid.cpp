@@ -0,0 +1,80 @@
+#include "SpatialGrid.h"
+#include "Constants.h"
+#include <algorithm>
+#include <cmath>
+
+// Keeps sparse scenes (a few particles spread far off screen) from allocating
+// millions of empty cells: past this budget the cells grow instead.
+const int MIN_GRID_CELLS = 1024;
+const int GRID_CELLS_PER_PARTICLE = 2;
+
+int spatialGridColumn(const spatial_grid& grid, float x) {
+    int column = static_cast<int>((x - grid.originX) / grid.cellSize);
+    return std::min(std::max(column, 0), grid.columns - 1);
+}
+
+int spatialGridRow(const spatial_grid& grid, float y) {
+    int row = static_cast<int>((y - grid.originY) / grid.cellSize);
+    return std::min(std::max(row, 0), grid.rows - 1);
+}
+
+void buildSpatialGrid(spatial_grid& grid, const ParticleStore& particles) {
+    const int n = awakeParticleCount(particles);
+    float minX = 0.f;
+    float minY = 0.f;
+    float maxX = 0.f;
+    float maxY = 0.f;
+    int alive = 0;
+    for (int i = 0; i < n; i++) {
+        if (particles.flags[i] & PARTICLE_REMOVED) {
+            continue;
+        }
+        if (alive == 0) {
+            minX = maxX = particles.x[i];
+            minY = maxY = particles.y[i];
+        }
+        minX = std::min(minX, particles.x[i]);
+        minY = std::min(minY, particles.y[i]);
+        maxX = std::max(maxX, particles.x[i]);
+        maxY = std::max(maxY, particles.y[i]);
+        alive++;
+    }
+
+    const float width = maxX - minX;
+    const float height = maxY - minY;
+    const double maxCells = std::max(MIN_GRID_CELLS, alive * GRID_CELLS_PER_PARTICLE);
+    grid.cellSize = MAX_RADIUS * 2.f;
+    while ((std::floor(width / grid.cellSize) + 1) * (std::floor(height / grid.cellSize) + 1) > maxCells) {
+        grid.cellSize *= 2.f;
+    }
+    grid.originX = minX;
+    grid.originY = minY;
+    grid.columns = static_cast<int>(width / grid.cellSize) + 1;
+    grid.rows = static_cast<int>(height / grid.cellSize) + 1;
+
+    // Counting sort of particle indices by cell. Entries inside a cell stay in
+    // ascending index order, which particleContacts relies on.
+    const int cells = grid.columns * grid.rows;
+    grid.cellStart.assign(cells + 1, 0);
+    grid.particleCell.resize(n);
+    grid.cellParticles.resize(alive);
+    for (int i = 0; i < n; i++) {
+        if (particles.flags[i] & PARTICLE_REMOVED) {
+            grid.particleCell[i] = -1;
+            continue;
+        }
+        int cell = spatialGridRow(grid, particles.y[i]) * grid.columns + spatialGridColumn(grid, particles.x[i]);
+        grid.particleCell[i] = cell;
+        grid.cellStart[cell + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        grid.cellStart[c + 1] += grid.cellStart[c];
+    }
+    grid.cellFill.assign(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    for (int i = 0; i < n; i++) {
+        int cell = grid.particleCell[i];
+        if (cell >= 0) {
+            grid.cellParticles[grid.cellFill[cell]++] = i;
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include "ParticleStore.h"
+
+// Uniform grid broad phase over the awake particles, rebuilt every frame.
+// Cells are one max particle diameter wide, so two overlapping particles
+// always sit in the same cell or in one of its 8 neighbours.
+typedef struct {
+    float cellSize;
+    float originX;
+    float originY;
+    int columns;
+    int rows;
+    std::vector<int> cellStart;
+    std::vector<int> cellFill;
+    std::vector<int> cellParticles;
+    std::vector<int> particleCell;
+} spatial_grid;
+
+// Functions
+void buildSpatialGrid(spatial_grid& grid, const ParticleStore& particles);
+int spatialGridColumn(const spatial_grid& grid, float x);
+int spatialGridRow(const spatial_grid& grid, float y);
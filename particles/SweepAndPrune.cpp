@@ -0,0 +1,94 @@
+#include "SweepAndPrune.h"
+#include "Particle.h"
+#include <algorithm>
+#include <cmath>
+
+// Slack on the sweep bound so float rounding of x - radius and x + radius
+// never cuts off a pair the exact distance test would accept
+const float SWEEP_PAD = 0.01f;
+
+// Functions
+bool sweepEntryBefore(const sweep_entry& a, const sweep_entry& b);
+
+bool sweepEntryBefore(const sweep_entry& a, const sweep_entry& b) {
+    return a.key < b.key;
+}
+
+// Drops removed and sleeping particles and restores the order by x - radius with insertion
+// sort. New particles are sorted on their own and merged in, so a first
+// update or a big spawn does not go quadratic.
+void updateSweepAndPrune(sweep_and_prune& sweep, const ParticleStore& particles) {
+    sweep.slotListed.resize(particles.slotIndex.size(), 0);
+    int kept = 0;
+    for (int s = 0; s < static_cast<int>(sweep.entries.size()); s++) {
+        sweep_entry entry = sweep.entries[s];
+        entry.index = particleIndex(particles, entry.handle);
+        if (entry.index < 0 || entry.index >= awakeParticleCount(particles) || (particles.flags[entry.index] & PARTICLE_REMOVED)) {
+            sweep.slotListed[entry.handle.slot] = 0;
+            continue;
+        }
+        entry.key = particles.x[entry.index] - particles.radius[entry.index];
+        sweep.entries[kept++] = entry;
+    }
+    sweep.entries.resize(kept);
+    for (int s = 1; s < kept; s++) {
+        const sweep_entry entry = sweep.entries[s];
+        int t = s - 1;
+        while (t >= 0 && sweep.entries[t].key > entry.key) {
+            sweep.entries[t + 1] = sweep.entries[t];
+            t--;
+        }
+        sweep.entries[t + 1] = entry;
+    }
+
+    const int n = awakeParticleCount(particles);
+    for (int i = 0; i < n; i++) {
+        if ((particles.flags[i] & PARTICLE_REMOVED) || sweep.slotListed[particles.slot[i]]) {
+            continue;
+        }
+        sweep.slotListed[particles.slot[i]] = 1;
+        sweep_entry entry;
+        entry.key = particles.x[i] - particles.radius[i];
+        entry.index = i;
+        entry.handle = particleHandle(particles, i);
+        sweep.entries.push_back(entry);
+    }
+    if (static_cast<int>(sweep.entries.size()) > kept) {
+        std::sort(sweep.entries.begin() + kept, sweep.entries.end(), sweepEntryBefore);
+        sweep.merged.resize(sweep.entries.size());
+        std::merge(sweep.entries.begin(), sweep.entries.begin() + kept, sweep.entries.begin() + kept, sweep.entries.end(),
+            sweep.merged.begin(), sweepEntryBefore);
+        sweep.entries.swap(sweep.merged);
+    }
+}
+
+// One pass over the sorted order: each particle is only tested against the
+// ones whose x interval starts before its own ends. Overlap is the same
+// distance test as particleContacts, behind a cheap y reject that can only
+// drop pairs the distance test would drop too. Contacts come out in sweep
+// order.
+void sweepOverlappingPairs(const sweep_and_prune& sweep, const ParticleStore& particles, std::vector<particle_contact>& contacts) {
+    contacts.clear();
+    const int count = static_cast<int>(sweep.entries.size());
+    for (int s = 0; s < count; s++) {
+        const int i = sweep.entries[s].index;
+        const sf::Vector2f position(particles.x[i], particles.y[i]);
+        const float radius = particles.radius[i];
+        const float end = position.x + radius + SWEEP_PAD;
+        for (int t = s + 1; t < count && sweep.entries[t].key < end; t++) {
+            const int other = sweep.entries[t].index;
+            const float reach = radius + particles.radius[other];
+            if (std::fabs(position.y - particles.y[other]) >= reach) {
+                continue;
+            }
+            float distance = distanceBetweenTwoPoints(position, sf::Vector2f(particles.x[other], particles.y[other]));
+            if (distance < reach) {
+                particle_contact contact;
+                contact.a = std::min(i, other);
+                contact.b = std::max(i, other);
+                contact.distance = distance;
+                contacts.push_back(contact);
+            }
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include "Particle.h"
+#include "ParticleStore.h"
+
+// Entry of the sweep order; index and key are refreshed every update
+typedef struct {
+    float key;
+    int index;
+    particle_handle handle;
+} sweep_entry;
+
+// Sweep and prune broad phase along x. Particles stay sorted by x - radius
+// from one frame to the next and are re-sorted with insertion sort, which is
+// close to linear because they only move a few pixels per step. Entries are
+// kept by handle so compaction and removals do not lose the order.
+typedef struct {
+    std::vector<sweep_entry> entries;
+    // Scratch the new entries are merged in through, kept between updates
+    std::vector<sweep_entry> merged;
+    // Per slot, 1 while the slot's particle is in entries
+    std::vector<unsigned char> slotListed;
+} sweep_and_prune;
+
+// Functions
+void updateSweepAndPrune(sweep_and_prune& sweep, const ParticleStore& particles);
+void sweepOverlappingPairs(const sweep_and_prune& sweep, const ParticleStore& particles, std::vector<particle_contact>& contacts);
@@ -0,0 +1,164 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Chunks per thread a parallelFor is cut into when the grain allows it, so a
+// thread that finishes early has something left to steal. No queue is ever
+// handed more than that at once.
+const int CHUNKS_PER_THREAD = 8;
+
+// Types
+typedef struct {
+    const parallel_body* body;
+    int begin;
+    int end;
+} pool_task;
+
+// A fixed ring of tasks, so queueing never allocates: tasks[first] is the
+// front and count tasks follow it
+typedef struct {
+    std::mutex mutex;
+    pool_task tasks[CHUNKS_PER_THREAD];
+    int first = 0;
+    int count = 0;
+} worker_queue;
+
+// Pool state. Queue 0 belongs to the thread calling parallelFor, which works
+// through chunks too instead of blocking.
+std::vector<std::thread> POOL_WORKERS;
+std::unique_ptr<worker_queue[]> POOL_QUEUES;
+int POOL_SIZE = 1;
+bool POOL_RUNNING = false;
+std::atomic<int> POOL_QUEUED(0);
+std::atomic<int> POOL_PENDING(0);
+std::mutex POOL_WAKE_MUTEX;
+std::condition_variable POOL_WAKE;
+
+// Functions
+bool popTask(int queue, pool_task& task);
+bool stealTask(int queue, pool_task& task);
+void runTask(const pool_task& task);
+void workerLoop(int queue);
+
+// Owners take from the back of their own deque
+bool popTask(int queue, pool_task& task) {
+    worker_queue& q = POOL_QUEUES[queue];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.count == 0) {
+        return false;
+    }
+    q.count--;
+    task = q.tasks[(q.first + q.count) % CHUNKS_PER_THREAD];
+    POOL_QUEUED--;
+    return true;
+}
+
+// Thieves take from the front of the others' deques
+bool stealTask(int queue, pool_task& task) {
+    for (int offset = 1; offset < POOL_SIZE; offset++) {
+        worker_queue& q = POOL_QUEUES[(queue + offset) % POOL_SIZE];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.count == 0) {
+            continue;
+        }
+        task = q.tasks[q.first];
+        q.first = (q.first + 1) % CHUNKS_PER_THREAD;
+        q.count--;
+        POOL_QUEUED--;
+        return true;
+    }
+    return false;
+}
+
+void runTask(const pool_task& task) {
+    task.body->call(task.body->context, task.begin, task.end);
+    POOL_PENDING--;
+}
+
+void workerLoop(int queue) {
+    while (true) {
+        pool_task task;
+        if (popTask(queue, task) || stealTask(queue, task)) {
+            runTask(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(POOL_WAKE_MUTEX);
+        POOL_WAKE.wait(lock, [] { return !POOL_RUNNING || POOL_QUEUED > 0; });
+        if (!POOL_RUNNING) {
+            return;
+        }
+    }
+}
+
+// threads counts the calling thread; 0 means one per hardware thread
+void startThreadPool(int threads) {
+    stopThreadPool();
+    if (threads <= 0) {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    POOL_SIZE = threads;
+    POOL_QUEUES.reset(new worker_queue[threads]);
+    POOL_RUNNING = true;
+    for (int queue = 1; queue < threads; queue++) {
+        POOL_WORKERS.push_back(std::thread(workerLoop, queue));
+    }
+}
+
+void stopThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(POOL_WAKE_MUTEX);
+        POOL_RUNNING = false;
+    }
+    POOL_WAKE.notify_all();
+    for (auto& worker : POOL_WORKERS) {
+        worker.join();
+    }
+    POOL_WORKERS.clear();
+    POOL_SIZE = 1;
+}
+
+int threadPoolSize() {
+    return POOL_SIZE;
+}
+
+// Runs body over [0, n) in chunks of at least `grain` and returns once every
+// chunk is done. Chunks write disjoint ranges, so results do not depend on
+// which thread ran what. Not reentrant: body must not call parallelFor.
+void runParallelFor(int n, int grain, const parallel_body& body) {
+    if (POOL_WORKERS.empty() || n <= grain) {
+        body.call(body.context, 0, n);
+        return;
+    }
+    const int chunk = std::max(grain, (n + POOL_SIZE * CHUNKS_PER_THREAD - 1) / (POOL_SIZE * CHUNKS_PER_THREAD));
+    const int chunks = (n + chunk - 1) / chunk;
+    POOL_PENDING += chunks;
+    for (int c = 0; c < chunks; c++) {
+        pool_task task;
+        task.body = &body;
+        task.begin = c * chunk;
+        task.end = std::min(n, task.begin + chunk);
+        worker_queue& q = POOL_QUEUES[c % POOL_SIZE];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks[(q.first + q.count) % CHUNKS_PER_THREAD] = task;
+        q.count++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(POOL_WAKE_MUTEX);
+        POOL_QUEUED += chunks;
+    }
+    POOL_WAKE.notify_all();
+    while (POOL_PENDING > 0) {
+        pool_task task;
+        if (popTask(0, task) || stealTask(0, task)) {
+            runTask(task);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Smallest chunk of particles handed to a worker. Below this the cost of
+// queueing a chunk is no longer small next to the work in it.
+const int PARALLEL_GRAIN = 4096;
+
+// The body of a parallelFor without its type. It only points at the caller's
+// lambda, so unlike a std::function it never allocates however much the
+// lambda captures.
+typedef struct {
+    const void* context;
+    void (*call)(const void* context, int begin, int end);
+} parallel_body;
+
+// Functions
+void startThreadPool(int threads);
+void stopThreadPool();
+int threadPoolSize();
+void runParallelFor(int n, int grain, const parallel_body& body);
+
+// Runs body(begin, end) over [0, n), see runParallelFor
+template <typename Body>
+void parallelFor(int n, int grain, const Body& body) {
+    parallel_body erased;
+    erased.context = &body;
+    erased.call = [](const void* context, int begin, int end) {
+        (*static_cast<const Body*>(context))(begin, end);
+    };
+    runParallelFor(n, grain, erased);
+}
@@ -0,0 +1,143 @@
+#include "VerletList.h"
+#include "Constants.h"
+#include "Particle.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// Slack on the candidate test, so float rounding never drops a pair that
+// could overlap before the next rebuild
+const float VERLET_PAD = 0.01f;
+
+// Functions
+template <typename Visit>
+void forEachVerletCandidate(const ParticleStore& particles, const spatial_grid& grid, float skin, int i, Visit visit);
+
+// False once a particle has moved more than skin / 2 since the last rebuild,
+// or the store no longer holds the same particles at the same indices
+bool verletListValid(const verlet_list& list, const ParticleStore& particles, float skin) {
+    const int n = awakeParticleCount(particles);
+    if (list.skin != skin || static_cast<int>(list.builtSlot.size()) != n) {
+        return false;
+    }
+    const float limit = skin * 0.5f;
+    std::atomic<bool> valid(true);
+    parallelFor(n, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end && valid; i++) {
+            const float dx = particles.x[i] - list.builtX[i];
+            const float dy = particles.y[i] - list.builtY[i];
+            if (particles.slot[i] != list.builtSlot[i] || dx * dx + dy * dy > limit * limit) {
+                valid = false;
+            }
+        }
+    });
+    return valid;
+}
+
+// Calls visit(other) for every earlier live particle within
+// r1 + r2 + skin of particle i, in no particular order. Only the cells the
+// reach box covers are visited, however the grid cell size compares to it.
+template <typename Visit>
+void forEachVerletCandidate(const ParticleStore& particles, const spatial_grid& grid, float skin, int i, Visit visit) {
+    const float x = particles.x[i];
+    const float y = particles.y[i];
+    const float radius = particles.radius[i];
+    const float box = radius + MAX_RADIUS + skin + VERLET_PAD;
+    const int firstColumn = spatialGridColumn(grid, x - box);
+    const int lastColumn = spatialGridColumn(grid, x + box);
+    const int firstRow = spatialGridRow(grid, y - box);
+    const int lastRow = spatialGridRow(grid, y + box);
+    for (int r = firstRow; r <= lastRow; r++) {
+        for (int c = firstColumn; c <= lastColumn; c++) {
+            const int cell = r * grid.columns + c;
+            for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+                const int other = grid.cellParticles[k];
+                if (other >= i) {
+                    break;
+                }
+                const float reach = radius + particles.radius[other] + skin + VERLET_PAD;
+                const float dx = particles.x[other] - x;
+                const float dy = particles.y[other] - y;
+                if (dx * dx + dy * dy <= reach * reach) {
+                    visit(other);
+                }
+            }
+        }
+    }
+}
+
+// One parallel pass over fixed blocks of particles: each block gathers and
+// sorts its particles' lists into its own buffer, then the buffers are
+// copied into place once the counts give every list its offset
+void buildVerletList(verlet_list& list, const ParticleStore& particles, const spatial_grid& grid, float skin) {
+    const int n = awakeParticleCount(particles);
+    const int blocks = (n + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+    list.skin = skin;
+    // Per particle arrays follow the store's reservation, so a live count
+    // that grows within it does not reallocate them on a rebuild
+    const size_t reserved = particles.x.capacity();
+    list.start.reserve(reserved + 1);
+    list.builtSlot.reserve(reserved);
+    list.builtX.reserve(reserved);
+    list.builtY.reserve(reserved);
+    list.start.assign(n + 1, 0);
+    list.blockCandidates.resize(std::max(blocks, static_cast<int>(list.blockCandidates.size())));
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            std::vector<int>& buffer = list.blockCandidates[b];
+            buffer.clear();
+            for (int i = b * PARALLEL_GRAIN; i < std::min(n, (b + 1) * PARALLEL_GRAIN); i++) {
+                if (particles.flags[i] & PARTICLE_REMOVED) {
+                    continue;
+                }
+                const size_t first = buffer.size();
+                forEachVerletCandidate(particles, grid, skin, i, [&](int other) { buffer.push_back(other); });
+                std::sort(buffer.begin() + first, buffer.end());
+                list.start[i + 1] = static_cast<int>(buffer.size() - first);
+            }
+        }
+    });
+    list.maxCandidates = 0;
+    for (int i = 0; i < n; i++) {
+        list.maxCandidates = std::max(list.maxCandidates, list.start[i + 1]);
+        list.start[i + 1] += list.start[i];
+    }
+    list.candidates.resize(list.start[n]);
+    parallelFor(blocks, 1, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            const std::vector<int>& buffer = list.blockCandidates[b];
+            std::copy(buffer.begin(), buffer.end(), list.candidates.begin() + list.start[b * PARALLEL_GRAIN]);
+        }
+    });
+    list.builtSlot.assign(particles.slot.begin(), particles.slot.begin() + n);
+    list.builtX.assign(particles.x.begin(), particles.x.begin() + n);
+    list.builtY.assign(particles.y.begin(), particles.y.begin() + n);
+    list.rebuilds++;
+}
+
+// Appends a contact with every earlier particle overlapping particle i, in
+// ascending order; the same exact test particleContacts runs on the grid
+void verletListContacts(const verlet_list& list, const ParticleStore& particles, int i, std::vector<particle_contact>& contacts) {
+    const sf::Vector2f position(particles.x[i], particles.y[i]);
+    const float radius = particles.radius[i];
+    for (int k = list.start[i]; k < list.start[i + 1]; k++) {
+        const int other = list.candidates[k];
+        if (particles.flags[other] & PARTICLE_REMOVED) {
+            continue;
+        }
+        float distance = distanceBetweenTwoPoints(position, sf::Vector2f(particles.x[other], particles.y[other]));
+        if (distance < radius + particles.radius[other]) {
+            particle_contact contact;
+            contact.a = other;
+            contact.b = i;
+            contact.distance = distance;
+            contacts.push_back(contact);
+        }
+    }
+}
+
+float verletListMeanCandidates(const verlet_list& list) {
+    const int n = static_cast<int>(list.start.size()) - 1;
+    return n > 0 ? static_cast<float>(list.candidates.size()) / n : 0.f;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include "Particle.h"
+#include "ParticleStore.h"
+#include "SpatialGrid.h"
+
+// Verlet neighbour lists. Each particle keeps the earlier particles that were
+// within r1 + r2 + skin of it at the last rebuild. While no particle has
+// moved more than skin / 2 since then, no pair outside the lists can have
+// closed the gap, so collision queries only walk the lists and the grid is
+// not touched. Any change to the store's layout (spawns, compaction,
+// reordering) also forces a rebuild.
+typedef struct {
+    float skin;
+    // Candidates of particle i are candidates[start[i], start[i + 1]), in
+    // ascending index order and all below i
+    std::vector<int> start;
+    std::vector<int> candidates;
+    // Per block of PARALLEL_GRAIN particles, reused between rebuilds and
+    // never shrunk
+    std::vector<std::vector<int>> blockCandidates;
+    // Slot and position of every index at the last rebuild
+    std::vector<int> builtSlot;
+    std::vector<float> builtX;
+    std::vector<float> builtY;
+    // Stats since the list was created
+    long long steps;
+    long long rebuilds;
+    int maxCandidates;
+} verlet_list;
+
+// Functions
+bool verletListValid(const verlet_list& list, const ParticleStore& particles, float skin);
+void buildVerletList(verlet_list& list, const ParticleStore& particles, const spatial_grid& grid, float skin);
+void verletListContacts(const verlet_list& list, const ParticleStore& particles, int i, std::vector<particle_contact>& contacts);
+float verletListMeanCandidates(const verlet_list& list);
@@ -0,0 +1,1688 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "BarnesHut.h"
+#include "Constants.h"
+#include "Emitter.h"
+#include "Fft.h"
+#include "MortonOrder.h"
+#include "Particle.h"
+#include "ParticleMesh.h"
+#include "ParticleStore.h"
+#include "Particles.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "Renderer.h"
+#include "Simd.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
+
+// Headless benchmarks, no window is ever opened.
+// Usage: particles_bench [scenario] [--particles N] [--frames N] [--seed N]
+//                        [--attractors N] [--threads N] [--gravity] [--freeze]
+//                        [--border-freeze] [--spawn] [--no-reorder]
+//                        [--simd scalar|sse2|avx2|avx512]
+//                        [--broad-phase grid|sweep|quadtree|verlet]
+//                        [--skin PIXELS] [--solve] [--iterations N]
+//                        [--restitution R] [--no-sleep] [--snapshot PATH]
+//                        [--nbody [barnes-hut|mesh]] [--theta THETA] [--field]
+//                        [--generic-kernels]
+
+// Bench scenes keep the density of a 10k particles window while N grows, so
+// the amount of broad phase work per particle stays the same.
+const float BENCH_DENSITY = 10000.f / (WINDOW_WIDTH * WINDOW_HEIGHT);
+const int BENCH_FRAMES = 10;
+// Every scenario seeds from this, --seed sets it
+int BENCH_SEED = 42;
+// Clustered scenes put the particles in a few gaussian blobs instead
+const int BENCH_CLUSTERS = 20;
+const float BENCH_CLUSTER_SPREAD = 30.f;
+// Emitters in the emitters scenario, and how long their particles live
+const int BENCH_EMITTERS = 16;
+const float BENCH_EMITTER_RATE = 30.f;
+const float BENCH_EMITTER_LIFETIME = 2.f;
+// Heap allocations by any thread, counted by the operator new below
+std::atomic<long long> BENCH_ALLOCATIONS(0);
+
+typedef struct {
+    const char* scenario;
+    int particles;
+    int frames;
+    int seed;
+    int attractors;
+    int threads;
+    bool gravity;
+    bool freeze;
+    bool borderFreeze;
+    bool spawn;
+    bool reorder;
+    bool sleep;
+    const char* snapshot;
+    int simd;
+    int broadPhase;
+} bench_options;
+
+// Layout of a particle before the ParticleStore split, only kept so the store
+// scenario can compare against it.
+typedef struct {
+    int id;
+    float radius;
+    bool freeze;
+    bool removed;
+    sf::Vector2f position;
+    sf::Vector2f velocity;
+    sf::CircleShape shape;
+} legacy_particle;
+
+// Functions
+bool parseBenchOptions(int argc, char** argv, bench_options& options);
+void spawnBenchParticles(int n, ParticleStore& particles);
+void spawnClusteredBenchParticles(int n, ParticleStore& particles);
+void driftBenchParticles(ParticleStore& particles);
+double elapsedMilliseconds(std::chrono::steady_clock::time_point start);
+void benchGrid(int maxParticles);
+void benchStore(int particlesCount);
+void benchVertices(int particlesCount);
+bool benchFrames(const bench_options& options);
+bool benchSimd(int particlesCount);
+bool benchAttractors(int particlesCount);
+bool benchBroadPhase(int particlesCount);
+bool benchQuadtree(int particlesCount);
+void benchMorton(int particlesCount);
+bool benchVerlet(int particlesCount);
+bool benchSolver(int particlesCount);
+bool benchSleep(int particlesCount, int frames);
+bool benchSpawn(int particlesCount, int threads);
+bool benchSnapshot(int particlesCount);
+bool benchProfiler(int samples);
+bool benchNbody(int particlesCount);
+bool benchMesh(int particlesCount);
+bool benchKernels(int particlesCount);
+bool benchEmitters(int particlesCount, int frames);
+bool benchDeterminism(const bench_options& options);
+unsigned long long runDeterminismScene(int particlesCount, int frames, int threads);
+unsigned long long hashParticlesBySlot(const ParticleStore& particles);
+bool sameParticlesBySlot(const ParticleStore& first, const ParticleStore& second);
+double meanContactPenetration(const ParticleStore& particles, const std::vector<particle_contact>& contacts);
+double gridCacheLinesPerQuery(const ParticleStore& particles);
+
+// Every scenario runs with these, so the emitters scenario can tell whether a
+// step allocated at all. Array and sized forms fall through to them. GCC
+// warns about free on memory from operator new wherever it inlines delete
+// next to a new, so delete is kept out of line.
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+void* operator new(size_t size) {
+    BENCH_ALLOCATIONS++;
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+BENCH_NOINLINE void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    ::operator delete(memory);
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    if (!parseBenchOptions(argc, argv, options)) {
+        return 1;
+    }
+    if (options.simd > SIMD_LEVEL) {
+        fprintf(stderr, "%s is not supported here, using %s\n", simdLevelName(options.simd), simdLevelName(SIMD_LEVEL));
+    }
+    else if (options.simd >= 0) {
+        SIMD_LEVEL = options.simd;
+    }
+    BROAD_PHASE = options.broadPhase;
+    MORTON_REORDER = options.reorder;
+    SLEEP_FROZEN_PARTICLES = options.sleep;
+    BENCH_SEED = options.seed;
+    startThreadPool(options.threads);
+    int status = 0;
+    if (strcmp(options.scenario, "frames") == 0) {
+        if (options.particles == 0) {
+            options.particles = 100000;
+        }
+        status = benchFrames(options) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "determinism") == 0) {
+        status = benchDeterminism(options) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "grid") == 0) {
+        benchGrid(options.particles > 0 ? options.particles : 1000000);
+    }
+    else if (strcmp(options.scenario, "store") == 0) {
+        benchStore(options.particles > 0 ? options.particles : 1000000);
+    }
+    else if (strcmp(options.scenario, "vertices") == 0) {
+        benchVertices(options.particles > 0 ? options.particles : 1000000);
+    }
+    else if (strcmp(options.scenario, "broadphase") == 0) {
+        status = benchBroadPhase(options.particles > 0 ? options.particles : 100000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "quadtree") == 0) {
+        status = benchQuadtree(options.particles > 0 ? options.particles : 100000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "solver") == 0) {
+        status = benchSolver(options.particles > 0 ? options.particles : 100000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "verlet") == 0) {
+        status = benchVerlet(options.particles > 0 ? options.particles : 100000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "snapshot") == 0) {
+        status = benchSnapshot(options.particles > 0 ? options.particles : 10000000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "nbody") == 0) {
+        status = benchNbody(options.particles > 0 ? options.particles : 1000000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "mesh") == 0) {
+        status = benchMesh(options.particles > 0 ? options.particles : 10000000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "kernels") == 0) {
+        status = benchKernels(options.particles > 0 ? options.particles : 1000000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "emitters") == 0) {
+        status = benchEmitters(options.particles > 0 ? options.particles : 50000, options.frames) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "profiler") == 0) {
+        status = benchProfiler(options.particles > 0 ? options.particles : 10000000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "spawn") == 0) {
+        status = benchSpawn(options.particles > 0 ? options.particles : 10000000, options.threads) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "sleep") == 0) {
+        status = benchSleep(options.particles > 0 ? options.particles : 20000, options.frames) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "morton") == 0) {
+        benchMorton(options.particles > 0 ? options.particles : 1000000);
+    }
+    else if (strcmp(options.scenario, "attractors") == 0) {
+        status = benchAttractors(options.particles > 0 ? options.particles : 100000) ? 0 : 1;
+    }
+    else if (strcmp(options.scenario, "simd") == 0) {
+        status = benchSimd(options.particles > 0 ? options.particles : 1000000) ? 0 : 1;
+    }
+    else {
+        fprintf(stderr, "unknown scenario '%s'\n", options.scenario);
+        status = 1;
+    }
+    stopThreadPool();
+    return status;
+}
+
+// Function bodies
+
+bool parseBenchOptions(int argc, char** argv, bench_options& options) {
+    options.scenario = "frames";
+    options.particles = 0;
+    options.frames = 300;
+    options.seed = BENCH_SEED;
+    options.attractors = 0;
+    options.threads = THREADS_COUNT;
+    options.gravity = false;
+    options.freeze = false;
+    options.borderFreeze = false;
+    options.spawn = false;
+    options.reorder = true;
+    options.sleep = true;
+    options.snapshot = nullptr;
+    options.simd = -1;
+    options.broadPhase = BROAD_PHASE_GRID;
+    int i = 1;
+    if (argc > 1 && argv[1][0] != '-') {
+        options.scenario = argv[1];
+        i++;
+    }
+    for (; i < argc; i++) {
+        const char* option = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(option, "--particles") == 0 && hasValue) {
+            options.particles = atoi(argv[++i]);
+        }
+        else if (strcmp(option, "--frames") == 0 && hasValue) {
+            options.frames = atoi(argv[++i]);
+        }
+        else if (strcmp(option, "--seed") == 0 && hasValue) {
+            options.seed = atoi(argv[++i]);
+        }
+        else if (strcmp(option, "--attractors") == 0 && hasValue) {
+            options.attractors = atoi(argv[++i]);
+        }
+        else if (strcmp(option, "--threads") == 0 && hasValue) {
+            options.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(option, "--skin") == 0 && hasValue) {
+            VERLET_SKIN = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(option, "--iterations") == 0 && hasValue) {
+            SOLVER_ITERATIONS = atoi(argv[++i]);
+        }
+        else if (strcmp(option, "--restitution") == 0 && hasValue) {
+            RESTITUTION = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(option, "--solve") == 0) {
+            SOLVE_COLLISIONS = true;
+        }
+        else if (strcmp(option, "--nbody") == 0) {
+            NBODY_GRAVITY = NBODY_GRAVITY_BARNES_HUT;
+            if (hasValue && argv[i + 1][0] != '-') {
+                const char* gravity = argv[++i];
+                NBODY_GRAVITY = -1;
+                for (int g = NBODY_GRAVITY_BARNES_HUT; g < NBODY_GRAVITY_COUNT; g++) {
+                    if (strcmp(gravity, nbodyGravityName(g)) == 0) {
+                        NBODY_GRAVITY = g;
+                    }
+                }
+                if (NBODY_GRAVITY < 0) {
+                    fprintf(stderr, "unknown n-body gravity '%s'\n", gravity);
+                    return false;
+                }
+            }
+        }
+        else if (strcmp(option, "--generic-kernels") == 0) {
+            SPECIALISE_UPDATE_KERNELS = false;
+        }
+        else if (strcmp(option, "--field") == 0) {
+            CACHE_ATTRACTOR_FIELD = true;
+        }
+        else if (strcmp(option, "--theta") == 0 && hasValue) {
+            BARNES_HUT_THETA = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(option, "--simd") == 0 && hasValue) {
+            const char* level = argv[++i];
+            options.simd = -1;
+            for (int l = SIMD_SCALAR; l <= SIMD_AVX512; l++) {
+                if (strcmp(level, simdLevelName(l)) == 0) {
+                    options.simd = l;
+                }
+            }
+            if (options.simd < 0) {
+                fprintf(stderr, "unknown instruction set '%s'\n", level);
+                return false;
+            }
+        }
+        else if (strcmp(option, "--broad-phase") == 0 && hasValue) {
+            const char* broadPhase = argv[++i];
+            options.broadPhase = -1;
+            for (int b = 0; b < BROAD_PHASE_COUNT; b++) {
+                if (strcmp(broadPhase, broadPhaseName(b)) == 0) {
+                    options.broadPhase = b;
+                }
+            }
+            if (options.broadPhase < 0) {
+                fprintf(stderr, "unknown broad phase '%s'\n", broadPhase);
+                return false;
+            }
+        }
+        else if (strcmp(option, "--gravity") == 0) {
+            options.gravity = true;
+        }
+        else if (strcmp(option, "--freeze") == 0) {
+            options.freeze = true;
+        }
+        else if (strcmp(option, "--border-freeze") == 0) {
+            options.borderFreeze = true;
+        }
+        else if (strcmp(option, "--spawn") == 0) {
+            options.spawn = true;
+        }
+        else if (strcmp(option, "--no-reorder") == 0) {
+            options.reorder = false;
+        }
+        else if (strcmp(option, "--no-sleep") == 0) {
+            options.sleep = false;
+        }
+        else if (strcmp(option, "--snapshot") == 0 && hasValue) {
+            options.snapshot = argv[++i];
+        }
+        else {
+            fprintf(stderr, "unknown option '%s'\n", option);
+            return false;
+        }
+    }
+    return true;
+}
+
+double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void spawnBenchParticles(int n, ParticleStore& particles) {
+    const float side = sqrt(n / BENCH_DENSITY);
+    reserveParticles(particles, n);
+    spawnRandomParticles(particles, n, 0, side, 0, side);
+}
+
+void spawnClusteredBenchParticles(int n, ParticleStore& particles) {
+    const float side = sqrt(n / BENCH_DENSITY);
+    std::vector<sf::Vector2f> centers(BENCH_CLUSTERS);
+    for (auto& center : centers) {
+        center = sf::Vector2f(randomFloat(0, side), randomFloat(0, side));
+    }
+    reserveParticles(particles, n);
+    for (int i = 0; i < n; i++) {
+        // Box-Muller
+        const float u = randomFloat(1e-6f, 1.f);
+        const float angle = randomFloat(0, 2 * 3.14159265f);
+        const float distance = BENCH_CLUSTER_SPREAD * sqrt(-2 * log(u));
+        const sf::Vector2f center = centers[i % BENCH_CLUSTERS];
+        createParticle(
+            particles,
+            randomFloat(MIN_RADIUS, MAX_RADIUS),
+            false,
+            center + sf::Vector2f(distance * cos(angle), distance * sin(angle)),
+            sf::Vector2f(randomFloat(-10, 10), randomFloat(-10, 10)),
+            randomColorIndex()
+        );
+    }
+}
+
+// Bench scenes reach past the window, where integrateParticles would flag
+// most of them off screen after one frame; this moves them without that.
+void driftBenchParticles(ParticleStore& particles) {
+    for (int i = 0; i < particleCount(particles); i++) {
+        if (!(particles.flags[i] & (PARTICLE_FROZEN | PARTICLE_REMOVED))) {
+            particles.x[i] += particles.vx[i] * TIME;
+            particles.y[i] += particles.vy[i] * TIME;
+        }
+    }
+}
+
+// Frame time of the grid rebuild and collision query, plus moving everything
+// from 1k particles up to maxParticles, growing by 10x.
+void benchGrid(int maxParticles) {
+    printf("%12s %14s %14s\n", "particles", "ms/frame", "ns/particle");
+    for (int n = 1000; n <= maxParticles; n *= 10) {
+        seedRandom(BENCH_SEED);
+        ParticleStore particles;
+        std::vector<attractive_particle> attractive_particles;
+        spawnBenchParticles(n, particles);
+        collideParticles(particles);
+        driftBenchParticles(particles);
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            collideParticles(particles);
+            driftBenchParticles(particles);
+        }
+        double frameMs = elapsedMilliseconds(start) / BENCH_FRAMES;
+        printf("%12d %14.3f %14.1f\n", n, frameMs, frameMs * 1e6 / n);
+        clearParticles(particles, attractive_particles);
+    }
+}
+
+// Bytes per particle and integrate loop cost of the legacy particle struct
+// against the ParticleStore columns.
+void benchStore(int particlesCount) {
+    seedRandom(BENCH_SEED);
+    GRAVITY_ENABLED = true;
+    std::vector<legacy_particle> legacy(particlesCount);
+    for (auto& p : legacy) {
+        p.removed = false;
+        p.freeze = false;
+        p.radius = randomFloat(MIN_RADIUS, MAX_RADIUS);
+        p.position = sf::Vector2f(randomFloat(0, WINDOW_WIDTH), randomFloat(0, WINDOW_HEIGHT));
+        p.velocity = sf::Vector2f(randomFloat(-10, 10), randomFloat(-10, 10));
+        p.shape = sf::CircleShape(p.radius);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        for (auto& p : legacy) {
+            if (p.removed || p.freeze) {
+                continue;
+            }
+            if (GRAVITY_ENABLED) {
+                p.velocity += GRAVITY_FORCE * TIME;
+            }
+            p.position += p.velocity * TIME;
+            p.shape.setPosition(p.position);
+        }
+    }
+    double legacyNs = elapsedMilliseconds(start) * 1e6 / BENCH_FRAMES / particlesCount;
+    legacy.clear();
+    legacy.shrink_to_fit();
+
+    seedRandom(BENCH_SEED);
+    ParticleStore particles;
+    spawnBenchParticles(particlesCount, particles);
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        integrateParticles(particles);
+    }
+    double storeNs = elapsedMilliseconds(start) * 1e6 / BENCH_FRAMES / particlesCount;
+
+    // The legacy figure leaves out the vertex arrays each CircleShape keeps
+    // on the heap, so the real gap is wider than printed.
+    printf("%d particles, integrate loop\n", particlesCount);
+    printf("%16s %16s %16s\n", "layout", "bytes/particle", "ns/particle");
+    printf("%16s %16d %16.2f\n", "legacy struct", static_cast<int>(sizeof(legacy_particle)), legacyNs);
+    printf("%16s %16d %16.2f\n", "ParticleStore", particleStoreBytesPerParticle(), storeNs);
+}
+
+// Cost of filling the batched renderer's vertex array, no window involved
+void benchVertices(int particlesCount) {
+    seedRandom(BENCH_SEED);
+    ParticleStore particles;
+    std::vector<attractive_particle> attractive_particles;
+    spawnBenchParticles(particlesCount, particles);
+    particle_batch batch;
+    initParticleBatch(batch);
+    buildParticleBatchVertices(batch, particles, attractive_particles, 1.f);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        buildParticleBatchVertices(batch, particles, attractive_particles, 1.f);
+    }
+    double frameMs = elapsedMilliseconds(start) / BENCH_FRAMES;
+    printf("%d particles, %d vertices, 1 draw call\n", particlesCount, static_cast<int>(batch.vertices.getVertexCount()));
+    printf("%.3f ms/frame, %.1f ns/particle\n", frameMs, frameMs * 1e6 / particlesCount);
+}
+
+// Runs the same frames as the window loop, minus rendering, and prints the
+// time spent per stage as JSON. With --spawn the left mouse button is held at
+// the centre of the window for the whole run. With --snapshot the run starts
+// from the saved world, settings included, instead of a fresh one.
+bool benchFrames(const bench_options& options) {
+    seedRandom(options.seed);
+    GRAVITY_ENABLED = options.gravity;
+    FREEZE_PARTICLES_ON_COLLAPSE = options.freeze;
+    FREEZE_PARTICLES_ON_BORDER_COLLAPSE = options.borderFreeze;
+    ParticleStore particles;
+    std::vector<attractive_particle> attractive_particles;
+    if (options.snapshot != nullptr) {
+        if (!loadSnapshot(options.snapshot, particles, attractive_particles)) {
+            return false;
+        }
+    }
+    else {
+        reserveParticles(particles, options.particles);
+        initParticles(options.particles, particles);
+        for (int i = 0; i < options.attractors; i++) {
+            sf::Vector2i position(static_cast<int>(randomFloat(0, WINDOW_WIDTH)), static_cast<int>(randomFloat(0, WINDOW_HEIGHT)));
+            spawnAttractiveParticlesOnMousePosition(position, attractive_particles);
+        }
+    }
+    const int particlesCount = particleCount(particles);
+    const int attractorsCount = static_cast<int>(attractive_particles.size());
+
+    const sf::Vector2i spawnPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+    const char* stageNames[] = {"spawn", "collide", "solve", "integrate", "attraction", "compaction", "reorder", "sleep", "frame"};
+    const int stages = 9;
+    const int profileStages[stages] = {PROFILE_SPAWN, PROFILE_COLLIDE, PROFILE_SOLVE, PROFILE_INTEGRATE, PROFILE_ATTRACTION, PROFILE_COMPACTION, PROFILE_REORDER, PROFILE_SLEEP, PROFILE_STEP};
+    double total[stages] = {0};
+    double worst[stages] = {0};
+    resetFrameProfiler(PROFILER);
+    PROFILE_FRAMES = true;
+    for (int frame = 0; frame < options.frames; frame++) {
+        frame_timings timings;
+        simulateStep(particles, attractive_particles, options.spawn, spawnPosition, timings);
+        recordStepTimings(PROFILER, timings);
+        double stage[stages] = {timings.spawn, timings.collide, timings.solve, timings.integrate, timings.attraction, timings.compaction, timings.reorder, timings.sleep, 0};
+        for (int s = 0; s < stages - 1; s++) {
+            stage[stages - 1] += stage[s];
+        }
+        recordProfileMilliseconds(PROFILER, PROFILE_STEP, stage[stages - 1]);
+        for (int s = 0; s < stages; s++) {
+            total[s] += stage[s];
+            worst[s] = std::max(worst[s], stage[s]);
+        }
+    }
+
+    printf("{\n");
+    printf("  \"seed\": %d,\n", options.seed);
+    printf("  \"frames\": %d,\n", options.frames);
+    printf("  \"particles\": %d,\n", particlesCount);
+    printf("  \"attractors\": %d,\n", attractorsCount);
+    printf("  \"threads\": %d,\n", threadPoolSize());
+    printf("  \"flags\": {\"gravity\": %s, \"freeze\": %s, \"borderFreeze\": %s, \"spawn\": %s, \"reorder\": %s, \"solve\": %s, \"sleep\": %s, \"nbody\": \"%s\", \"field\": %s, \"specialised\": %s},\n",
+        GRAVITY_ENABLED ? "true" : "false", FREEZE_PARTICLES_ON_COLLAPSE ? "true" : "false",
+        FREEZE_PARTICLES_ON_BORDER_COLLAPSE ? "true" : "false", options.spawn ? "true" : "false",
+        options.reorder ? "true" : "false", SOLVE_COLLISIONS ? "true" : "false", options.sleep ? "true" : "false",
+        nbodyGravityName(NBODY_GRAVITY), CACHE_ATTRACTOR_FIELD ? "true" : "false",
+        SPECIALISE_UPDATE_KERNELS ? "true" : "false");
+    printf("  \"finalParticles\": %d,\n", particleCount(particles));
+    printf("  \"finalAwake\": %d,\n", awakeParticleCount(particles));
+    printf("  \"stages\": {\n");
+    // Percentiles are over the steps that ran the stage, means over all
+    for (int s = 0; s < stages; s++) {
+        const profile_summary summary = runProfileSummary(PROFILER, profileStages[s]);
+        printf("    \"%s\": {\"totalMs\": %.3f, \"meanMs\": %.4f, \"p50Ms\": %.4f, \"p99Ms\": %.4f, \"maxMs\": %.4f}%s\n",
+            stageNames[s], total[s], options.frames > 0 ? total[s] / options.frames : 0.0, summary.p50Ms, summary.p99Ms, worst[s], s + 1 < stages ? "," : "");
+    }
+    printf("  }\n");
+    printf("}\n");
+    return true;
+}
+
+// Runs the integrate and border kernels at every level this CPU supports on
+// copies of the same store and checks each against the scalar one bit for
+// bit. Some particles are frozen, removed or off the window so every branch
+// is taken, and the count is odd so the scalar tails run too.
+bool benchSimd(int particlesCount) {
+    seedRandom(BENCH_SEED);
+    ParticleStore reference;
+    reserveParticles(reference, particlesCount + 13);
+    for (int i = 0; i < particlesCount + 13; i++) {
+        unsigned char flags = 0;
+        if (nextRandomIndex(threadRandomStream(), 8) == 0) {
+            flags |= PARTICLE_FROZEN;
+        }
+        if (nextRandomIndex(threadRandomStream(), 16) == 0) {
+            flags |= PARTICLE_REMOVED;
+        }
+        pushParticle(
+            reference,
+            randomFloat(MIN_RADIUS, MAX_RADIUS),
+            flags,
+            sf::Vector2f(randomFloat(-50, WINDOW_WIDTH + 50), randomFloat(-50, WINDOW_HEIGHT + 50)),
+            sf::Vector2f(randomFloat(-10, 10), randomFloat(-10, 10)),
+            randomColorIndex()
+        );
+    }
+    const int n = particleCount(reference);
+    const float gravityX = GRAVITY_FORCE.x * TIME;
+    const float gravityY = GRAVITY_FORCE.y * TIME;
+
+    std::vector<unsigned char> referenceBorder(n);
+    ParticleStore expected = reference;
+    borderKernel(SIMD_SCALAR, expected, 0, n, referenceBorder.data());
+    integrateKernel(SIMD_SCALAR, expected, 0, n, gravityX, gravityY, TIME);
+
+    bool identical = true;
+    printf("%10s %16s %16s %10s\n", "level", "integrate ns/p", "border ns/p", "identical");
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+        ParticleStore particles = reference;
+        std::vector<unsigned char> border(n);
+        borderKernel(level, particles, 0, n, border.data());
+        integrateKernel(level, particles, 0, n, gravityX, gravityY, TIME);
+        bool same = border == referenceBorder
+            && memcmp(particles.x.data(), expected.x.data(), n * sizeof(float)) == 0
+            && memcmp(particles.y.data(), expected.y.data(), n * sizeof(float)) == 0
+            && memcmp(particles.vx.data(), expected.vx.data(), n * sizeof(float)) == 0
+            && memcmp(particles.vy.data(), expected.vy.data(), n * sizeof(float)) == 0
+            && particles.flags == expected.flags;
+        identical = identical && same;
+
+        // Timing runs on the already checked copy, frozen lanes keep it from
+        // drifting anywhere interesting
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            integrateKernel(level, particles, 0, n, gravityX, gravityY, TIME);
+        }
+        double integrateNs = elapsedMilliseconds(start) * 1e6 / BENCH_FRAMES / n;
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            borderKernel(level, particles, 0, n, border.data());
+        }
+        double borderNs = elapsedMilliseconds(start) * 1e6 / BENCH_FRAMES / n;
+        printf("%10s %16.2f %16.2f %10s\n", simdLevelName(level), integrateNs, borderNs, same ? "yes" : "no");
+    }
+    return identical;
+}
+
+// Attraction pass cost from 1 to 1000 attractors, scanning every particle
+// against the grid query, on copies of the same window sized scene. The two
+// must leave the same velocities.
+// The field is approximate: its error against the scan is checked against
+// attractorFieldErrorBound at every particle instead
+bool benchAttractors(int particlesCount) {
+    seedRandom(BENCH_SEED);
+    ParticleStore reference;
+    reserveParticles(reference, particlesCount);
+    initParticles(particlesCount, reference);
+    std::vector<attractive_particle> attractive_particles;
+
+    bool identical = true;
+    bool bounded = true;
+    printf("%d particles\n", particlesCount);
+    printf("%12s %12s %12s %10s %10s %12s %12s %12s %10s\n", "attractors", "scan ms", "grid ms", "speedup", "identical",
+        "build ms", "field ms", "mean err %", "bounded");
+    for (int attractors = 1; attractors <= 1000; attractors *= 10) {
+        while (static_cast<int>(attractive_particles.size()) < attractors) {
+            sf::Vector2i position(static_cast<int>(randomFloat(0, WINDOW_WIDTH)), static_cast<int>(randomFloat(0, WINDOW_HEIGHT)));
+            spawnAttractiveParticlesOnMousePosition(position, attractive_particles);
+        }
+        ParticleStore scanned = reference;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            attractParticles(attractive_particles, scanned);
+        }
+        double scanMs = elapsedMilliseconds(start) / BENCH_FRAMES;
+        ParticleStore gridded = reference;
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            attractParticlesWithGrid(attractive_particles, gridded);
+        }
+        double gridMs = elapsedMilliseconds(start) / BENCH_FRAMES;
+        bool same = scanned.vx == gridded.vx && scanned.vy == gridded.vy;
+        identical = identical && same;
+
+        // The first call builds the field, the rest only sample it
+        ParticleStore sampled = reference;
+        start = std::chrono::steady_clock::now();
+        attractParticlesWithField(attractive_particles, sampled);
+        double buildMs = elapsedMilliseconds(start);
+        start = std::chrono::steady_clock::now();
+        for (int frame = 1; frame < BENCH_FRAMES; frame++) {
+            attractParticlesWithField(attractive_particles, sampled);
+        }
+        double fieldMs = elapsedMilliseconds(start) / (BENCH_FRAMES - 1);
+        buildMs -= fieldMs;
+
+        // One step of each from the same velocities, as pulls
+        ParticleStore exact = reference;
+        attractParticles(attractive_particles, exact);
+        ParticleStore cached = reference;
+        attractParticlesWithField(attractive_particles, cached);
+        const float time = stepTime();
+        double error = 0;
+        double pull = 0;
+        bool within = true;
+        for (int i = 0; i < particlesCount; i++) {
+            const float exactX = (exact.vx[i] - reference.vx[i]) / time;
+            const float exactY = (exact.vy[i] - reference.vy[i]) / time;
+            const float differenceX = (cached.vx[i] - exact.vx[i]) / time;
+            const float differenceY = (cached.vy[i] - exact.vy[i]) / time;
+            const float difference = hypot(differenceX, differenceY);
+            error += difference;
+            pull += hypot(exactX, exactY);
+            // Velocities are rounded to float around their own size
+            const float rounding = 1e-5f * (std::fabs(reference.vx[i]) + std::fabs(reference.vy[i]) + 1) / time;
+            if (difference > attractorFieldErrorBound(particlesAttractorField(), reference.x[i], reference.y[i]) + rounding) {
+                within = false;
+            }
+        }
+        bounded = bounded && within;
+        printf("%12d %12.3f %12.3f %9.1fx %10s %12.3f %12.3f %12.3f %10s\n", attractors, scanMs, gridMs, scanMs / gridMs, same ? "yes" : "no",
+            buildMs, fieldMs, pull > 0 ? 100 * error / pull : 0, within ? "yes" : "no");
+    }
+    return identical && bounded;
+}
+
+// Collision query cost of every broad phase on a uniform and a clustered
+// scene. Particles freeze on collapse so any difference in the pairs found
+// shows up in the final state, which has to match across broad phases.
+bool benchBroadPhase(int particlesCount) {
+    FREEZE_PARTICLES_ON_COLLAPSE = true;
+    bool identical = true;
+    printf("%d particles, %d frames\n", particlesCount, BENCH_FRAMES);
+    printf("%12s %12s %14s %10s\n", "scene", "broad phase", "collide ms", "identical");
+    for (int clustered = 0; clustered < 2; clustered++) {
+        seedRandom(BENCH_SEED);
+        ParticleStore scene;
+        if (clustered) {
+            spawnClusteredBenchParticles(particlesCount, scene);
+        }
+        else {
+            spawnBenchParticles(particlesCount, scene);
+        }
+        ParticleStore expected;
+        for (int broadPhase = 0; broadPhase < BROAD_PHASE_COUNT; broadPhase++) {
+            BROAD_PHASE = broadPhase;
+            ParticleStore particles = scene;
+            double collideMs = 0;
+            for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+                auto start = std::chrono::steady_clock::now();
+                collideParticles(particles);
+                collideMs += elapsedMilliseconds(start);
+                driftBenchParticles(particles);
+            }
+            if (broadPhase == 0) {
+                expected = particles;
+            }
+            bool same = particles.x == expected.x && particles.y == expected.y && particles.flags == expected.flags;
+            identical = identical && same;
+            printf("%12s %12s %14.3f %10s\n", clustered ? "clustered" : "uniform", broadPhaseName(broadPhase), collideMs / BENCH_FRAMES, same ? "yes" : "no");
+        }
+    }
+    return identical;
+}
+
+// Mixed-size scenes: particles plus a growing number of attractors, whose
+// circles are 5 to 50 times wider. Collisions through the quadtree against
+// particleContacts' grid, attraction through the quadtree against
+// computeAttraction's scan of every particle; each pair must match, and
+// particles freeze on collapse so the collisions show in the flags.
+bool benchQuadtree(int particlesCount) {
+    FREEZE_PARTICLES_ON_COLLAPSE = true;
+    seedRandom(BENCH_SEED);
+    ParticleStore scene;
+    spawnBenchParticles(particlesCount, scene);
+    const float side = sqrt(particlesCount / BENCH_DENSITY);
+    std::vector<attractive_particle> attractive_particles;
+
+    bool identical = true;
+    printf("%d particles, %d frames\n", particlesCount, BENCH_FRAMES);
+    printf("%12s %14s %14s %14s %14s %10s\n", "attractors", "collide grid", "collide tree", "attract scan", "attract tree", "identical");
+    for (int attractors = 1; attractors <= 1000; attractors *= 10) {
+        while (static_cast<int>(attractive_particles.size()) < attractors) {
+            sf::Vector2i position(static_cast<int>(randomFloat(0, side)), static_cast<int>(randomFloat(0, side)));
+            spawnAttractiveParticlesOnMousePosition(position, attractive_particles);
+        }
+        double ms[4] = {0};
+        ParticleStore results[4];
+        for (int run = 0; run < 4; run++) {
+            BROAD_PHASE = run % 2 == 0 ? BROAD_PHASE_GRID : BROAD_PHASE_QUADTREE;
+            ParticleStore particles = scene;
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+                if (run == 0 || run == 1) {
+                    collideParticles(particles);
+                }
+                else if (run == 2) {
+                    attractParticles(attractive_particles, particles);
+                }
+                else {
+                    attractParticlesWithQuadtree(attractive_particles, particles);
+                }
+            }
+            ms[run] = elapsedMilliseconds(start) / BENCH_FRAMES;
+            results[run] = particles;
+        }
+        bool same = results[0].flags == results[1].flags
+            && results[2].vx == results[3].vx && results[2].vy == results[3].vy;
+        identical = identical && same;
+        printf("%12d %14.3f %14.3f %14.3f %14.3f %10s\n", attractors, ms[0], ms[1], ms[2], ms[3], same ? "yes" : "no");
+    }
+    BROAD_PHASE = BROAD_PHASE_GRID;
+    return identical;
+}
+
+// Spawn order against Z-curve order on the same scene: the locality metric,
+// a cache model of the collision query and the collide plus move frame time.
+// There are no hardware counters to read here, so the model stands in for
+// cache misses: the distinct 64 byte lines of the x column a grid query reads.
+void benchMorton(int particlesCount) {
+    seedRandom(BENCH_SEED);
+    ParticleStore scene;
+    spawnBenchParticles(particlesCount, scene);
+    printf("%d particles, %d frames\n", particlesCount, BENCH_FRAMES);
+    printf("%10s %12s %14s %12s %14s %14s\n", "order", "reorder ms", "locality bits", "lines/query", "collide ms", "frame ms");
+    for (int sorted = 0; sorted < 2; sorted++) {
+        ParticleStore particles = scene;
+        morton_order morton = morton_order();
+        double reorderMs = 0;
+        if (sorted) {
+            auto start = std::chrono::steady_clock::now();
+            computeMortonCodes(particles, morton.codes);
+            reorderParticlesByMorton(morton, particles);
+            reorderMs = elapsedMilliseconds(start);
+        }
+        computeMortonCodes(particles, morton.codes);
+        const float locality = mortonLocality(morton.codes);
+        const double lines = gridCacheLinesPerQuery(particles);
+        collideParticles(particles);
+        driftBenchParticles(particles);
+        double collideMs = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            auto collideStart = std::chrono::steady_clock::now();
+            collideParticles(particles);
+            collideMs += elapsedMilliseconds(collideStart);
+            driftBenchParticles(particles);
+        }
+        const double frameMs = elapsedMilliseconds(start) / BENCH_FRAMES;
+        printf("%10s %12.3f %14.2f %12.2f %14.3f %14.3f\n", sorted ? "morton" : "spawn", reorderMs, locality, lines, collideMs / BENCH_FRAMES, frameMs);
+    }
+}
+
+// Mean number of distinct cache lines of one float column that the 3x3
+// cells around each particle index into
+double gridCacheLinesPerQuery(const ParticleStore& particles) {
+    const int floatsPerLine = 64 / sizeof(float);
+    spatial_grid grid;
+    buildSpatialGrid(grid, particles);
+    std::vector<int> lines;
+    long long total = 0;
+    int queries = 0;
+    for (int i = 0; i < particleCount(particles); i++) {
+        if (grid.particleCell[i] < 0) {
+            continue;
+        }
+        const int column = grid.particleCell[i] % grid.columns;
+        const int row = grid.particleCell[i] / grid.columns;
+        lines.clear();
+        for (int r = std::max(row - 1, 0); r <= std::min(row + 1, grid.rows - 1); r++) {
+            for (int c = std::max(column - 1, 0); c <= std::min(column + 1, grid.columns - 1); c++) {
+                const int cell = r * grid.columns + c;
+                for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+                    lines.push_back(grid.cellParticles[k] / floatsPerLine);
+                }
+            }
+        }
+        std::sort(lines.begin(), lines.end());
+        total += std::unique(lines.begin(), lines.end()) - lines.begin();
+        queries++;
+    }
+    return queries > 0 ? static_cast<double>(total) / queries : 0.0;
+}
+
+// Verlet lists at a range of skins against the grid on the same moving
+// scene, over three times the usual frames so the lists get reused, at the
+// normal and at the slowest TIME. Particles freeze on collapse, so the final
+// state has to match the grid's.
+bool benchVerlet(int particlesCount) {
+    const int frames = BENCH_FRAMES * 3;
+    const float times[] = {0.5f, 0.1f};
+    const float skins[] = {5.f, 10.f, 20.f, 40.f};
+    const float defaultTime = TIME;
+    const float defaultSkin = VERLET_SKIN;
+    FREEZE_PARTICLES_ON_COLLAPSE = true;
+    seedRandom(BENCH_SEED);
+    ParticleStore scene;
+    spawnBenchParticles(particlesCount, scene);
+
+    bool identical = true;
+    printf("%d particles, %d frames\n", particlesCount, frames);
+    printf("%6s %8s %12s %14s %12s %12s %10s\n", "time", "skin", "ms/frame", "frames/build", "mean list", "max list", "identical");
+    for (float time : times) {
+        TIME = time;
+        BROAD_PHASE = BROAD_PHASE_GRID;
+        ParticleStore expected = scene;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            collideParticles(expected);
+            driftBenchParticles(expected);
+        }
+        printf("%6.1f %8s %12.3f %14s %12s %12s %10s\n", time, "grid", elapsedMilliseconds(start) / frames, "-", "-", "-", "-");
+        BROAD_PHASE = BROAD_PHASE_VERLET;
+        for (float skin : skins) {
+            VERLET_SKIN = skin;
+            ParticleStore particles = scene;
+            const long long steps = particlesVerletList().steps;
+            const long long rebuilds = particlesVerletList().rebuilds;
+            start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames; frame++) {
+                collideParticles(particles);
+                driftBenchParticles(particles);
+            }
+            const double verletMs = elapsedMilliseconds(start) / frames;
+            const verlet_list& list = particlesVerletList();
+            const double framesPerBuild = static_cast<double>(list.steps - steps) / std::max(list.rebuilds - rebuilds, 1LL);
+            bool same = particles.x == expected.x && particles.y == expected.y && particles.flags == expected.flags;
+            identical = identical && same;
+            printf("%6.1f %8.1f %12.3f %14.2f %12.2f %12d %10s\n", time, skin, verletMs, framesPerBuild, verletListMeanCandidates(list), list.maxCandidates, same ? "yes" : "no");
+        }
+    }
+    TIME = defaultTime;
+    VERLET_SKIN = defaultSkin;
+    BROAD_PHASE = BROAD_PHASE_GRID;
+    return identical;
+}
+
+// Colouring and solve cost of the contact solver on a uniform and a
+// clustered scene, with the throughput in contacts solved per second over
+// all iterations. The same batches solved serially must give the same
+// store bit for bit, and the overlap left must go down.
+bool benchSolver(int particlesCount) {
+    bool identical = true;
+    printf("%d particles, %d iterations, restitution %.2f\n", particlesCount, SOLVER_ITERATIONS, RESTITUTION);
+    printf("%10s %10s %8s %10s %10s %14s %12s %12s %10s\n", "scene", "contacts", "batches", "color ms", "solve ms", "contacts/s", "overlap in", "overlap out", "identical");
+    for (int clustered = 0; clustered < 2; clustered++) {
+        seedRandom(BENCH_SEED);
+        ParticleStore scene;
+        if (clustered) {
+            spawnClusteredBenchParticles(particlesCount, scene);
+        }
+        else {
+            spawnBenchParticles(particlesCount, scene);
+        }
+        collideParticles(scene);
+        const std::vector<particle_contact> contacts = particleContactBuffer();
+        contact_batches batches;
+        auto start = std::chrono::steady_clock::now();
+        colorContacts(batches, contacts, particleCount(scene));
+        const double colorMs = elapsedMilliseconds(start);
+
+        ParticleStore particles = scene;
+        start = std::chrono::steady_clock::now();
+        solveContacts(batches, particles, SOLVER_ITERATIONS, RESTITUTION);
+        const double solveMs = elapsedMilliseconds(start);
+        ParticleStore serial = scene;
+        for (int iteration = 0; iteration < SOLVER_ITERATIONS; iteration++) {
+            for (const particle_contact& contact : batches.contacts) {
+                solveContact(serial, contact, RESTITUTION);
+            }
+        }
+        bool same = particles.x == serial.x && particles.y == serial.y && particles.vx == serial.vx && particles.vy == serial.vy;
+        identical = identical && same;
+        const double rate = contacts.size() * static_cast<double>(SOLVER_ITERATIONS) / (solveMs / 1000.0);
+        const int batchCount = static_cast<int>(batches.batchStart.size()) - 1;
+        printf("%10s %10d %8d %10.3f %10.3f %14.3g %12.4f %12.4f %10s\n", clustered ? "clustered" : "uniform", static_cast<int>(contacts.size()), batchCount,
+            colorMs, solveMs, rate, meanContactPenetration(scene, contacts), meanContactPenetration(particles, contacts), same ? "yes" : "no");
+    }
+    return identical;
+}
+
+// Saving and loading a world of n particles and a few attractors. The loaded
+// world has to match the saved one column for column, and both have to run
+// the next frames to the same state.
+bool benchSnapshot(int particlesCount) {
+    const char* path = "bench.snapshot";
+    FREEZE_PARTICLES_ON_COLLAPSE = true;
+    seedRandom(BENCH_SEED);
+    ParticleStore saved;
+    std::vector<attractive_particle> savedAttractors;
+    spawnBenchParticles(particlesCount, saved);
+    for (int i = 0; i < 8; i++) {
+        sf::Vector2i position(static_cast<int>(randomFloat(0, WINDOW_WIDTH)), static_cast<int>(randomFloat(0, WINDOW_HEIGHT)));
+        spawnAttractiveParticlesOnMousePosition(position, savedAttractors);
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!saveSnapshot(path, saved, savedAttractors)) {
+        return false;
+    }
+    const double saveMs = elapsedMilliseconds(start);
+    ParticleStore loaded;
+    std::vector<attractive_particle> loadedAttractors;
+    start = std::chrono::steady_clock::now();
+    if (!loadSnapshot(path, loaded, loadedAttractors)) {
+        return false;
+    }
+    const double loadMs = elapsedMilliseconds(start);
+    // Again into the same store, which has its memory already, like F9 in the app
+    start = std::chrono::steady_clock::now();
+    if (!loadSnapshot(path, loaded, loadedAttractors)) {
+        return false;
+    }
+    const double reloadMs = elapsedMilliseconds(start);
+    const double megabytes = (particlesCount * (7 * sizeof(float) + 2)) / 1e6;
+    printf("%d particles, %.1f MB of columns\n", particlesCount, megabytes);
+    printf("save %.3f ms (%.0f MB/s), load %.3f ms (%.0f MB/s), reload %.3f ms (%.0f MB/s)\n", saveMs, megabytes / (saveMs / 1000),
+        loadMs, megabytes / (loadMs / 1000), reloadMs, megabytes / (reloadMs / 1000));
+
+    bool same = loaded.x == saved.x && loaded.y == saved.y && loaded.vx == saved.vx && loaded.vy == saved.vy
+        && loaded.radius == saved.radius && loaded.flags == saved.flags && loaded.colorIndex == saved.colorIndex
+        && loaded.previousX == saved.previousX && loaded.previousY == saved.previousY
+        && loadedAttractors.size() == savedAttractors.size();
+    for (size_t a = 0; same && a < savedAttractors.size(); a++) {
+        same = loadedAttractors[a].position == savedAttractors[a].position && loadedAttractors[a].attractionRadius == savedAttractors[a].attractionRadius;
+    }
+    // Reordering is left out, its schedule is kept across stores
+    const bool defaultReorder = MORTON_REORDER;
+    MORTON_REORDER = false;
+    ParticleStore* worlds[2] = {&saved, &loaded};
+    std::vector<attractive_particle>* attractors[2] = {&savedAttractors, &loadedAttractors};
+    for (int w = 0; w < 2; w++) {
+        FRAMES = 0;
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            frame_timings timings;
+            simulateStep(*worlds[w], *attractors[w], false, sf::Vector2i(), timings);
+        }
+    }
+    MORTON_REORDER = defaultReorder;
+    same = same && loaded.x == saved.x && loaded.y == saved.y && loaded.flags == saved.flags;
+    printf("identical: %s\n", same ? "yes" : "no");
+    remove(path);
+    return same;
+}
+
+// Tree forces against the direct sum on a small clustered scene, for a few
+// opening angles, then build and force times on the full one next to what
+// the direct sum would take
+bool benchNbody(int particlesCount) {
+    const int accuracyBodies = 2000;
+    const float thetas[] = {0.f, 0.3f, 0.5f, 0.7f, 1.f};
+    seedRandom(BENCH_SEED);
+    ParticleStore few;
+    spawnClusteredBenchParticles(accuracyBodies, few);
+    barnes_hut_tree tree;
+    buildBarnesHutTree(tree, few);
+    std::vector<float> exactX(accuracyBodies);
+    std::vector<float> exactY(accuracyBodies);
+    parallelFor(accuracyBodies, 64, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            directAcceleration(tree, k, NBODY_SOFTENING, exactX[k], exactY[k]);
+        }
+    });
+    bool accurate = true;
+    printf("%d bodies, force error against the direct sum\n", accuracyBodies);
+    printf("%8s %12s %12s %12s\n", "theta", "mean %", "p99 %", "max %");
+    for (float theta : thetas) {
+        std::vector<float> ax(accuracyBodies);
+        std::vector<float> ay(accuracyBodies);
+        for (int leaf : tree.leaves) {
+            barnesHutLeafAccelerations(tree, leaf, theta, NBODY_SOFTENING, ax.data(), ay.data());
+        }
+        std::vector<double> errors(accuracyBodies);
+        for (int k = 0; k < accuracyBodies; k++) {
+            const double exact = std::hypot(exactX[k], exactY[k]);
+            errors[k] = 100 * std::hypot(ax[k] - exactX[k], ay[k] - exactY[k]) / std::max(exact, 1e-12);
+        }
+        std::sort(errors.begin(), errors.end());
+        double mean = 0;
+        for (double error : errors) {
+            mean += error / accuracyBodies;
+        }
+        printf("%8.2f %12.4f %12.4f %12.4f\n", theta, mean, errors[accuracyBodies * 99 / 100], errors.back());
+        // The direct sum through the tree, up to float rounding
+        if (theta == 0.f && errors.back() > 0.01) {
+            accurate = false;
+        }
+    }
+
+    // Every instruction set has to give the same bits
+    std::vector<float> levelX[SIMD_AVX512 + 1];
+    std::vector<float> levelY[SIMD_AVX512 + 1];
+    const int defaultLevel = SIMD_LEVEL;
+    for (int level = SIMD_SCALAR; level <= defaultLevel; level++) {
+        SIMD_LEVEL = level;
+        levelX[level].resize(accuracyBodies);
+        levelY[level].resize(accuracyBodies);
+        for (int leaf : tree.leaves) {
+            barnesHutLeafAccelerations(tree, leaf, BARNES_HUT_THETA, NBODY_SOFTENING, levelX[level].data(), levelY[level].data());
+        }
+        if (levelX[level] != levelX[SIMD_SCALAR] || levelY[level] != levelY[SIMD_SCALAR]) {
+            accurate = false;
+        }
+    }
+    SIMD_LEVEL = defaultLevel;
+
+    ParticleStore many;
+    spawnClusteredBenchParticles(particlesCount, many);
+    std::vector<float> ax(particlesCount);
+    std::vector<float> ay(particlesCount);
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < 1000; k++) {
+        float x, y;
+        directAcceleration(tree, k % accuracyBodies, NBODY_SOFTENING, x, y);
+    }
+    // Per pair, measured on the small scene
+    const double pairNs = elapsedMilliseconds(start) * 1e6 / (1000.0 * accuracyBodies);
+    printf("%d bodies, %d threads, direct sum about %.1f s per step\n", particlesCount, threadPoolSize(), pairNs * particlesCount * 1e-9 * particlesCount / threadPoolSize());
+    printf("%8s %12s %12s %12s %14s\n", "theta", "nodes", "build ms", "force ms", "Mbodies/s");
+    for (float theta : {0.3f, 0.5f, 0.8f}) {
+        double buildMs = 0;
+        double forceMs = 0;
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            start = std::chrono::steady_clock::now();
+            buildBarnesHutTree(tree, many);
+            buildMs += elapsedMilliseconds(start);
+            start = std::chrono::steady_clock::now();
+            parallelFor(static_cast<int>(tree.leaves.size()), PARALLEL_GRAIN / BARNES_HUT_LEAF_BODIES, [&](int begin, int end) {
+                for (int l = begin; l < end; l++) {
+                    barnesHutLeafAccelerations(tree, tree.leaves[l], theta, NBODY_SOFTENING, ax.data(), ay.data());
+                }
+            });
+            forceMs += elapsedMilliseconds(start);
+        }
+        buildMs /= BENCH_FRAMES;
+        forceMs /= BENCH_FRAMES;
+        printf("%8.2f %12d %12.3f %12.3f %14.2f\n", theta, static_cast<int>(tree.nodes.size()), buildMs, forceMs,
+            particlesCount / ((buildMs + forceMs) * 1e3));
+    }
+    // The root holds all the mass
+    double mass = 0;
+    for (int k = 0; k < barnesHutBodyCount(tree); k++) {
+        mass += tree.bodyMass[k];
+    }
+    const bool consistent = std::fabs(mass - tree.nodes[0].mass) <= 1e-4 * mass;
+    printf("accurate, same on scalar to %s: %s, root mass matches: %s\n", simdLevelName(defaultLevel), accurate ? "yes" : "no", consistent ? "yes" : "no");
+    return accurate && consistent;
+}
+
+// What a profile scope costs with profiling off and on, over an empty loop,
+// then how close the histogram percentiles come to exact ones on log-uniform
+// samples, and whether recording from every worker at once loses any
+// The mesh scenes have to fit the window, which the mesh covers
+bool benchMesh(int particlesCount) {
+    // Against a plain discrete Fourier transform in double
+    const int fftSize = 64;
+    fft_plan plan;
+    initFftPlan(plan, fftSize);
+    std::vector<float> re(fftSize);
+    std::vector<float> im(fftSize);
+    for (int k = 0; k < fftSize; k++) {
+        re[k] = randomFloat(-1, 1);
+        im[k] = randomFloat(-1, 1);
+    }
+    std::vector<float> inputRe = re;
+    std::vector<float> inputIm = im;
+    fft(plan, re.data(), im.data(), false);
+    double fftError = 0;
+    for (int f = 0; f < fftSize; f++) {
+        double sumRe = 0;
+        double sumIm = 0;
+        for (int k = 0; k < fftSize; k++) {
+            const double angle = -2 * 3.14159265358979323846 * f * k / fftSize;
+            sumRe += inputRe[k] * std::cos(angle) - inputIm[k] * std::sin(angle);
+            sumIm += inputRe[k] * std::sin(angle) + inputIm[k] * std::cos(angle);
+        }
+        fftError = std::max(fftError, std::hypot(re[f] - sumRe, im[f] - sumIm));
+    }
+    fft(plan, re.data(), im.data(), true);
+    double roundTripError = 0;
+    for (int k = 0; k < fftSize; k++) {
+        roundTripError = std::max(roundTripError, static_cast<double>(std::hypot(re[k] / fftSize - inputRe[k], im[k] / fftSize - inputIm[k])));
+    }
+    const bool transformed = fftError < 1e-4 && roundTripError < 1e-5;
+    printf("%d point fft, max error against the dft %.2e, round trip %.2e\n", fftSize, fftError, roundTripError);
+
+    // Errors are against the force scale of the scene, the mean exact pull,
+    // as well as per body: where the pulls around a body cancel, any absolute
+    // error is a large fraction of what is left
+    const int accuracyBodies = 4000;
+    const float extent = static_cast<float>(std::max(WINDOW_WIDTH, WINDOW_HEIGHT));
+    particle_mesh mesh;
+    initParticleMesh(mesh, PARTICLE_MESH_SIZE, extent, NBODY_SOFTENING);
+    bool accurate = true;
+    printf("%d bodies in the window, %d cells a side, force error against the direct sum\n", accuracyBodies, PARTICLE_MESH_SIZE);
+    printf("%10s %12s %12s %12s %14s %14s\n", "scene", "solver", "mean %", "p99 %", "of scale mean", "of scale p99");
+    for (int clustered = 0; clustered < 2; clustered++) {
+        seedRandom(BENCH_SEED);
+        ParticleStore few;
+        if (clustered) {
+            spawnClusteredBenchParticles(accuracyBodies, few);
+            // The clustered scene is under half the window wide, centre it
+            for (int i = 0; i < accuracyBodies; i++) {
+                few.x[i] = std::min(std::max(few.x[i] + extent / 4, 0.f), extent - 1);
+                few.y[i] = std::min(std::max(few.y[i] + extent / 4, 0.f), extent - 1);
+            }
+        }
+        else {
+            spawnRandomParticles(few, accuracyBodies, 0, static_cast<float>(WINDOW_WIDTH), 0, static_cast<float>(WINDOW_HEIGHT));
+        }
+        barnes_hut_tree tree;
+        buildBarnesHutTree(tree, few);
+        std::vector<float> exactX(accuracyBodies);
+        std::vector<float> exactY(accuracyBodies);
+        parallelFor(accuracyBodies, 64, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                directAcceleration(tree, k, NBODY_SOFTENING, exactX[k], exactY[k]);
+            }
+        });
+        double scale = 0;
+        for (int k = 0; k < accuracyBodies; k++) {
+            scale += std::hypot(exactX[k], exactY[k]) / accuracyBodies;
+        }
+        std::vector<float> treeX(accuracyBodies);
+        std::vector<float> treeY(accuracyBodies);
+        for (int leaf : tree.leaves) {
+            barnesHutLeafAccelerations(tree, leaf, BARNES_HUT_THETA, NBODY_SOFTENING, treeX.data(), treeY.data());
+        }
+        depositParticleMesh(mesh, few);
+        solveParticleMesh(mesh);
+        std::vector<float> meshX(accuracyBodies);
+        std::vector<float> meshY(accuracyBodies);
+        for (int k = 0; k < accuracyBodies; k++) {
+            particleMeshAcceleration(mesh, tree.bodyX[k], tree.bodyY[k], meshX[k], meshY[k]);
+        }
+        for (int solver = 0; solver < 2; solver++) {
+            const std::vector<float>& ax = solver == 0 ? treeX : meshX;
+            const std::vector<float>& ay = solver == 0 ? treeY : meshY;
+            std::vector<double> errors(accuracyBodies);
+            std::vector<double> scaledErrors(accuracyBodies);
+            for (int k = 0; k < accuracyBodies; k++) {
+                const double error = std::hypot(ax[k] - exactX[k], ay[k] - exactY[k]);
+                errors[k] = 100 * error / std::max(static_cast<double>(std::hypot(exactX[k], exactY[k])), 1e-12);
+                scaledErrors[k] = 100 * error / scale;
+            }
+            std::sort(errors.begin(), errors.end());
+            std::sort(scaledErrors.begin(), scaledErrors.end());
+            double mean = 0;
+            double scaledMean = 0;
+            for (int k = 0; k < accuracyBodies; k++) {
+                mean += errors[k] / accuracyBodies;
+                scaledMean += scaledErrors[k] / accuracyBodies;
+            }
+            printf("%10s %12s %12.4f %12.4f %14.4f %14.4f\n", clustered ? "clustered" : "uniform", nbodyGravityName(solver == 0 ? NBODY_GRAVITY_BARNES_HUT : NBODY_GRAVITY_MESH),
+                mean, errors[accuracyBodies * 99 / 100], scaledMean, scaledErrors[accuracyBodies * 99 / 100]);
+            // A few cells of resolution: a few percent of the scene's pull
+            if (solver == 1 && scaledMean > 5) {
+                accurate = false;
+            }
+        }
+    }
+
+    seedRandom(BENCH_SEED);
+    ParticleStore many;
+    reserveParticles(many, particlesCount);
+    spawnRandomParticles(many, particlesCount, 0, static_cast<float>(WINDOW_WIDTH), 0, static_cast<float>(WINDOW_HEIGHT));
+    std::vector<float> ax(particlesCount);
+    std::vector<float> ay(particlesCount);
+    double depositMs = 0;
+    double solveMs = 0;
+    double gatherMs = 0;
+    std::vector<float> firstX;
+    bool repeatable = true;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        depositParticleMesh(mesh, many);
+        depositMs += elapsedMilliseconds(start);
+        start = std::chrono::steady_clock::now();
+        solveParticleMesh(mesh);
+        solveMs += elapsedMilliseconds(start);
+        start = std::chrono::steady_clock::now();
+        parallelFor(particlesCount, PARALLEL_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                particleMeshAcceleration(mesh, many.x[i], many.y[i], ax[i], ay[i]);
+            }
+        });
+        gatherMs += elapsedMilliseconds(start);
+        if (frame == 0) {
+            firstX = mesh.forceX;
+        }
+        else if (mesh.forceX != firstX) {
+            repeatable = false;
+        }
+    }
+    depositMs /= BENCH_FRAMES;
+    solveMs /= BENCH_FRAMES;
+    gatherMs /= BENCH_FRAMES;
+    printf("%d bodies, %d threads\n", particlesCount, threadPoolSize());
+    printf("%12s %12s %12s %12s %14s\n", "deposit ms", "solve ms", "gather ms", "total ms", "Mbodies/s");
+    printf("%12.3f %12.3f %12.3f %12.3f %14.2f\n", depositMs, solveMs, gatherMs, depositMs + solveMs + gatherMs,
+        particlesCount / ((depositMs + solveMs + gatherMs) * 1e3));
+    // Every body's mass lands on the grid
+    double mass = 0;
+    for (int i = 0; i < particlesCount; i++) {
+        mass += many.radius[i] * many.radius[i];
+    }
+    const bool conserved = std::fabs(mass - mesh.totalMass) <= 1e-4 * mass;
+    printf("fft matches: %s, accurate: %s, mass conserved: %s, repeatable: %s\n", transformed ? "yes" : "no", accurate ? "yes" : "no",
+        conserved ? "yes" : "no", repeatable ? "yes" : "no");
+    return transformed && accurate && conserved && repeatable;
+}
+
+// The freeze and integrate passes of every flag combination against the
+// generic ones, from the same contacts and store each time
+bool benchKernels(int particlesCount) {
+    seedRandom(BENCH_SEED);
+    ParticleStore scene;
+    spawnBenchParticles(particlesCount, scene);
+    collideParticles(scene);
+    const bool gravity = GRAVITY_ENABLED;
+    const bool freeze = FREEZE_PARTICLES_ON_COLLAPSE;
+    const bool borderFreeze = FREEZE_PARTICLES_ON_BORDER_COLLAPSE;
+    const bool specialise = SPECIALISE_UPDATE_KERNELS;
+
+    bool identical = true;
+    printf("%d particles, %s, %d threads\n", particlesCount, simdLevelName(SIMD_LEVEL), threadPoolSize());
+    printf("%8s %8s %8s %12s %14s %10s %10s\n", "gravity", "freeze", "border", "generic ms", "specialised ms", "speedup", "identical");
+    for (int flags = 0; flags < UPDATE_FLAG_COMBINATIONS; flags++) {
+        GRAVITY_ENABLED = (flags & UPDATE_GRAVITY) != 0;
+        FREEZE_PARTICLES_ON_COLLAPSE = (flags & UPDATE_FREEZE_ON_COLLAPSE) != 0;
+        FREEZE_PARTICLES_ON_BORDER_COLLAPSE = (flags & UPDATE_FREEZE_ON_BORDER_COLLAPSE) != 0;
+        double milliseconds[2] = {0, 0};
+        ParticleStore results[2];
+        for (int specialised = 0; specialised < 2; specialised++) {
+            SPECIALISE_UPDATE_KERNELS = specialised != 0;
+            for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+                results[specialised] = scene;
+                auto start = std::chrono::steady_clock::now();
+                freezeCollidedParticles(results[specialised]);
+                integrateParticles(results[specialised]);
+                milliseconds[specialised] += elapsedMilliseconds(start) / BENCH_FRAMES;
+            }
+        }
+        const bool same = results[0].x == results[1].x && results[0].y == results[1].y && results[0].vx == results[1].vx
+            && results[0].vy == results[1].vy && results[0].flags == results[1].flags;
+        identical = identical && same;
+        printf("%8s %8s %8s %12.3f %14.3f %9.2fx %10s\n", GRAVITY_ENABLED ? "on" : "off", FREEZE_PARTICLES_ON_COLLAPSE ? "on" : "off",
+            FREEZE_PARTICLES_ON_BORDER_COLLAPSE ? "on" : "off", milliseconds[0], milliseconds[1], milliseconds[0] / milliseconds[1], same ? "yes" : "no");
+    }
+    GRAVITY_ENABLED = gravity;
+    FREEZE_PARTICLES_ON_COLLAPSE = freeze;
+    FREEZE_PARTICLES_ON_BORDER_COLLAPSE = borderFreeze;
+    SPECIALISE_UPDATE_KERNELS = specialise;
+    return identical;
+}
+
+// Fountains that keep about particlesCount particles alive, stepped through
+// simulateStep until every emitter has gone through two lifetimes, then
+// measured from the spawn stage's timings. Once there, no step may allocate,
+// Morton reorders and compactions included, every step must keep the pool's
+// reservation, and no burst may come up short of the pool.
+bool benchEmitters(int particlesCount, int frames) {
+    seedRandom(BENCH_SEED);
+    const bool gravity = GRAVITY_ENABLED;
+    GRAVITY_ENABLED = true;
+    FRAMES = 0;
+    ParticleStore particles;
+    std::vector<attractive_particle> attractors;
+    emitter_system& system = particleEmitters();
+    const int pool = particlesCount + particlesCount / 4;
+    initEmitters(system, particles, pool);
+    const int burst = std::max(1, static_cast<int>(particlesCount / (BENCH_EMITTERS * BENCH_EMITTER_RATE * BENCH_EMITTER_LIFETIME)));
+    for (int e = 0; e < BENCH_EMITTERS; e++) {
+        emitter_settings settings = defaultEmitterSettings((e + 0.5f) * WINDOW_WIDTH / BENCH_EMITTERS, WINDOW_HEIGHT - 20.f);
+        settings.rate = BENCH_EMITTER_RATE;
+        settings.burst = burst;
+        settings.lifetime = BENCH_EMITTER_LIFETIME;
+        settings.minSpeed = 20;
+        settings.maxSpeed = 30;
+        addEmitter(system, settings);
+    }
+
+    const double warmup = 2 * BENCH_EMITTER_LIFETIME;
+    const sf::Vector2i spawnPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+    int minLive = pool;
+    int maxLive = 0;
+    long long allocations = 0;
+    int reorders = 0;
+    int compactions = 0;
+    bool reserved = true;
+    long long spawned = 0;
+    long long expired = 0;
+    double spawnMs = 0;
+    int measured = 0;
+    while (system.time < warmup || measured < frames) {
+        const bool measuring = system.time >= warmup;
+        const long long spawnedBefore = system.spawned;
+        const long long expiredBefore = system.expired;
+        frame_timings timings;
+        const long long allocationsBefore = BENCH_ALLOCATIONS;
+        simulateStep(particles, attractors, false, spawnPosition, timings);
+        const long long stepAllocations = BENCH_ALLOCATIONS - allocationsBefore;
+        if (measuring) {
+            measured++;
+            spawnMs += timings.spawn;
+            spawned += system.spawned - spawnedBefore;
+            expired += system.expired - expiredBefore;
+            allocations += stepAllocations;
+            reorders += timings.reorder > 0;
+            compactions += timings.compaction > 0;
+            reserved = reserved && particles.x.capacity() >= static_cast<size_t>(pool) && particles.previousX.capacity() >= static_cast<size_t>(pool)
+                && particles.slotIndex.capacity() >= static_cast<size_t>(pool) && particles.freeSlots.capacity() >= static_cast<size_t>(pool);
+            minLive = std::min(minLive, particleCount(particles));
+            maxLive = std::max(maxLive, particleCount(particles));
+        }
+    }
+
+    printf("%d emitters of %d particles %g times a second living %g s, pool of %d, %d threads\n", BENCH_EMITTERS, burst,
+        BENCH_EMITTER_RATE, BENCH_EMITTER_LIFETIME, pool, threadPoolSize());
+    printf("%10s %14s %12s %12s %12s %14s\n", "steps", "live", "spawned", "expired", "spawn ms", "ns/particle");
+    printf("%10d %6d-%-7d %12lld %12lld %12.4f %14.2f\n", measured, minLive, maxLive, spawned, expired, spawnMs / measured,
+        spawned + expired > 0 ? spawnMs * 1e6 / (spawned + expired) : 0.0);
+    printf("allocations: %lld over %d reorders and %d compactions, pool kept: %s, dropped: %lld\n", allocations, reorders,
+        compactions, reserved ? "yes" : "no", system.dropped);
+    for (int e = 0; e < static_cast<int>(system.emitters.size()); e++) {
+        removeEmitter(system, e);
+    }
+    GRAVITY_ENABLED = gravity;
+    return allocations == 0 && reserved && system.dropped == 0 && spawned > 0 && expired > 0;
+}
+
+bool benchProfiler(int samples) {
+    seedRandom(BENCH_SEED);
+    volatile int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++) {
+        sink = sink + 1;
+    }
+    const double emptyNs = elapsedMilliseconds(start) * 1e6 / samples;
+    double scopeNs[2];
+    for (int enabled = 0; enabled < 2; enabled++) {
+        resetFrameProfiler(PROFILER);
+        PROFILE_FRAMES = enabled == 1;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < samples; i++) {
+            profile_scope scope(PROFILE_EVENTS);
+            sink = sink + 1;
+        }
+        scopeNs[enabled] = elapsedMilliseconds(start) * 1e6 / samples - emptyNs;
+    }
+    printf("%d scopes\n", samples);
+    printf("%10s %14s\n", "profiling", "ns/scope");
+    printf("%10s %14.2f\n", "off", scopeNs[0]);
+    printf("%10s %14.2f\n", "on", scopeNs[1]);
+
+    // 1 us to 100 ms
+    resetFrameProfiler(PROFILER);
+    std::vector<unsigned long long> values(samples);
+    random_stream& stream = threadRandomStream();
+    for (int i = 0; i < samples; i++) {
+        values[i] = static_cast<unsigned long long>(1e3 * std::pow(1e5, nextRandomFloat(stream, 0.f, 1.f)));
+        recordProfileSample(PROFILER, PROFILE_FRAME, values[i]);
+    }
+    std::sort(values.begin(), values.end());
+    const profile_summary summary = runProfileSummary(PROFILER, PROFILE_FRAME);
+    const double exact50 = values[samples / 2] * 1e-6;
+    const double exact99 = values[static_cast<int>(samples * 0.99)] * 1e-6;
+    printf("%10s %14s %14s %10s\n", "", "exact ms", "histogram ms", "error %");
+    printf("%10s %14.4f %14.4f %10.2f\n", "p50", exact50, summary.p50Ms, 100 * std::fabs(summary.p50Ms - exact50) / exact50);
+    printf("%10s %14.4f %14.4f %10.2f\n", "p99", exact99, summary.p99Ms, 100 * std::fabs(summary.p99Ms - exact99) / exact99);
+    printf("%10s %14.4f %14.4f\n", "max", values[samples - 1] * 1e-6, summary.maxMs);
+
+    resetFrameProfiler(PROFILER);
+    parallelFor(samples, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            recordProfileSample(PROFILER, PROFILE_STEP, i);
+        }
+    });
+    const unsigned long long recorded = runProfileSummary(PROFILER, PROFILE_STEP).samples;
+    printf("%d threads recorded %llu of %d samples\n", threadPoolSize(), recorded, samples);
+    PROFILE_FRAMES = false;
+    return recorded == static_cast<unsigned long long>(samples) && summary.maxMs == values[samples - 1] * 1e-6;
+}
+
+// Spawning n particles one createParticle call at a time against one batch,
+// and the batch again on a single thread and with the seed set again, which
+// has to give the same store bit for bit
+bool benchSpawn(int particlesCount, int threads) {
+    printf("%d particles\n", particlesCount);
+    printf("%10s %10s %12s %14s\n", "spawn", "threads", "ms", "ns/particle");
+    seedRandom(BENCH_SEED);
+    ParticleStore single;
+    reserveParticles(single, particlesCount);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < particlesCount; i++) {
+        createParticle(
+            single,
+            randomFloat(MIN_RADIUS, MAX_RADIUS),
+            false,
+            sf::Vector2f(randomFloat(0, WINDOW_WIDTH), randomFloat(0, WINDOW_HEIGHT)),
+            sf::Vector2f(randomFloat(-10, 10), randomFloat(-10, 10)),
+            randomColorIndex()
+        );
+    }
+    double ms = elapsedMilliseconds(start);
+    printf("%10s %10d %12.3f %14.2f\n", "single", 1, ms, ms * 1e6 / particlesCount);
+
+    ParticleStore batches[2];
+    for (int run = 0; run < 2; run++) {
+        if (run == 1) {
+            stopThreadPool();
+            startThreadPool(1);
+        }
+        seedRandom(BENCH_SEED);
+        reserveParticles(batches[run], particlesCount);
+        start = std::chrono::steady_clock::now();
+        spawnRandomParticles(batches[run], particlesCount, 0, WINDOW_WIDTH, 0, WINDOW_HEIGHT);
+        ms = elapsedMilliseconds(start);
+        printf("%10s %10d %12.3f %14.2f\n", "batch", threadPoolSize(), ms, ms * 1e6 / particlesCount);
+    }
+    stopThreadPool();
+    startThreadPool(threads);
+    const bool same = batches[0].x == batches[1].x && batches[0].y == batches[1].y && batches[0].vx == batches[1].vx
+        && batches[0].vy == batches[1].vy && batches[0].radius == batches[1].radius && batches[0].colorIndex == batches[1].colorIndex;
+    printf("reproducible: %s\n", same ? "yes" : "no");
+    return same;
+}
+
+// The window scene with both freezes on, run with and without sleeping.
+// Particles freeze as they meet, so the awake share drops as the run goes
+// on; the last third of the frames shows what a mostly frozen scene costs.
+// Sleeping must not change the outcome: every particle has to end up the
+// same, compared by slot since sleeping moves particles between indices.
+bool benchSleep(int particlesCount, int frames) {
+    const bool defaultSleep = SLEEP_FROZEN_PARTICLES;
+    FREEZE_PARTICLES_ON_COLLAPSE = true;
+    FREEZE_PARTICLES_ON_BORDER_COLLAPSE = true;
+    seedRandom(BENCH_SEED);
+    ParticleStore scene;
+    reserveParticles(scene, particlesCount);
+    initParticles(particlesCount, scene);
+    std::vector<attractive_particle> attractors;
+    for (int i = 0; i < 4; i++) {
+        sf::Vector2i position(static_cast<int>(randomFloat(0, WINDOW_WIDTH)), static_cast<int>(randomFloat(0, WINDOW_HEIGHT)));
+        spawnAttractiveParticlesOnMousePosition(position, attractors);
+    }
+
+    ParticleStore results[2];
+    printf("%d particles, %d attractors, %d frames\n", particlesCount, static_cast<int>(attractors.size()), frames);
+    printf("%8s %12s %14s %10s %12s %10s\n", "sleep", "ms/frame", "late ms/frame", "awake", "fell asleep", "woken");
+    for (int sleep = 0; sleep < 2; sleep++) {
+        SLEEP_FROZEN_PARTICLES = sleep != 0;
+        FRAMES = 0;
+        ParticleStore& particles = results[sleep];
+        particles = scene;
+        std::vector<attractive_particle> attractive_particles = attractors;
+        const sleep_stats before = particleSleepStats();
+        double totalMs = 0;
+        double lateMs = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            frame_timings timings;
+            auto start = std::chrono::steady_clock::now();
+            simulateStep(particles, attractive_particles, false, sf::Vector2i(), timings);
+            const double frameMs = elapsedMilliseconds(start);
+            totalMs += frameMs;
+            if (frame >= frames - frames / 3) {
+                lateMs += frameMs;
+            }
+        }
+        const sleep_stats& after = particleSleepStats();
+        printf("%8s %12.3f %14.3f %10d %12d %10d\n", sleep ? "on" : "off", totalMs / frames, lateMs / std::max(frames / 3, 1),
+            awakeParticleCount(particles), after.fellAsleep - before.fellAsleep, after.woken - before.woken);
+    }
+    SLEEP_FROZEN_PARTICLES = defaultSleep;
+    const bool same = sameParticlesBySlot(results[0], results[1]);
+    printf("identical: %s\n", same ? "yes" : "no");
+    return same;
+}
+
+// Every live slot holds the same particle in both stores
+// The same scene stepped under every broad phase, every SIMD level this CPU
+// supports and 1, 3 and --threads threads has to end in the same store, by
+// slot and bit for bit. Freezing, attractors and mouse spawning are on so
+// every stage runs; --gravity, --nbody, --solve and the others add theirs.
+bool benchDeterminism(const bench_options& options) {
+    const int particlesCount = options.particles > 0 ? options.particles : 20000;
+    const int simdLevel = SIMD_LEVEL;
+    const int broadPhase = BROAD_PHASE;
+    const bool gravity = GRAVITY_ENABLED;
+    const bool freeze = FREEZE_PARTICLES_ON_COLLAPSE;
+    GRAVITY_ENABLED = options.gravity;
+    FREEZE_PARTICLES_ON_COLLAPSE = true;
+    const int threads[] = {1, 3, options.threads};
+    unsigned long long expected = 0;
+    bool identical = true;
+    printf("%d particles, %d steps\n", particlesCount, options.frames);
+    printf("%10s %8s %8s %18s %10s\n", "broad", "simd", "threads", "hash", "identical");
+    for (int b = 0; b < BROAD_PHASE_COUNT; b++) {
+        BROAD_PHASE = b;
+        for (int level = SIMD_SCALAR; level <= simdLevel; level++) {
+            SIMD_LEVEL = level;
+            for (int t : threads) {
+                const unsigned long long hash = runDeterminismScene(particlesCount, options.frames, t);
+                if (b == 0 && level == SIMD_SCALAR && t == threads[0]) {
+                    expected = hash;
+                }
+                identical = identical && hash == expected;
+                printf("%10s %8s %8d %18llx %10s\n", broadPhaseName(b), simdLevelName(level), threadPoolSize(), hash, hash == expected ? "yes" : "no");
+            }
+        }
+    }
+    stopThreadPool();
+    startThreadPool(options.threads);
+    SIMD_LEVEL = simdLevel;
+    BROAD_PHASE = broadPhase;
+    GRAVITY_ENABLED = gravity;
+    FREEZE_PARTICLES_ON_COLLAPSE = freeze;
+    printf("deterministic: %s\n", identical ? "yes" : "no");
+    return identical;
+}
+
+// Runs the scene from a cleared world and the start of the clock, on a pool
+// of the given size, which is left running
+unsigned long long runDeterminismScene(int particlesCount, int frames, int threads) {
+    stopThreadPool();
+    startThreadPool(threads);
+    seedRandom(BENCH_SEED);
+    FRAMES = 0;
+    SECONDS = 0;
+    ParticleStore particles;
+    std::vector<attractive_particle> attractive_particles;
+    clearParticles(particles, attractive_particles);
+    initParticles(particlesCount, particles);
+    for (int i = 0; i < 20; i++) {
+        sf::Vector2i position(static_cast<int>(randomFloat(0, WINDOW_WIDTH)), static_cast<int>(randomFloat(0, WINDOW_HEIGHT)));
+        spawnAttractiveParticlesOnMousePosition(position, attractive_particles);
+    }
+    const sf::Vector2i spawnPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+    for (int frame = 0; frame < frames; frame++) {
+        frame_timings timings;
+        simulateStep(particles, attractive_particles, true, spawnPosition, timings);
+    }
+    return hashParticlesBySlot(particles);
+}
+
+// FNV-1a over every live particle's fields in slot order, so it does not
+// depend on where the particles sit in the store
+unsigned long long hashParticlesBySlot(const ParticleStore& particles) {
+    unsigned long long hash = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t bytes) {
+        const unsigned char* c = static_cast<const unsigned char*>(data);
+        for (size_t k = 0; k < bytes; k++) {
+            hash = (hash ^ c[k]) * 1099511628211ull;
+        }
+    };
+    for (int slot = 0; slot < static_cast<int>(particles.slotIndex.size()); slot++) {
+        const int i = particles.slotIndex[slot];
+        if (i < 0 || i >= particleCount(particles) || particles.slot[i] != slot) {
+            continue;
+        }
+        mix(&slot, sizeof(slot));
+        mix(&particles.x[i], sizeof(float));
+        mix(&particles.y[i], sizeof(float));
+        mix(&particles.vx[i], sizeof(float));
+        mix(&particles.vy[i], sizeof(float));
+        mix(&particles.radius[i], sizeof(float));
+        mix(&particles.flags[i], 1);
+        mix(&particles.colorIndex[i], 1);
+    }
+    return hash;
+}
+
+bool sameParticlesBySlot(const ParticleStore& first, const ParticleStore& second) {
+    if (particleCount(first) != particleCount(second)) {
+        return false;
+    }
+    for (int i = 0; i < particleCount(first); i++) {
+        const int j = second.slotIndex[first.slot[i]];
+        if (j < 0 || j >= particleCount(second) || second.slot[j] != first.slot[i] || first.x[i] != second.x[j] || first.y[i] != second.y[j]
+            || first.vx[i] != second.vx[j] || first.vy[i] != second.vy[j] || first.flags[i] != second.flags[j]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Mean overlap, in pixels, over the given contacts
+double meanContactPenetration(const ParticleStore& particles, const std::vector<particle_contact>& contacts) {
+    double total = 0;
+    for (const particle_contact& contact : contacts) {
+        const sf::Vector2f a(particles.x[contact.a], particles.y[contact.a]);
+        const sf::Vector2f b(particles.x[contact.b], particles.y[contact.b]);
+        total += std::max(0.f, particles.radius[contact.a] + particles.radius[contact.b] - distanceBetweenTwoPoints(a, b));
+    }
+    return contacts.empty() ? 0.0 : total / contacts.size();
+}
@@ -1,108 +1,120 @@
 #include <SFML/Graphics.hpp>
 #include <vector>
 #include <cmath>
-
-// Screen constants
-const int WINDOW_WIDTH = 1000;
-const int WINDOW_HEIGHT = 1000;
-const int FRAME_RATE_LIMIT = 30;
-const int BASE_SPAWN_MARGIN = 20;
-const int MOUSE_CLICK_SPAWN_RANGE = 20;
-
-// Particles
-const int PARTICLES_COUNT = 200;
-const int MOUSE_CLICK_PARTICLES_SPAWN_COUNT = 20;
-bool FREEZE_PARTICLES_ON_COLLAPSE = false;
-bool FREEZE_PARTICLES_ON_BORDER_COLLAPSE = false;
-int LAST_PARTICLE_ID = 0;
-int LAST_ATTRACTIVE_PARTICLE_ID = -1;
-const int MIN_RADIUS = 1;
-const int MAX_RADIUS = 5;
-// Gravity
-bool GRAVITY_ENABLED = false;
-const sf::Vector2f GRAVITY_FORCE(0.f, 1.f);
-// Time 
-float TIME = 0.5;
-int SECONDS = 0;
-int FRAMES = 0;
-// Controls
-bool PAUSED = false;
-bool LEFT_MOUSE_CLICK = false;
-// Colors
-const int COLORS_LENGTH = 7;
-sf::Color COLORS[COLORS_LENGTH] = {sf::Color::White, sf::Color::Green, sf::Color::Blue, sf::Color::Yellow, sf::Color::Red, sf::Color::Magenta, sf::Color::Cyan};
-
-// Types
-typedef struct {
-    int id;
-    float radius;
-    bool freeze;
-    bool removed;
-    sf::Vector2f position;
-    sf::Vector2f velocity;
-    sf::CircleShape shape;
-} particle;
-
-typedef struct {
-    int id;
-    float radius;
-    bool removed;
-    float attractionRadius;
-    sf::Vector2f attraction;
-    sf::Vector2f position;
-    sf::Vector2f velocity;
-    sf::CircleShape shape;
-    sf::CircleShape attraction_shape;
-} attractive_particle;
-
-typedef struct {
-    bool collapsed;
-    particle * collapsedParticle;
-    float distance;
-} particleCollapsed_t;
-
-// Functions 
-void initParticles(int n, std::vector<particle>& particles);
-void renderParticles(sf::RenderWindow& window, std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles);
-void updateParticles(std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles);
-int borderCollapse(particle p);
-int borderCollapse(attractive_particle p);
-float randomFloat(float min, float max);
-particleCollapsed_t particleCollapse(particle& p, std::vector<particle>& particles);
-void clearParticles(std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles);
-void reloadParticles(std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles);
-void spawnMoreParticlesOnMousePositionRange(sf::Vector2i mousePosition, std::vector<particle>& particles);
-bool inParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB);
-bool inAttractionRadiusParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB, float attractionRadius);
-void removeOffScreenParticles(std::vector<particle>& particles);
-void clearRemovedParticlesAndReallocate(std::vector<particle>& particles);
-particle createParticle(int id, float radius, bool freeze, sf::Vector2f position, sf::Vector2f velocity, sf::Color color);
-sf::Color randomColor();
-void resolveCollision(particle& p, particle& p2, float distance);
-void spawnAttractiveParticlesOnMousePosition(sf::Vector2i mousePosition, std::vector<attractive_particle>& attractive_particles);
-void computeAttraction(attractive_particle& p, std::vector<particle>& particles);
-sf::Vector2f normalize(sf::Vector2f v);
-
-// Main workflow
-int _main()
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "Constants.h"
+#include "CpuUsage.h"
+#include "Particle.h"
+#include "ParticleStore.h"
+#include "Particles.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "Renderer.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
+
+// The profiler HUD uses the first font that loads. SFML has no built in one.
+const char* const PROFILE_FONT_PATHS[] = {
+    "profiler.ttf",
+    "C:/Windows/Fonts/consola.ttf",
+    "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+    "/System/Library/Fonts/Menlo.ttc"
+};
+const int PROFILE_FONT_SIZE = 12;
+
+// Functions
+bool loadProfileFont(sf::Font& font);
+void renderParticles(sf::RenderWindow& window, particle_batch& batch, ParticleStore& particles, std::vector<attractive_particle>& attractive_particles, float alpha);
+void showCpuUsage(sf::RenderWindow& window, const cpu_usage_meter& meter, bool paused);
+
+// Main workflow. `--seed N` replays a run, otherwise the seed comes from the
+// clock and is printed so the run can be replayed. `--snapshot PATH` starts
+// from a saved world instead of a fresh one. `--scene PATH` loads emitters,
+// X places one at the mouse and D removes the one under it. `--profile`
+// times the frame stages from the start, H shows them and turns profiling on
+// while shown; whatever was timed goes to PROFILE_CSV_PATH on exit.
+int _main(int argc, char** argv)
 {
-    srand(static_cast<unsigned>(time(0)));
+    unsigned long long seed = static_cast<unsigned long long>(time(0));
+    const char* snapshot = nullptr;
+    const char* scene = nullptr;
+    bool profile = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        }
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshot = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--scene") == 0) {
+            scene = argv[i + 1];
+        }
+    }
+    seedRandom(seed);
+    printf("seed %llu\n", seed);
+    startThreadPool(THREADS_COUNT);
     sf::VideoMode videoMode = sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT);
     sf::RenderWindow window(videoMode, "Particles");
     window.setPosition(sf::Vector2i(0, 0));
     window.setVerticalSyncEnabled(true);
     window.setFramerateLimit(FRAME_RATE_LIMIT);
     
-    std::vector<particle> particles;
+    ParticleStore particles;
     std::vector<attractive_particle> attractive_particles;
+    particle_batch batch;
+    initParticleBatch(batch);
 
-    initParticles(PARTICLES_COUNT, particles);
+    if (snapshot == nullptr || !loadSnapshot(snapshot, particles, attractive_particles)) {
+        initParticles(PARTICLES_COUNT, particles);
+    }
+    initEmitters(particleEmitters(), particles, EMITTER_POOL_PARTICLES);
+    if (scene != nullptr) {
+        loadEmitterScene(scene, particleEmitters(), particles);
+    }
+
+    // Rendering runs at FRAME_RATE_LIMIT, the simulation at SIMULATION_RATE
+    simulation_clock clock;
+    initSimulationClock(clock, SIMULATION_RATE, MAX_SUBSTEPS_PER_FRAME);
+    sf::Clock frameClock;
+
+    // While paused nothing moves, so the last frame is only drawn again when
+    // an event may have changed it (resize, focus, keys, clicks)
+    bool repaint = false;
+    cpu_usage_meter cpuUsage;
+    bool cpuUsagePaused = PAUSED;
+    startCpuUsageMeter(cpuUsage);
+
+    resetFrameProfiler(PROFILER);
+    PROFILE_FRAMES = profile;
+    bool showProfile = false;
+    sf::Font profileFont;
+    const bool profileFontLoaded = loadProfileFont(profileFont);
+    sf::Text profileText;
+    profileText.setFont(profileFont);
+    profileText.setCharacterSize(PROFILE_FONT_SIZE);
+    profileText.setFillColor(sf::Color::White);
+    profileText.setPosition(8.f, 8.f);
+    char profileReport[1024];
 
     while (window.isOpen())
     {
+        profile_scope frameScope(PROFILE_FRAME);
+        profile_scope eventsScope(PROFILE_EVENTS);
         sf::Event event;
         while (window.pollEvent(event))
         {
+            if (event.type != sf::Event::MouseMoved) {
+                repaint = true;
+            }
             if (event.type == sf::Event::Closed) {
                 window.close();
             }
@@ -142,15 +154,56 @@ int _main()
                 case sf::Keyboard::G:
                     GRAVITY_ENABLED = !GRAVITY_ENABLED;
                     break;
+                case sf::Keyboard::A:
+                    CACHE_ATTRACTOR_FIELD = !CACHE_ATTRACTOR_FIELD;
+                    break;
+                case sf::Keyboard::N:
+                    NBODY_GRAVITY = (NBODY_GRAVITY + 1) % NBODY_GRAVITY_COUNT;
+                    break;
+                case sf::Keyboard::T:
+                    BARNES_HUT_THETA = BARNES_HUT_THETA < 0.4f ? 0.5f : BARNES_HUT_THETA < 0.6f ? 0.8f : 0.3f;
+                    break;
                 case sf::Keyboard::R:
                     reloadParticles(particles, attractive_particles);
                     break;
                 case sf::Keyboard::Space:
                     PAUSED = !PAUSED;
                     break;
+                case sf::Keyboard::P:
+                    BROAD_PHASE = (BROAD_PHASE + 1) % BROAD_PHASE_COUNT;
+                    break;
+                case sf::Keyboard::S:
+                    SOLVE_COLLISIONS = !SOLVE_COLLISIONS;
+                    break;
+                case sf::Keyboard::E:
+                    RESTITUTION = RESTITUTION > 0.9f ? 0.5f : RESTITUTION > 0.4f ? 0.f : 1.f;
+                    break;
+                case sf::Keyboard::M:
+                    MORTON_REORDER = !MORTON_REORDER;
+                    break;
+                case sf::Keyboard::Z:
+                    SLEEP_FROZEN_PARTICLES = !SLEEP_FROZEN_PARTICLES;
+                    break;
                 case sf::Keyboard::C:
                     clearParticles(particles, attractive_particles);
                     break;
+                case sf::Keyboard::X:
+                    placeEmitterOnMousePosition(sf::Mouse::getPosition(window));
+                    break;
+                case sf::Keyboard::D:
+                    removeEmitterOnMousePosition(sf::Mouse::getPosition(window));
+                    break;
+                case sf::Keyboard::F5:
+                    saveSnapshot(SNAPSHOT_PATH, particles, attractive_particles);
+                    break;
+                case sf::Keyboard::F9:
+                    loadSnapshot(SNAPSHOT_PATH, particles, attractive_particles);
+                    break;
+                case sf::Keyboard::H:
+                    showProfile = !showProfile;
+                    PROFILE_FRAMES = showProfile || profile;
+                    profileText.setString("");
+                    break;
                 case sf::Keyboard::Right:
                     TIME = TIME == 0.1 ? 0.5 : 1.f;
                     break;
@@ -162,308 +215,79 @@ int _main()
                 }
             }
         }
-        FRAMES++;
-        if (FRAMES >= FRAME_RATE_LIMIT) {
-            SECONDS++;
-            FRAMES = 0;
-            clearRemovedParticlesAndReallocate(particles);
-        }
-        if (PAUSED) {
-            continue;
-        }
-        if (LEFT_MOUSE_CLICK && FRAMES % 2 == 0) {
-            spawnMoreParticlesOnMousePositionRange(sf::Mouse::getPosition(window), particles);
-        }
-        updateParticles(particles, attractive_particles);
-        removeOffScreenParticles(particles);
-        window.clear();
-        renderParticles(window, particles, attractive_particles);
-        window.display();
-    }
-
-    return 0;
-}
-
-// Function bodies
-
-sf::Color randomColor() {
-    return COLORS[(rand() % COLORS_LENGTH) - 1];
-}
-
-void clearRemovedParticlesAndReallocate(std::vector<particle>& particles) {
-    for (auto it = particles.begin(); it != particles.end();) {
-        if (it->removed) {
-            it = particles.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
-}
-
-void removeOffScreenParticles(std::vector<particle>& particles) {
-    for (auto& p : particles) {
-        bool offX = p.position.x + p.radius * 2 < 0.f || p.position.x - p.radius * 2 > WINDOW_WIDTH;
-        bool offY = p.position.y + p.radius * 2 < 0.f || p.position.y - p.radius * 2 > WINDOW_HEIGHT;
-        p.removed = offX || offY; 
-    }
-}
-
-void spawnMoreParticlesOnMousePositionRange(sf::Vector2i mousePosition, std::vector<particle>& particles) {
-    for (int i = 0; i < MOUSE_CLICK_PARTICLES_SPAWN_COUNT; i++) {
-        float minX = mousePosition.x - MOUSE_CLICK_SPAWN_RANGE;
-        if (minX <= 0) {
-            minX = mousePosition.x + BASE_SPAWN_MARGIN;
-        }
-        float maxX = mousePosition.x + MOUSE_CLICK_SPAWN_RANGE;
-        if (maxX >= WINDOW_WIDTH) {
-            maxX = mousePosition.x - BASE_SPAWN_MARGIN;
-        }
-        float minY = mousePosition.y - MOUSE_CLICK_SPAWN_RANGE;
-        if (minY <= 0) {
-            minX = mousePosition.y + BASE_SPAWN_MARGIN;
-        }
-        float maxY = mousePosition.y + MOUSE_CLICK_SPAWN_RANGE;
-        if (maxY >= WINDOW_HEIGHT) {
-            maxX = mousePosition.y - BASE_SPAWN_MARGIN;
-        }
-        particle p = createParticle(
-            i,
-            randomFloat(MIN_RADIUS, MAX_RADIUS),
-            false,
-            sf::Vector2f(randomFloat(minX, maxX), randomFloat(minY, maxY)),
-            sf::Vector2f(randomFloat(-10, 10), randomFloat(-10, 10)), randomColor()
-        );
-        particles.push_back(p);
-    }
-}
-
-void reloadParticles(std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles) {
-    clearParticles(particles, attractive_particles);
-    initParticles(PARTICLES_COUNT, particles);
-}
-
-void clearParticles(std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles) {
-    particles.clear();
-    LAST_PARTICLE_ID = 0;
-    LAST_ATTRACTIVE_PARTICLE_ID = -1;
-    attractive_particles.clear();
-}
-
-void initParticles(int n, std::vector<particle> &particles) {
-    for (int i = 0; i < n; i++) {
-        particle p = createParticle(
-            i,
-            randomFloat(MIN_RADIUS, MAX_RADIUS),
-            false, 
-            sf::Vector2f(randomFloat(BASE_SPAWN_MARGIN, WINDOW_WIDTH - BASE_SPAWN_MARGIN), randomFloat(BASE_SPAWN_MARGIN, WINDOW_HEIGHT - BASE_SPAWN_MARGIN)),
-            sf::Vector2f(randomFloat(-10, 10), randomFloat(-10, 10)),
-            randomColor()
-        );
-        particles.push_back(p);
-    }
-}
-
-void renderParticles(sf::RenderWindow& window, std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles) {
-    for (auto &p : particles) {
-        window.draw(p.shape);
-    }
-    for (auto& p : attractive_particles) {
-        window.draw(p.attraction_shape);
-        window.draw(p.shape);
-    }
-}
-
-void resolveCollision(particle& p, particle& p2, float distance) {
-    sf::Vector2f unit_cent = p.position - p2.position / distance;
-    p.velocity = p.velocity - unit_cent * 0.01f;
-    p2.velocity = p2.velocity + unit_cent * 0.01f;
-}
-
-void updateParticles(std::vector<particle>& particles, std::vector<attractive_particle>& attractive_particles) {
-    for (auto &p : particles) {
-        if (p.removed) {
-            continue;
+        eventsScope.stop();
+        const int substeps = advanceSimulationClock(clock, frameClock.restart().asSeconds());
+        for (int s = 0; s < substeps; s++) {
+            profile_scope stepScope(PROFILE_STEP);
+            frame_timings timings;
+            simulateStep(particles, attractive_particles, LEFT_MOUSE_CLICK, sf::Mouse::getPosition(window), timings);
+            recordStepTimings(PROFILER, timings);
         }
-        int borderCollapsed = borderCollapse(p);
-        if (borderCollapsed != 0) {
-            p.freeze = FREEZE_PARTICLES_ON_BORDER_COLLAPSE;
+        // The figures change once per window, so does the HUD
+        if (PROFILE_FRAMES && rotateFrameProfiler(PROFILER) && showProfile) {
+            formatProfileReport(PROFILER, profileReport, sizeof(profileReport));
+            if (profileFontLoaded) {
+                profileText.setString(profileReport);
+            }
+            else {
+                printf("%s\n", profileReport);
+            }
+            repaint = true;
         }
-        particleCollapsed_t particleCollapsed = particleCollapse(p, particles);
-        if (particleCollapsed.collapsed) {
-            p.freeze = FREEZE_PARTICLES_ON_COLLAPSE;
-            particleCollapsed.collapsedParticle->freeze = FREEZE_PARTICLES_ON_COLLAPSE;
-            // resolveCollision(p, *particleCollapsed.collapsedParticle, particleCollapsed.distance);
+        // Each reading covers one state only
+        if (PAUSED != cpuUsagePaused) {
+            cpuUsagePaused = PAUSED;
+            startCpuUsageMeter(cpuUsage);
         }
-        if (!p.freeze) {
-            if (GRAVITY_ENABLED) {
-                p.velocity += GRAVITY_FORCE * TIME;
-            }
-            p.position += p.velocity * TIME;
+        if (updateCpuUsageMeter(cpuUsage)) {
+            showCpuUsage(window, cpuUsage, PAUSED);
         }
-        p.shape.setPosition(p.position);
-    }
-    for (auto& p : attractive_particles) {
-        if (p.removed) {
+        // The steps above keep running while paused, so compaction stays on
+        // schedule; without a frame to display the loop sleeps a frame time
+        // instead of spinning on pollEvent. Paused steps do not save
+        // positions, so a repaint draws the current ones.
+        if (PAUSED && !repaint) {
+            sf::sleep(sf::seconds(1.f / FRAME_RATE_LIMIT));
             continue;
         }
-        if (GRAVITY_ENABLED) {
-            p.velocity += GRAVITY_FORCE * TIME;
-        }
-        int borderCollapsed = borderCollapse(p);
-        if (borderCollapsed == 0) {
-            p.position += p.velocity * TIME;
+        repaint = false;
+        profile_scope renderScope(PROFILE_RENDER);
+        window.clear();
+        renderParticles(window, batch, particles, attractive_particles, PAUSED ? 1.f : clock.alpha);
+        if (showProfile) {
+            window.draw(profileText);
         }
-        computeAttraction(p, particles);
-        p.shape.setPosition(p.position);
-        p.attraction_shape.setPosition(p.position - sf::Vector2f(p.attractionRadius - p.radius, p.attractionRadius - p.radius));
-    }
-}
-
-int borderCollapse(particle p) {
-    if (p.removed) {
-        return 0;
-    }
-    const float diameter = p.radius * 2;
-    if (p.position.x + diameter > WINDOW_WIDTH) {
-        return 2;
-    }
-    if (p.position.x - p.radius < 0) {
-        return -2;
-    }
-    if (p.position.y - diameter < 0) {
-        return -1;
-    }
-    if (p.position.y + diameter > WINDOW_HEIGHT) {
-        return 1;
+        renderScope.stop();
+        // Includes the wait for vertical sync
+        profile_scope displayScope(PROFILE_DISPLAY);
+        window.display();
     }
-    return 0;
-}
 
-int borderCollapse(attractive_particle p) {
-    if (p.removed) {
-        return 0;
-    }
-    const float diameter = p.radius * 2;
-    if (p.position.x + diameter > WINDOW_WIDTH) {
-        return 2;
-    }
-    if (p.position.x - p.radius < 0) {
-        return -2;
-    }
-    if (p.position.y - diameter < 0) {
-        return -1;
-    }
-    if (p.position.y + diameter > WINDOW_HEIGHT) {
-        return 1;
+    if (runProfileSummary(PROFILER, PROFILE_FRAME).samples > 0) {
+        writeProfileCsv(PROFILER, PROFILE_CSV_PATH, PROFILE_HISTOGRAM_CSV_PATH);
     }
+    stopThreadPool();
     return 0;
 }
 
-float randomFloat(float min, float max) {
-    return min + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (max - min)));
-}
-
-float distanceBetweenTwoPoints(sf::Vector2f a, sf::Vector2f b) {
-    return sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2));
-}
-
-bool inParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB) {
-    float rangeX = positionA.x + MAX_RADIUS * 2;
-    float rangeY = positionA.y + MAX_RADIUS * 2;
-    return positionB.x <= rangeX && positionB.x >= -rangeX && positionB.y <= rangeY && positionB.y >= -rangeY;
-}
-
-bool inAttractionRadiusParticleCollapsePositionRange(sf::Vector2f positionA, sf::Vector2f positionB, float attractionRadius) {
-    float rangeX = positionA.x + attractionRadius * 2;
-    float rangeY = positionA.y + attractionRadius * 2;
-    return positionB.x <= rangeX && positionB.x >= -rangeX && positionB.y <= rangeY && positionB.y >= -rangeY;
-}
+// Function bodies
 
-particleCollapsed_t particleCollapse(particle& p, std::vector<particle>& particles) {
-    particleCollapsed_t result;
-    result.collapsed = false;
-    for (auto& otherParticle : particles) {
-        if (otherParticle.removed || !inParticleCollapsePositionRange(p.position, otherParticle.position)) {
-            continue;
-        }
-        if (otherParticle.id == p.id) {
-            return result;
-        }
-        float distance = distanceBetweenTwoPoints(p.position, otherParticle.position);
-        if (distance < p.radius + otherParticle.radius) {
-            result.collapsed = true;
-            result.distance = distance;
-            result.collapsedParticle = &otherParticle;
-            return result;
+bool loadProfileFont(sf::Font& font) {
+    for (const char* path : PROFILE_FONT_PATHS) {
+        if (font.loadFromFile(path)) {
+            return true;
         }
     }
-    return result;
+    return false;
 }
 
-particle createParticle(int id, float radius, bool freeze, sf::Vector2f position, sf::Vector2f velocity, sf::Color color) {
-    particle p;
-    p.removed = false;
-    p.id = LAST_PARTICLE_ID + id;
-    if (p.id >= LAST_PARTICLE_ID) {
-        LAST_PARTICLE_ID = p.id;
-    }
-    p.radius = radius;
-    p.freeze = freeze;
-    p.position = position;
-    p.velocity = velocity;
-    p.shape = sf::CircleShape(p.radius);
-    p.shape.setFillColor(color);
-    p.shape.setPosition(p.position);
-    return p;
-}
-
-
-void spawnAttractiveParticlesOnMousePosition(sf::Vector2i mousePosition, std::vector<attractive_particle>& attractive_particles) {
-    attractive_particle p;
-    p.id = LAST_ATTRACTIVE_PARTICLE_ID - 1;
-    LAST_PARTICLE_ID--;
-    p.removed = false;
-    p.radius = randomFloat(0.5 + MAX_RADIUS / 2, MAX_RADIUS);
-    p.attractionRadius = pow(p.radius, 3);
-    p.attraction = sf::Vector2f(10.f, 10.f);
-    p.position = sf::Vector2f(static_cast<float>(mousePosition.x), static_cast<float>(mousePosition.y));
-    p.velocity = sf::Vector2f(0.f, 0.f);
-    p.shape = sf::CircleShape(p.radius);
-    p.attraction_shape = sf::CircleShape(p.attractionRadius);
-    p.attraction_shape.setPosition(p.position - sf::Vector2f(p.attractionRadius - p.radius, p.attractionRadius - p.radius));
-    p.attraction_shape.setOutlineColor(sf::Color(255, 0, 0, 60));
-    p.attraction_shape.setFillColor(sf::Color::Transparent);
-    p.attraction_shape.setOutlineThickness(1);
-    p.shape.setPosition(p.position);
-    p.shape.setFillColor(sf::Color::Red);
-    attractive_particles.push_back(p);
+void renderParticles(sf::RenderWindow& window, particle_batch& batch, ParticleStore& particles, std::vector<attractive_particle>& attractive_particles, float alpha) {
+    buildParticleBatchVertices(batch, particles, attractive_particles, alpha);
+    window.draw(batch.vertices);
 }
 
-void computeAttraction(attractive_particle& p, std::vector<particle>& particles) {
-    if (p.removed) {
-        return;
-    }
-    for (auto& otherParticle : particles) {
-        if (otherParticle.removed || !inAttractionRadiusParticleCollapsePositionRange(p.position, otherParticle.position, p.attractionRadius)) {
-            continue;
-        }
-        sf::Vector2f distance = p.position - otherParticle.position;
-        float absoluteDistance = hypot(distance.x, distance.y);
-        if (absoluteDistance > p.attractionRadius + otherParticle.radius) {
-            continue;
-        }
-        sf::Vector2f distanceNorm = normalize(distance);
-        sf::Vector2f attraction(distanceNorm.x, distanceNorm.y);
-        attraction.x *= p.attraction.x;
-        attraction.y *= p.attraction.y;
-        otherParticle.velocity += attraction * TIME;
-    }
+void showCpuUsage(sf::RenderWindow& window, const cpu_usage_meter& meter, bool paused) {
+    char title[64];
+    snprintf(title, sizeof(title), "Particles - %s - %.2f CPU s/s", paused ? "paused" : "running", meter.cpuPerWallSecond);
+    window.setTitle(title);
 }
-
-sf::Vector2f normalize(sf::Vector2f v) {
-    float mag = hypot(v.x, v.y);
-    v.x = v.x / mag;
-    v.y = v.y / mag;
-    return v;
-}
\ No newline at end of file
@@ -154,7 +154,7 @@ int main()
 // Function bodies
 
 sf::Color randomColor() {
-    return COLORS[(rand() % COLORS_LENGTH) - 1];
+    return COLORS[rand() % COLORS_LENGTH];
 }
 
 void clearRemovedParticlesAndReallocate(std::vector<particle>& particles) {